@@ -0,0 +1,218 @@
+/**
+ * @file lwc_bench.cpp
+ * @brief lwc_bench 的入口：收集各个 lwc_bench_*.cpp 注册的用例组，跑完打印表格，可选输出 JSON
+ *
+ *  lwc_bench [--json out.json] [--filter substr] [--samples N] [--warmup N] [--quick] [--list]
+ */
+#include "lwc_bench.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+namespace comm {
+
+    namespace bench {
+
+        struct group_t {
+            char const*     name;
+            BenchFunction   function;
+        };
+
+        static std::vector<group_t>& Groups() {
+            static std::vector<group_t> groups;
+            return groups;
+        }
+
+        BenchRegistrar::BenchRegistrar(char const* group, BenchFunction function) {
+            Groups().push_back({ group, function });
+        }
+
+        BenchResult& BenchContext::begin(std::string const& name, uint32_t threads, uint64_t ops, uint64_t bytesPerOp) {
+            _results.push_back({ _prefix + "/" + name, threads, ops, bytesPerOp, {}, {} });
+            _results.back().samples.reserve(_options.sampleCount);
+            fprintf(stderr, "  %s\n", _results.back().name.c_str());
+            return _results.back();
+        }
+
+        uint64_t BenchContext::scaled(uint64_t ops) const {
+            return std::max<uint64_t>(1, (uint64_t)((double)ops * _options.scale));
+        }
+
+        bool BenchContext::enabled(std::string const& name) const {
+            return _options.filter.empty() || (_prefix + "/" + name).find(_options.filter) != std::string::npos;
+        }
+
+        std::vector<uint32_t> ThreadCounts() {
+            uint32_t limit = std::max<uint32_t>(8, std::thread::hardware_concurrency() * 2);
+            std::vector<uint32_t> counts;
+            for(uint32_t count = 1; count <= limit; count <<= 1) {
+                counts.push_back(count);
+            }
+            return counts;
+        }
+
+        struct summary_t {
+            double  min;
+            double  mean;
+            double  p50;
+            double  p90;
+            double  p99;
+            double  max;
+        };
+
+        // 最近秩法取分位数，样本少的时候 p99 就是最大值
+        static summary_t Summarize(std::vector<double> samples) {
+            summary_t summary = {};
+            if(samples.empty()) {
+                return summary;
+            }
+            std::sort(samples.begin(), samples.end());
+            auto percentile = [&](double q) {
+                size_t rank = (size_t)std::ceil(q * (double)samples.size());
+                return samples[std::clamp<size_t>(rank, 1, samples.size()) - 1];
+            };
+            double total = 0;
+            for(double sample : samples) {
+                total += sample;
+            }
+            summary.min = samples.front();
+            summary.mean = total / (double)samples.size();
+            summary.p50 = percentile(0.50);
+            summary.p90 = percentile(0.90);
+            summary.p99 = percentile(0.99);
+            summary.max = samples.back();
+            return summary;
+        }
+
+        static std::string JsonEscape(std::string const& text) {
+            std::string rst;
+            for(char c : text) {
+                if(c == '"' || c == '\\') {
+                    rst.push_back('\\');
+                }
+                rst.push_back(c);
+            }
+            return rst;
+        }
+
+        static bool WriteJson(char const* path, BenchOptions const& options, std::deque<BenchResult> const& results) {
+            FILE* file = fopen(path, "wb");
+            if(!file) {
+                return false;
+            }
+            fprintf(file, "{\n");
+            fprintf(file, "  \"suite\": \"lwc_bench\",\n");
+            fprintf(file, "  \"timestamp\": %lld,\n", (long long)time(nullptr));
+            fprintf(file, "  \"hardware_concurrency\": %u,\n", std::thread::hardware_concurrency());
+            fprintf(file, "  \"samples\": %u,\n", options.sampleCount);
+            fprintf(file, "  \"warmup\": %u,\n", options.warmupCount);
+            fprintf(file, "  \"scale\": %g,\n", options.scale);
+            fprintf(file, "  \"results\": [");
+            for(size_t i = 0; i < results.size(); ++i) {
+                auto const& result = results[i];
+                summary_t summary = Summarize(result.samples);
+                fprintf(file, "%s\n    {\n", i ? "," : "");
+                fprintf(file, "      \"name\": \"%s\",\n", JsonEscape(result.name).c_str());
+                fprintf(file, "      \"threads\": %u,\n", result.threads);
+                fprintf(file, "      \"ops_per_sample\": %llu,\n", (unsigned long long)result.opsPerSample);
+                fprintf(file, "      \"unit\": \"ns/op\",\n");
+                fprintf(file, "      \"min\": %.3f, \"mean\": %.3f, \"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, \"max\": %.3f,\n",
+                    summary.min, summary.mean, summary.p50, summary.p90, summary.p99, summary.max);
+                fprintf(file, "      \"ops_per_sec\": %.1f", summary.p50 > 0 ? 1e9 / summary.p50 : 0.0);
+                if(result.bytesPerOp) {
+                    fprintf(file, ",\n      \"bytes_per_sec\": %.1f", summary.p50 > 0 ? 1e9 / summary.p50 * (double)result.bytesPerOp : 0.0);
+                }
+                if(!result.counters.empty()) {
+                    fprintf(file, ",\n      \"counters\": {");
+                    bool first = true;
+                    for(auto const& counter : result.counters) {
+                        fprintf(file, "%s \"%s\": %g", first ? "" : ",", JsonEscape(counter.first).c_str(), counter.second);
+                        first = false;
+                    }
+                    fprintf(file, " }");
+                }
+                fprintf(file, ",\n      \"samples\": [");
+                for(size_t k = 0; k < result.samples.size(); ++k) {
+                    fprintf(file, "%s%.3f", k ? ", " : "", result.samples[k]);
+                }
+                fprintf(file, "]\n    }");
+            }
+            fprintf(file, "\n  ]\n}\n");
+            fclose(file);
+            return true;
+        }
+
+        static void PrintTable(std::deque<BenchResult> const& results) {
+            printf("%-48s %4s %10s %10s %10s %10s %12s\n", "name", "thr", "p50", "p90", "p99", "min", "Mops/s");
+            for(auto const& result : results) {
+                summary_t summary = Summarize(result.samples);
+                printf("%-48s %4u %10.1f %10.1f %10.1f %10.1f %12.2f", result.name.c_str(), result.threads,
+                    summary.p50, summary.p90, summary.p99, summary.min, summary.p50 > 0 ? 1e3 / summary.p50 : 0.0);
+                if(result.bytesPerOp && summary.p50 > 0) {
+                    printf("   %.1f MB/s", 1e9 / summary.p50 * (double)result.bytesPerOp / (1024.0 * 1024.0));
+                }
+                for(auto const& counter : result.counters) {
+                    printf("   %s=%g", counter.first.c_str(), counter.second);
+                }
+                printf("\n");
+            }
+        }
+
+    }
+
+}
+
+int main(int argc, char** argv) {
+    using namespace comm::bench;
+    BenchOptions options;
+    char const* jsonPath = nullptr;
+    bool list = false;
+    for(int i = 1; i < argc; ++i) {
+        if(!strcmp(argv[i], "--json") && i + 1 < argc) {
+            jsonPath = argv[++i];
+        } else if(!strcmp(argv[i], "--filter") && i + 1 < argc) {
+            options.filter = argv[++i];
+        } else if(!strcmp(argv[i], "--samples") && i + 1 < argc) {
+            options.sampleCount = std::max(1, atoi(argv[++i]));
+        } else if(!strcmp(argv[i], "--warmup") && i + 1 < argc) {
+            options.warmupCount = (uint32_t)std::max(0, atoi(argv[++i]));
+        } else if(!strcmp(argv[i], "--quick")) {
+            options.scale = 0.05;
+            options.sampleCount = 5;
+            options.warmupCount = 1;
+        } else if(!strcmp(argv[i], "--list")) {
+            list = true;
+        } else {
+            fprintf(stderr, "usage: %s [--json out.json] [--filter substr] [--samples N] [--warmup N] [--quick] [--list]\n", argv[0]);
+            return 1;
+        }
+    }
+    // 注册顺序取决于链接顺序，排一下保证每次输出顺序一样
+    std::sort(Groups().begin(), Groups().end(), [](group_t const& a, group_t const& b) {
+        return strcmp(a.name, b.name) < 0;
+    });
+    if(list) {
+        for(auto const& group : Groups()) {
+            printf("%s\n", group.name);
+        }
+        return 0;
+    }
+    std::deque<BenchResult> results;
+    for(auto const& group : Groups()) {
+        fprintf(stderr, "%s\n", group.name);
+        BenchContext context(options, group.name, results);
+        group.function(context);
+    }
+    PrintTable(results);
+    if(jsonPath) {
+        if(!WriteJson(jsonPath, options, results)) {
+            fprintf(stderr, "failed to write %s\n", jsonPath);
+            return 1;
+        }
+        printf("\nwrote %s\n", jsonPath);
+    }
+    return 0;
+}
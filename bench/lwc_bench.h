@@ -0,0 +1,178 @@
+#pragma once
+
+/**
+ * @file lwc_bench.h
+ * @brief lwc_bench 的小型测量框架
+ *  每个用例先预热一轮，再采 sampleCount 个样本，每个样本执行固定次数的操作，记录 ns/op；
+ *  输出样本的 min/mean/p50/p90/p99/max，可以写成 JSON 给夜间任务对比两次运行。
+ *  随机数都用固定种子，同一台机器上两次运行的操作序列完全一样。
+ */
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <chrono>
+#include <thread>
+#include <barrier>
+#include <functional>
+#include <algorithm>
+
+namespace comm {
+
+    namespace bench {
+
+        struct BenchResult {
+            std::string                     name;
+            uint32_t                        threads;
+            uint64_t                        opsPerSample;       // 每个样本里所有线程的操作总数
+            uint64_t                        bytesPerOp;         // 非 0 时额外算吞吐
+            std::vector<double>             samples;            // ns/op
+            std::map<std::string, double>   counters;           // 命中率之类的附加数据
+        };
+
+        struct BenchOptions {
+            uint32_t        sampleCount = 30;
+            uint32_t        warmupCount = 3;
+            double          scale = 1.0;        // 每个样本的操作数乘上它，--quick 时调小
+            std::string     filter;             // 名字里包含它的用例才跑
+        };
+
+        /**
+         * @brief 确定性的伪随机数（xorshift64*），种子相同序列就相同
+         */
+        class BenchRandom {
+        private:
+            uint64_t    _state;
+        public:
+            explicit BenchRandom(uint64_t seed)
+                : _state(seed * 0x9E3779B97F4A7C15ull + 1)
+            {}
+            uint64_t next() {
+                _state ^= _state >> 12;
+                _state ^= _state << 25;
+                _state ^= _state >> 27;
+                return _state * 0x2545F4914F6CDD1Dull;
+            }
+            // [lo, hi]
+            uint32_t range(uint32_t lo, uint32_t hi) {
+                return lo + (uint32_t)(next() % ((uint64_t)hi - lo + 1));
+            }
+        };
+
+        class BenchContext {
+        private:
+            BenchOptions const&         _options;
+            std::string                 _prefix;
+            std::deque<BenchResult>&    _results;      // deque：返回出去的指针在后面的用例追加时不会失效
+        private:
+            BenchResult& begin(std::string const& name, uint32_t threads, uint64_t ops, uint64_t bytesPerOp);
+        public:
+            BenchContext(BenchOptions const& options, std::string const& prefix, std::deque<BenchResult>& results)
+                : _options(options)
+                , _prefix(prefix)
+                , _results(results)
+            {}
+
+            // 按 --quick 缩放之后的操作数，至少为 1
+            uint64_t scaled(uint64_t ops) const;
+
+            bool enabled(std::string const& name) const;
+
+            /**
+             * @brief 单线程用例：body(ops) 执行 ops 次操作，每次调用算一个样本
+             *  返回这个用例的结果，可以往 counters 里补数据；被过滤掉时返回 nullptr
+             */
+            template<class F>
+            BenchResult* measure(std::string const& name, uint64_t ops, F&& body, uint64_t bytesPerOp = 0) {
+                if(!enabled(name)) {
+                    return nullptr;
+                }
+                ops = scaled(ops);
+                BenchResult& result = begin(name, 1, ops, bytesPerOp);
+                for(uint32_t i = 0; i < _options.warmupCount + _options.sampleCount; ++i) {
+                    auto start = std::chrono::steady_clock::now();
+                    body(ops);
+                    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+                    if(i >= _options.warmupCount) {
+                        result.samples.push_back(ns / (double)ops);
+                    }
+                }
+                return &result;
+            }
+
+            /**
+             * @brief 多线程用例：每个样本里 threads 个线程同时开始，各执行 body(threadIndex, ops)，
+             *  最早开始到最晚结束的时间除以总操作数就是一个样本（时间由各线程自己记，不受调度影响）
+             *  线程在整个用例期间常驻，样本之间用 barrier 同步，不把建线程的时间算进去
+             */
+            template<class F>
+            BenchResult* measureThreads(std::string const& name, uint32_t threads, uint64_t opsPerThread, F&& body, uint64_t bytesPerOp = 0) {
+                using clock_t = std::chrono::steady_clock;
+                if(!enabled(name)) {
+                    return nullptr;
+                }
+                opsPerThread = scaled(opsPerThread);
+                BenchResult& result = begin(name, threads, opsPerThread * threads, bytesPerOp);
+                uint32_t rounds = _options.warmupCount + _options.sampleCount;
+                std::vector<clock_t::time_point> starts(threads);
+                std::vector<clock_t::time_point> ends(threads);
+                std::barrier<> sync(threads + 1);
+                std::vector<std::thread> workers;
+                for(uint32_t t = 0; t < threads; ++t) {
+                    workers.emplace_back([&, t]() {
+                        for(uint32_t i = 0; i < rounds; ++i) {
+                            sync.arrive_and_wait();
+                            starts[t] = clock_t::now();
+                            body(t, opsPerThread);
+                            ends[t] = clock_t::now();
+                            sync.arrive_and_wait();
+                        }
+                    });
+                }
+                for(uint32_t i = 0; i < rounds; ++i) {
+                    sync.arrive_and_wait();
+                    sync.arrive_and_wait();
+                    auto start = *std::min_element(starts.begin(), starts.end());
+                    auto end = *std::max_element(ends.begin(), ends.end());
+                    double ns = std::chrono::duration<double, std::nano>(end - start).count();
+                    if(i >= _options.warmupCount) {
+                        result.samples.push_back(ns / (double)(opsPerThread * threads));
+                    }
+                }
+                for(auto& worker : workers) {
+                    worker.join();
+                }
+                return &result;
+            }
+        };
+
+        using BenchFunction = void(*)(BenchContext& context);
+
+        struct BenchRegistrar {
+            BenchRegistrar(char const* group, BenchFunction function);
+        };
+
+        // 用例的线程数：1, 2, 4 ... 直到硬件线程数的两倍（至少到 8），看扩展性
+        std::vector<uint32_t> ThreadCounts();
+
+        // 让编译器认为 value 被用到了
+        template<class T>
+        inline void DoNotOptimize(T const& value) {
+        #if defined(_MSC_VER)
+            static T const* volatile sink;
+            sink = &value;
+        #else
+            asm volatile("" : : "r,m"(value) : "memory");
+        #endif
+        }
+
+    }
+
+}
+
+#define LWC_BENCH_GROUP(group) \
+    static void group##_bench(comm::bench::BenchContext& context); \
+    static comm::bench::BenchRegistrar group##_registrar(#group, group##_bench); \
+    static void group##_bench(comm::bench::BenchContext& context)
@@ -0,0 +1,114 @@
+/**
+ * @file lwc_bench_io.cpp
+ * @brief FileSystemArchive 的读吞吐（大文件顺序读、小文件打开+读完）和存在性检查，带索引和不带索引各一组
+ *  数据放在临时目录 lwc_bench_fs 下，第一次运行时生成，内容固定，之后的运行直接复用（热缓存）
+ */
+#include "lwc_bench.h"
+#include <io/archive.h>
+#include <filesystem>
+#include <cstdio>
+
+namespace {
+
+    using namespace comm::bench;
+
+    constexpr uint32_t LargeFileCount = 16;
+    constexpr uint32_t LargeFileSize = 4u << 20;
+    constexpr uint32_t SmallFileCount = 512;
+    constexpr uint32_t SmallFileSize = 4096;
+
+    bool WriteFile(std::filesystem::path const& path, uint32_t size, uint64_t seed) {
+        std::error_code error;
+        if(std::filesystem::exists(path, error) && std::filesystem::file_size(path, error) == size) {
+            return true;
+        }
+        FILE* file = fopen(path.string().c_str(), "wb");
+        if(!file) {
+            return false;
+        }
+        BenchRandom random(seed);
+        std::vector<uint64_t> block(8192);
+        uint32_t written = 0;
+        while(written < size) {
+            for(auto& value : block) {
+                value = random.next();
+            }
+            uint32_t count = std::min<uint32_t>(size - written, (uint32_t)(block.size() * sizeof(uint64_t)));
+            fwrite(block.data(), 1, count, file);
+            written += count;
+        }
+        fclose(file);
+        return true;
+    }
+
+    std::string LargeName(uint32_t index) {
+        return "large/" + std::to_string(index) + ".bin";
+    }
+
+    std::string SmallName(uint32_t index) {
+        return "small/" + std::to_string(index / 64) + "/" + std::to_string(index) + ".bin";
+    }
+
+    bool PrepareData(std::filesystem::path const& root) {
+        std::error_code error;
+        std::filesystem::create_directories(root / "large", error);
+        for(uint32_t i = 0; i < LargeFileCount; ++i) {
+            if(!WriteFile(root / LargeName(i), LargeFileSize, i + 100)) {
+                return false;
+            }
+        }
+        for(uint32_t i = 0; i < SmallFileCount; ++i) {
+            std::filesystem::create_directories((root / SmallName(i)).parent_path(), error);
+            if(!WriteFile(root / SmallName(i), SmallFileSize, i + 1000)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void ReadWhole(comm::IArchive* archive, std::string const& path, std::vector<uint8_t>& buffer) {
+        comm::IStream* stream = archive->openIStream(path, comm::ReadFlag::binary);
+        if(!stream) {
+            return;
+        }
+        while(stream->read(buffer.data(), (int64_t)buffer.size()) > 0) {
+        }
+        stream->close();
+    }
+
+}
+
+LWC_BENCH_GROUP(fs_archive) {
+    auto root = std::filesystem::temp_directory_path() / "lwc_bench_fs";
+    if(!PrepareData(root)) {
+        fprintf(stderr, "  cannot prepare %s, skipped\n", root.string().c_str());
+        return;
+    }
+    std::vector<uint8_t> buffer(256 * 1024);
+    for(bool indexed : { false, true }) {
+        comm::IArchive* archive = comm::CreateFSArchive(root.string(), indexed);
+        std::string suffix = indexed ? "/indexed" : "";
+        // 大文件：每次操作读完一个 4MB 文件
+        context.measure("read_large" + suffix, LargeFileCount, [&](uint64_t ops) {
+            for(uint64_t i = 0; i < ops; ++i) {
+                ReadWhole(archive, LargeName((uint32_t)(i % LargeFileCount)), buffer);
+            }
+        }, LargeFileSize);
+        // 小文件：打开 + 读 4KB + 关闭，主要看每个文件的固定开销
+        context.measure("read_small" + suffix, SmallFileCount, [&](uint64_t ops) {
+            for(uint64_t i = 0; i < ops; ++i) {
+                ReadWhole(archive, SmallName((uint32_t)((i * 37) % SmallFileCount)), buffer);
+            }
+        }, SmallFileSize);
+        // 一半存在一半不存在
+        context.measure("test_exist" + suffix, 20000, [&](uint64_t ops) {
+            uint32_t found = 0;
+            for(uint64_t i = 0; i < ops; ++i) {
+                uint32_t index = (uint32_t)(i % (SmallFileCount * 2));
+                found += archive->testExist(SmallName(index)) ? 1 : 0;
+            }
+            DoNotOptimize(found);
+        });
+        archive->destroy();
+    }
+}
@@ -0,0 +1,280 @@
+/**
+ * @file lwc_bench_memory.cpp
+ * @brief tlsf::Pool 在碎片化状态下的 alloc/free/realloc，FlightRing 的分配吞吐，LinearArena 和 comm_alloc 做临时分配的对比，
+ *  ObjectPool 和 new/delete 的对比
+ */
+#include "lwc_bench.h"
+#include <memory/tlsf/comm_tlsf.h>
+#include <memory/flight_ring.h>
+#include <memory/linear_arena.h>
+#include <memory/memory.h>
+#include <memory/object_pool.h>
+#include <vector>
+
+namespace {
+
+    using namespace comm::bench;
+
+    constexpr uint32_t PoolSize = 256u << 20;
+    constexpr uint32_t LiveCount = 16384;
+    constexpr uint32_t InvalidOffset = ~0u;
+
+    /**
+     * @brief 先随机分配 LiveCount 个块，再隔一个释放一个，池子里留下大量大小不一的空洞
+     */
+    void Fragment(comm::tlsf::Pool& pool, std::vector<uint32_t>& live, BenchRandom& random) {
+        live.assign(LiveCount, InvalidOffset);
+        for(auto& offset : live) {
+            offset = pool.alloc(random.range(16, 4096));
+        }
+        for(uint32_t i = 0; i < LiveCount; i += 2) {
+            if(live[i] != InvalidOffset) {
+                pool.free(live[i]);
+                live[i] = InvalidOffset;
+            }
+        }
+    }
+
+}
+
+LWC_BENCH_GROUP(tlsf) {
+    {
+        comm::tlsf::Pool pool(PoolSize);
+        std::vector<uint32_t> live;
+        BenchRandom random(1);
+        Fragment(pool, live, random);
+        // 每次操作：随机挑一个槽，有块就释放，再分配一个随机大小的新块放进去
+        auto result = context.measure("alloc_free_fragmented", 200000, [&](uint64_t ops) {
+            for(uint64_t i = 0; i < ops; ++i) {
+                uint32_t& slot = live[random.next() % LiveCount];
+                if(slot != InvalidOffset) {
+                    pool.free(slot);
+                }
+                slot = pool.alloc(random.range(16, 4096));
+            }
+        });
+        if(result) {
+            uint32_t failed = 0;
+            for(auto offset : live) {
+                failed += offset == InvalidOffset;
+            }
+            result->counters["failed_slots"] = failed;
+            result->counters["fragmentation"] = pool.report().fragmentation;
+        }
+    }
+    {
+        comm::tlsf::Pool pool(PoolSize);
+        std::vector<uint32_t> live;
+        BenchRandom random(2);
+        Fragment(pool, live, random);
+        // 大小跨度大一些（16B ~ 64KB），bitmap 要跨 first level 找
+        context.measure("alloc_free_mixed_sizes", 200000, [&](uint64_t ops) {
+            for(uint64_t i = 0; i < ops; ++i) {
+                uint32_t& slot = live[random.next() % LiveCount];
+                if(slot != InvalidOffset) {
+                    pool.free(slot);
+                }
+                uint32_t size = (random.next() & 7) ? random.range(16, 512) : random.range(4096, 65536);
+                slot = pool.alloc(size);
+            }
+        });
+    }
+    {
+        comm::tlsf::Pool pool(PoolSize);
+        std::vector<uint32_t> live;
+        BenchRandom random(3);
+        Fragment(pool, live, random);
+        for(auto& offset : live) {
+            if(offset == InvalidOffset) {
+                offset = pool.alloc(random.range(16, 4096));
+            }
+        }
+        uint64_t reallocs = 0;
+        uint64_t moves = 0;
+        auto result = context.measure("realloc_fragmented", 200000, [&](uint64_t ops) {
+            for(uint64_t i = 0; i < ops; ++i) {
+                uint32_t& slot = live[random.next() % LiveCount];
+                if(slot == InvalidOffset) {
+                    slot = pool.alloc(random.range(16, 4096));
+                } else {
+                    // 失败时原来的块还在，留着下次再试
+                    bool moved;
+                    uint32_t offset = pool.realloc(slot, random.range(16, 8192), moved);
+                    if(offset != InvalidOffset) {
+                        slot = offset;
+                    }
+                    ++reallocs;
+                    moves += moved;
+                }
+            }
+        });
+        if(result && reallocs) {
+            result->counters["moved_ratio"] = (double)moves / (double)reallocs;
+        }
+    }
+    {
+        comm::tlsf::Pool pool(PoolSize);
+        std::vector<uint32_t> live;
+        BenchRandom random(8);
+        Fragment(pool, live, random);
+        // GPU 常见的 256B 常量缓冲区对齐，和 64KB 的纹理对齐混着来
+        auto result = context.measure("alloc_free_aligned", 200000, [&](uint64_t ops) {
+            for(uint64_t i = 0; i < ops; ++i) {
+                uint32_t& slot = live[random.next() % LiveCount];
+                if(slot != InvalidOffset) {
+                    pool.free(slot);
+                }
+                size_t alignment = (random.next() & 15) ? 256 : 65536;
+                slot = pool.alloc(random.range(16, 4096), alignment);
+            }
+        });
+        if(result) {
+            auto stats = pool.stats();
+            result->counters["free_blocks"] = stats.freeBlockCount;
+            result->counters["padding_returned_mb"] = (double)stats.alignmentPaddingReturned / (1024.0 * 1024.0);
+        }
+    }
+}
+
+LWC_BENCH_GROUP(flight_ring) {
+    // 模拟每帧几千次小分配，三帧在飞
+    comm::FlightRing<3> ring(64u << 20, 16);
+    BenchRandom random(4);
+    uint64_t failed = 0;
+    auto result = context.measure("alloc_per_frame", 1000000, [&](uint64_t ops) {
+        for(uint64_t i = 0; i < ops; ++i) {
+            if((i & 4095) == 0) {
+                ring.prepareNextFlight();
+            }
+            uint32_t offset = ring.alloc(random.range(16, 1024));
+            failed += offset == comm::FlightRing<3>::InvalidAlloc;
+            DoNotOptimize(offset);
+        }
+    });
+    if(result) {
+        result->counters["failed"] = (double)failed;
+    }
+}
+
+LWC_BENCH_GROUP(linear_arena) {
+    // 一次“解析”分配 64 个小块，用完整体退回；对照组逐个 comm_alloc/comm_free
+    constexpr uint32_t BlocksPerScope = 64;
+    {
+        comm::LinearArena arena;
+        BenchRandom random(6);
+        context.measure("scope_64_allocs", 20000, [&](uint64_t ops) {
+            for(uint64_t i = 0; i < ops; ++i) {
+                comm::LinearArenaScope scope(arena);
+                for(uint32_t k = 0; k < BlocksPerScope; ++k) {
+                    DoNotOptimize(arena.alloc(random.range(16, 256)));
+                }
+            }
+        });
+    }
+    {
+        BenchRandom random(6);
+        void* blocks[BlocksPerScope];
+        context.measure("comm_alloc_64_allocs", 20000, [&](uint64_t ops) {
+            for(uint64_t i = 0; i < ops; ++i) {
+                for(uint32_t k = 0; k < BlocksPerScope; ++k) {
+                    blocks[k] = comm::comm_alloc(random.range(16, 256));
+                    DoNotOptimize(blocks[k]);
+                }
+                for(uint32_t k = 0; k < BlocksPerScope; ++k) {
+                    comm::comm_free(blocks[k]);
+                }
+            }
+        });
+    }
+    {
+        // std::pmr::vector 一路 push_back 到 1024 个元素
+        context.measure("pmr_vector_1024", 20000, [&](uint64_t ops) {
+            for(uint64_t i = 0; i < ops; ++i) {
+                comm::LinearArenaScope scope(comm::ScratchArena());
+                comm::LinearArenaResource resource(comm::ScratchArena());
+                std::pmr::vector<uint32_t> values(&resource);
+                for(uint32_t k = 0; k < 1024; ++k) {
+                    values.push_back(k);
+                }
+                DoNotOptimize(values.data());
+            }
+        });
+        context.measure("std_vector_1024", 20000, [&](uint64_t ops) {
+            for(uint64_t i = 0; i < ops; ++i) {
+                std::vector<uint32_t> values;
+                for(uint32_t k = 0; k < 1024; ++k) {
+                    values.push_back(k);
+                }
+                DoNotOptimize(values.data());
+            }
+        });
+    }
+}
+
+LWC_BENCH_GROUP(object_pool) {
+    // 手里拿着 1024 个 48 字节的对象，每次随机还一个再要一个
+    struct object_t {
+        uint64_t    values[6];
+    };
+    constexpr uint32_t LiveObjects = 1024;
+    {
+        comm::ObjectPool<object_t, false> pool;
+        std::vector<object_t*> live(LiveObjects);
+        for(auto& object : live) {
+            object = pool.create();
+        }
+        BenchRandom random(7);
+        context.measure("create_destroy_unlocked", 1000000, [&](uint64_t ops) {
+            for(uint64_t i = 0; i < ops; ++i) {
+                auto& slot = live[random.next() & (LiveObjects - 1)];
+                pool.destroy(slot);
+                slot = pool.create();
+            }
+        });
+        for(auto object : live) {
+            pool.destroy(object);
+        }
+    }
+    {
+        std::vector<object_t*> live(LiveObjects);
+        for(auto& object : live) {
+            object = new object_t();
+        }
+        BenchRandom random(7);
+        context.measure("new_delete", 1000000, [&](uint64_t ops) {
+            for(uint64_t i = 0; i < ops; ++i) {
+                auto& slot = live[random.next() & (LiveObjects - 1)];
+                delete slot;
+                slot = new object_t();
+            }
+        });
+        for(auto object : live) {
+            delete object;
+        }
+    }
+    for(bool threadCache : { false, true }) {
+        for(uint32_t threads : ThreadCounts()) {
+            comm::ObjectPool<object_t> pool(0, threadCache);
+            std::vector<std::vector<object_t*>> live(threads, std::vector<object_t*>(LiveObjects / 4, nullptr));
+            std::string name = std::string(threadCache ? "create_destroy_magazine/t" : "create_destroy_locked/t") + std::to_string(threads);
+            context.measureThreads(name, threads, 200000, [&](uint32_t index, uint64_t ops) {
+                BenchRandom random(index + 1);
+                auto& mine = live[index];
+                for(uint64_t i = 0; i < ops; ++i) {
+                    auto& slot = mine[random.next() % mine.size()];
+                    if(slot) {
+                        pool.destroy(slot);
+                    }
+                    slot = pool.create();
+                }
+            });
+            for(auto& mine : live) {
+                for(auto object : mine) {
+                    if(object) {
+                        pool.destroy(object);
+                    }
+                }
+            }
+        }
+    }
+}
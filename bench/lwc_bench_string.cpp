@@ -0,0 +1,99 @@
+/**
+ * @file lwc_bench_string.cpp
+ * @brief NamePool::getName 命中/未命中在多线程下的表现，VersionedUIDManager 的分配回收
+ */
+#include "lwc_bench.h"
+#include <string/name.h>
+#include <id/versioned_uid.h>
+#include <cstdio>
+#include <algorithm>
+
+namespace {
+
+    using namespace comm::bench;
+
+    constexpr uint32_t NameCount = 8192;
+
+    std::vector<std::string> MakeNames(char const* prefix, uint32_t count) {
+        std::vector<std::string> names;
+        names.reserve(count);
+        char buffer[64];
+        for(uint32_t i = 0; i < count; ++i) {
+            snprintf(buffer, sizeof(buffer), "%s/asset_%05u.res", prefix, i);
+            names.push_back(buffer);
+        }
+        return names;
+    }
+
+}
+
+LWC_BENCH_GROUP(name_pool) {
+    auto names = MakeNames("textures/common", NameCount);
+    for(uint32_t threads : ThreadCounts()) {
+        comm::NamePool pool;
+        for(auto const& name : names) {
+            pool.getName(name.c_str(), (uint16_t)name.size());
+        }
+        // 全部命中：每个线程从不同的位置开始按固定步长遍历
+        context.measureThreads("get_hit/t" + std::to_string(threads), threads, 100000, [&](uint32_t index, uint64_t ops) {
+            BenchRandom random(index + 1);
+            for(uint64_t i = 0; i < ops; ++i) {
+                auto const& name = names[random.next() % NameCount];
+                comm::Name value = pool.getName(name.c_str(), (uint16_t)name.size());
+                DoNotOptimize(value);
+            }
+        });
+    }
+    for(uint32_t threads : ThreadCounts()) {
+        comm::NamePool pool;
+        // 全部未命中：每个线程把自增的计数写进名字末尾，每次都是没见过的名字；
+        // 每个样本的总插入数固定，线程多了池子也不会无限涨
+        std::vector<uint32_t> counters(threads, 0);
+        auto result = context.measureThreads("get_miss/t" + std::to_string(threads), threads, std::max<uint32_t>(1, 32768 / threads), [&](uint32_t index, uint64_t ops) {
+            char name[64];
+            int prefix = snprintf(name, sizeof(name), "thread_%03u/asset_", index);
+            uint32_t next = counters[index];
+            for(uint64_t i = 0; i < ops; ++i) {
+                uint32_t serial = next++;
+                for(int k = 7; k >= 0; --k) {
+                    name[prefix + k] = "0123456789abcdef"[serial & 15];
+                    serial >>= 4;
+                }
+                comm::Name value = pool.getName(name, (uint16_t)(prefix + 8));
+                DoNotOptimize(value);
+            }
+            counters[index] = next;
+        });
+        if(result) {
+            result->counters["pool_bytes"] = (double)pool.bytesTotal();
+        }
+    }
+}
+
+LWC_BENCH_GROUP(versioned_uid) {
+    {
+        comm::VersionedUIDManager manager;
+        // 稳态：手里一直拿着 4096 个 ID，每次随机还一个再借一个，freeList 一直有货
+        std::vector<comm::VersionedUID> live;
+        for(uint32_t i = 0; i < 4096; ++i) {
+            live.push_back(manager.alloc());
+        }
+        BenchRandom random(5);
+        context.measure("alloc_free_steady", 1000000, [&](uint64_t ops) {
+            for(uint64_t i = 0; i < ops; ++i) {
+                auto& slot = live[random.next() & 4095];
+                manager.free(slot);
+                slot = manager.alloc();
+            }
+        });
+    }
+    {
+        // 冷启动：只分配不回收，走计数器
+        context.measure("alloc_fresh", 1000000, [&](uint64_t ops) {
+            comm::VersionedUIDManager manager;
+            for(uint64_t i = 0; i < ops; ++i) {
+                DoNotOptimize(manager.alloc());
+            }
+        });
+    }
+}
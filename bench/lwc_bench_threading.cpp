@@ -0,0 +1,46 @@
+/**
+ * @file lwc_bench_threading.cpp
+ * @brief SharedMutex 读锁随线程数的扩展性，和少量写混在一起时的表现；StripedSharedMutex 作对照
+ */
+#include "lwc_bench.h"
+#include <threading/shared_mutex.hpp>
+
+namespace {
+
+    using namespace comm::bench;
+
+    struct alignas(64) shared_data_t {
+        uint64_t    values[8] = {};
+    };
+
+    template<class Mutex>
+    void ReadWrite(BenchContext& context, char const* name, uint32_t writePermille) {
+        for(uint32_t threads : ThreadCounts()) {
+            Mutex mutex;
+            shared_data_t data;
+            context.measureThreads(std::string(name) + "/t" + std::to_string(threads), threads, 200000, [&](uint32_t index, uint64_t ops) {
+                BenchRandom random(index + 11);
+                uint64_t local = 0;
+                for(uint64_t i = 0; i < ops; ++i) {
+                    if(writePermille && random.next() % 1000 < writePermille) {
+                        mutex.lock();
+                        ++data.values[i & 7];
+                        mutex.unlock();
+                    } else {
+                        mutex.lock_shared();
+                        local += data.values[0] + data.values[7];
+                        mutex.unlock_shared();
+                    }
+                }
+                DoNotOptimize(local);
+            });
+        }
+    }
+
+}
+
+LWC_BENCH_GROUP(shared_mutex) {
+    ReadWrite<comm::SharedMutex>(context, "read", 0);
+    ReadWrite<comm::SharedMutex>(context, "write_1pct", 10);
+    ReadWrite<comm::StripedSharedMutex<16>>(context, "striped_read", 0);
+}
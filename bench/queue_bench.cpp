@@ -0,0 +1,207 @@
+/**
+ * @file queue_bench.cpp
+ * @brief SPSCQueue / MPMCQueue / mutex + std::deque 的吞吐和延迟
+ *  吞吐：P 个生产者各推 ItemsPerProducer 个整数，C 个消费者取完为止，单个和按 32 个一批两种方式
+ *  延迟：两个线程用两条队列来回传一个时间戳（ping-pong），统计往返时间的分位数，空了会睡在 futex 上
+ */
+#include <threading/ring_queue.hpp>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+
+namespace {
+
+    constexpr uint64_t ItemsPerProducer = 1000000;
+    constexpr size_t QueueCapacity = 4096;
+    constexpr size_t BatchSize = 32;
+    constexpr uint32_t PingPongRounds = 100000;
+
+    bool ChecksumFailed = false;
+
+    // 对照组：一把锁加两个条件变量
+    template<class T>
+    class LockedQueue {
+    private:
+        std::deque<T>               _items;
+        size_t                      _capacity;
+        std::mutex                  _mutex;
+        std::condition_variable     _notEmpty;
+        std::condition_variable     _notFull;
+    public:
+        explicit LockedQueue(size_t capacity)
+            : _capacity(capacity)
+        {}
+        void push(T item) {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _notFull.wait(lock, [this]() { return _items.size() < _capacity; });
+            _items.push_back(item);
+            lock.unlock();
+            _notEmpty.notify_one();
+        }
+        void pop(T& item) {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _notEmpty.wait(lock, [this]() { return !_items.empty(); });
+            item = _items.front();
+            _items.pop_front();
+            lock.unlock();
+            _notFull.notify_one();
+        }
+        void pushBatch(std::span<T> items) {
+            for(auto item : items) {
+                push(item);
+            }
+        }
+        size_t popBatch(std::span<T> items) {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _notEmpty.wait(lock, [this]() { return !_items.empty(); });
+            size_t count = std::min(items.size(), _items.size());
+            for(size_t i = 0; i < count; ++i) {
+                items[i] = _items.front();
+                _items.pop_front();
+            }
+            lock.unlock();
+            _notFull.notify_all();
+            return count;
+        }
+    };
+
+    // 返回 Mitems/s
+    template<class Queue>
+    double Throughput(uint32_t producers, uint32_t consumers, bool batch) {
+        Queue queue(QueueCapacity);
+        uint64_t total = ItemsPerProducer * producers;
+        std::atomic<uint64_t> consumed(0);
+        std::atomic<uint64_t> checksum(0);
+        std::atomic<bool> go(false);
+        std::vector<std::thread> threads;
+        for(uint32_t p = 0; p < producers; ++p) {
+            threads.emplace_back([&]() {
+                while(!go.load(std::memory_order_acquire)) {
+                    std::this_thread::yield();
+                }
+                if(batch) {
+                    uint64_t items[BatchSize];
+                    for(uint64_t i = 0; i < ItemsPerProducer; i += BatchSize) {
+                        size_t count = (size_t)std::min<uint64_t>(BatchSize, ItemsPerProducer - i);
+                        for(size_t k = 0; k < count; ++k) {
+                            items[k] = i + k + 1;
+                        }
+                        queue.pushBatch(std::span<uint64_t>(items, count));
+                    }
+                } else {
+                    for(uint64_t i = 0; i < ItemsPerProducer; ++i) {
+                        queue.push(i + 1);
+                    }
+                }
+            });
+        }
+        for(uint32_t c = 0; c < consumers; ++c) {
+            threads.emplace_back([&]() {
+                uint64_t sum = 0;
+                uint64_t items[BatchSize];
+                while(consumed.load(std::memory_order_relaxed) < total) {
+                    size_t count;
+                    if(batch) {
+                        count = queue.popBatch(std::span<uint64_t>(items, BatchSize));
+                    } else {
+                        queue.pop(items[0]);
+                        count = 1;
+                    }
+                    for(size_t k = 0; k < count; ++k) {
+                        sum += items[k];
+                    }
+                    consumed.fetch_add(count, std::memory_order_relaxed);
+                }
+                // 退出时塞一个 0，把还睡在 pop 上的消费者接力叫醒（0 不影响校验和）
+                if(consumers > 1) {
+                    queue.push(0);
+                }
+                checksum.fetch_add(sum, std::memory_order_relaxed);
+            });
+        }
+        auto begin = std::chrono::steady_clock::now();
+        go.store(true, std::memory_order_release);
+        for(auto& thread : threads) {
+            thread.join();
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        if(checksum.load() != producers * (ItemsPerProducer * (ItemsPerProducer + 1) / 2)) {
+            printf("checksum mismatch!\n");
+            ChecksumFailed = true;
+        }
+        return (double)total / seconds / 1e6;
+    }
+
+    struct latency_t {
+        double  p50;
+        double  p99;
+        double  p999;
+    };
+
+    // 往返时间，单位 ns
+    template<class Queue>
+    latency_t PingPong() {
+        Queue ping(64);
+        Queue pong(64);
+        std::thread echo([&]() {
+            uint64_t value;
+            for(uint32_t i = 0; i < PingPongRounds; ++i) {
+                ping.pop(value);
+                pong.push(value);
+            }
+        });
+        std::vector<double> samples;
+        samples.reserve(PingPongRounds);
+        for(uint32_t i = 0; i < PingPongRounds; ++i) {
+            auto begin = std::chrono::steady_clock::now();
+            uint64_t value = i;
+            ping.push(value);
+            pong.pop(value);
+            samples.push_back(std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count());
+        }
+        echo.join();
+        std::sort(samples.begin(), samples.end());
+        auto at = [&](double q) {
+            return samples[std::min(samples.size() - 1, (size_t)(q * samples.size()))];
+        };
+        return { at(0.5), at(0.99), at(0.999) };
+    }
+
+}
+
+int main() {
+    printf("throughput (Mitems/s), %llu items per producer, capacity %zu\n", (unsigned long long)ItemsPerProducer, QueueCapacity);
+    printf("%-14s %-6s %12s %12s %12s\n", "P x C", "batch", "locked", "SPSC", "MPMC");
+    for(bool batch : { false, true }) {
+        double locked = Throughput<LockedQueue<uint64_t>>(1, 1, batch);
+        double spsc = Throughput<comm::SPSCQueue<uint64_t>>(1, 1, batch);
+        double mpmc = Throughput<comm::MPMCQueue<uint64_t>>(1, 1, batch);
+        printf("%-14s %-6s %12.2f %12.2f %12.2f\n", "1 x 1", batch ? "32" : "1", locked, spsc, mpmc);
+    }
+    const uint32_t threadCounts[] = { 2, 4, 8 };
+    for(bool batch : { false, true }) {
+        for(uint32_t threads : threadCounts) {
+            double locked = Throughput<LockedQueue<uint64_t>>(threads, threads, batch);
+            double mpmc = Throughput<comm::MPMCQueue<uint64_t>>(threads, threads, batch);
+            char name[32];
+            snprintf(name, sizeof(name), "%u x %u", threads, threads);
+            printf("%-14s %-6s %12.2f %12s %12.2f\n", name, batch ? "32" : "1", locked, "-", mpmc);
+        }
+    }
+    printf("\nping-pong round trip (ns), %u rounds\n", PingPongRounds);
+    printf("%-10s %10s %10s %10s\n", "queue", "p50", "p99", "p99.9");
+    latency_t locked = PingPong<LockedQueue<uint64_t>>();
+    latency_t spsc = PingPong<comm::SPSCQueue<uint64_t>>();
+    latency_t mpmc = PingPong<comm::MPMCQueue<uint64_t>>();
+    printf("%-10s %10.0f %10.0f %10.0f\n", "locked", locked.p50, locked.p99, locked.p999);
+    printf("%-10s %10.0f %10.0f %10.0f\n", "SPSC", spsc.p50, spsc.p99, spsc.p999);
+    printf("%-10s %10.0f %10.0f %10.0f\n", "MPMC", mpmc.p50, mpmc.p99, mpmc.p999);
+    // 丢了或者重复了元素，吞吐数字没有意义
+    return ChecksumFailed ? 1 : 0;
+}
@@ -0,0 +1,121 @@
+/**
+ * @file shared_mutex_bench.cpp
+ * @brief SharedMutex / StripedSharedMutex / 原来的实现 / std::shared_mutex 在 1~32 线程下的吞吐
+ *  每个线程做固定次数的加锁-读（或写）-解锁，读操作只读一小段共享数据
+ */
+#include <threading/shared_mutex.hpp>
+#include <shared_mutex>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+#include <thread>
+#include <atomic>
+
+namespace {
+
+    // 改成原子状态之前的实现（所有操作都进 mutex），留着做对比
+    class LegacySharedMutex {
+    private:
+        constexpr static uint32_t           _writerMask = 1<<31;
+        constexpr static uint32_t           _readerMask = UINT32_MAX>>1;
+    private:
+        mutable std::mutex                  _mutex;
+        mutable std::condition_variable     _sharedCV;
+        mutable std::condition_variable     _exclusiveCV;
+        mutable uint32_t                    _statusBits = 0;
+    private:
+        bool writerEntered() const { return !!(_statusBits&_writerMask); }
+        uint32_t readerCount() const { return _statusBits&_readerMask; }
+        void setReaderCount( uint32_t count ) const { _statusBits&=~_readerMask; _statusBits|=count; }
+    public:
+        void lock() const {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _sharedCV.wait(lock,[this]()->bool{ return !writerEntered(); });
+            _statusBits |= _writerMask;
+            _exclusiveCV.wait(lock,[this]()->bool{ return readerCount() == 0; });
+        }
+        void unlock() const {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _statusBits = 0;
+            _sharedCV.notify_all();
+        }
+        void lock_shared() const {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _sharedCV.wait(lock, [this]()->bool{ return _readerMask>_statusBits; });
+            ++_statusBits;
+        }
+        void unlock_shared() const {
+            std::unique_lock<std::mutex> lock(_mutex);
+            auto readerNum = readerCount()-1;
+            setReaderCount(readerNum);
+            if(writerEntered()) {
+                if(readerCount() == 0) {
+                    _exclusiveCV.notify_one();
+                }
+            } else if(readerNum == _readerMask-1) {
+                _sharedCV.notify_one();
+            }
+        }
+    };
+
+    constexpr uint32_t OpsPerThread = 200000;
+
+    struct alignas(64) shared_data_t {
+        uint64_t    values[4] = {};
+    };
+
+    template<class Mutex>
+    double Run(uint32_t threadCount, uint32_t writePermille) {
+        Mutex mutex;
+        shared_data_t data;
+        std::atomic<bool> go(false);
+        std::atomic<uint64_t> sink(0);
+        std::vector<std::thread> threads;
+        for(uint32_t t = 0; t < threadCount; ++t) {
+            threads.emplace_back([&, t]() {
+                uint32_t seed = t * 2654435761u + 1;
+                uint64_t local = 0;
+                while(!go.load(std::memory_order_acquire)) {
+                    std::this_thread::yield();
+                }
+                for(uint32_t i = 0; i < OpsPerThread; ++i) {
+                    seed = seed * 1664525u + 1013904223u;
+                    if((seed >> 8) % 1000 < writePermille) {
+                        mutex.lock();
+                        ++data.values[i & 3];
+                        mutex.unlock();
+                    } else {
+                        mutex.lock_shared();
+                        local += data.values[0] + data.values[3];
+                        mutex.unlock_shared();
+                    }
+                }
+                sink.fetch_add(local, std::memory_order_relaxed);
+            });
+        }
+        auto begin = std::chrono::steady_clock::now();
+        go.store(true, std::memory_order_release);
+        for(auto& thread : threads) {
+            thread.join();
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        return (double)threadCount * OpsPerThread / seconds / 1e6;
+    }
+
+}
+
+int main() {
+    const uint32_t threadCounts[] = { 1, 2, 4, 8, 16, 32 };
+    const uint32_t writeRatios[] = { 0, 10, 100 };  // 千分比
+    printf("%-10s %-8s %12s %12s %12s %12s   (Mops/s)\n", "write%", "threads", "legacy", "std", "SharedMutex", "striped");
+    for(uint32_t ratio : writeRatios) {
+        for(uint32_t threads : threadCounts) {
+            double legacy = Run<LegacySharedMutex>(threads, ratio);
+            double stdmutex = Run<std::shared_mutex>(threads, ratio);
+            double shared = Run<comm::SharedMutex>(threads, ratio);
+            double striped = Run<comm::StripedSharedMutex<16>>(threads, ratio);
+            printf("%-10.1f %-8u %12.2f %12.2f %12.2f %12.2f\n", ratio / 10.0, threads, legacy, stdmutex, shared, striped);
+        }
+    }
+    return 0;
+}
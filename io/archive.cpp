@@ -0,0 +1,54 @@
+#include "archive.h"
+#include <threading/job_system.h>
+
+namespace comm {
+
+    std::vector<IArchive::FileEntity> IArchive::listFilesRecursive(const std::string& path) {
+        std::vector<FileEntity> rst;
+        if(!supportListFeature()) {
+            return rst;
+        }
+        std::vector<std::string> directories = { std::string() };
+        while(!directories.empty()) {
+            std::string relative = std::move(directories.back());
+            directories.pop_back();
+            std::string dir = relative.empty() ? path : path + "/" + relative;
+            for(auto& entity : listFiles(dir)) {
+                std::string name = relative.empty() ? std::move(entity.name) : relative + "/" + entity.name;
+                if(entity.type == FileEntityType::directory) {
+                    directories.push_back(name);
+                }
+                rst.emplace_back(std::move(name), entity.type);
+            }
+        }
+        return rst;
+    }
+
+    void IArchive::readAsync(const std::string& path, uint64_t offset, uint64_t size, AsyncReadCallback callback) {
+        std::vector<AsyncReadRequest> requests;
+        requests.push_back({ path, offset, size, nullptr, std::move(callback) });
+        submitBatch(std::move(requests));
+    }
+
+    std::future<AsyncReadResult> IArchive::readAsync(const std::string& path, uint64_t offset, uint64_t size) {
+        auto promise = std::make_shared<std::promise<AsyncReadResult>>();
+        auto future = promise->get_future();
+        readAsync(path, offset, size, [promise](AsyncReadResult& result) {
+            promise->set_value(std::move(result));
+        });
+        return future;
+    }
+
+    void AsyncReadAwaitable::await_suspend(std::coroutine_handle<> handle) {
+        _archive->readAsync(_path, _offset, _size, [this, handle](AsyncReadResult& result) {
+            _result = std::move(result);
+            // 恢复之后 this 就可能没了，这之后不能再碰成员
+            JobSystem::Instance()->resume(handle);
+        });
+    }
+
+    void IArchive::submitBatch(std::vector<AsyncReadRequest>&& requests) {
+        AsyncIOEngine::Instance()->submit(this, std::move(requests));
+    }
+
+}
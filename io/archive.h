@@ -2,7 +2,11 @@
 #include <cstdint>
 #include <string>
 #include <vector>
+#include <future>
+#include <span>
 #include <utils/enum_class_bits.h>
+#include "async_io.h"
+#include "file_watcher.h"
 
 namespace comm {
 
@@ -20,6 +24,8 @@ namespace comm {
         append  = 1,        // 只允许在文件尾写
         binary  = 2,        // 二进制格式
         trunc   = 4,        // 如果存在就抹掉
+        buffered= 8,        // 带缓冲的写（BufferedOStream）
+        atomic  = 16,       // 先写临时文件，close 时 rename 过去，中途崩溃不会留下半个文件（隐含 buffered）
     };
 
     enum class AssetManagerType {
@@ -43,9 +49,29 @@ namespace comm {
         virtual ~IStream(){}
     };
 
+    struct IOVec {
+        const void* base;
+        size_t      length;
+    };
+
     class OStream {
     public:
         virtual int64_t write( const void* buffer, int64_t size ) = 0;
+        /**
+         * @brief 一次写入多块内存，默认逐块 write，带缓冲的实现会合并成一次系统调用
+         */
+        virtual int64_t writev( std::span<const IOVec> vecs ) {
+            int64_t total = 0;
+            for(auto const& vec : vecs) {
+                int64_t rst = write(vec.base, (int64_t)vec.length);
+                if(rst < 0) {
+                    return rst;
+                }
+                total += rst;
+            }
+            return total;
+        }
+        virtual bool flush() { return true; }
         virtual int64_t seek(SeekOption option, int offset ) = 0;
         virtual int64_t tell() const = 0;
         virtual int64_t size() const = 0;
@@ -78,12 +104,45 @@ namespace comm {
         virtual bool testExist( const std::string& path ) = 0;
         virtual bool supportListFeature() const = 0;
         virtual std::vector<FileEntity> listFiles( const std::string& path ) = 0;
+        /**
+         * @brief 递归列出 path 下所有的文件和目录，name 是相对 path 的路径（以 '/' 分隔）
+         *  默认实现基于 listFiles 逐层展开，子类可以提供更快的实现
+         */
+        virtual std::vector<FileEntity> listFilesRecursive( const std::string& path );
         virtual std::string rootPath() = 0;
         virtual bool readonly() const = 0;
         virtual void destroy() = 0;
+        /**
+         * @brief 异步读取 [offset, offset+size)，size 为 0 表示读到文件尾
+         *  回调在 I/O 线程上执行，结果也可以通过 future 拿到
+         */
+        void readAsync( const std::string& path, uint64_t offset, uint64_t size, AsyncReadCallback callback);
+        std::future<AsyncReadResult> readAsync( const std::string& path, uint64_t offset, uint64_t size);
+        /**
+         * @brief 协程里用：auto result = co_await archive->read(path); 参数含义同 readAsync
+         */
+        AsyncReadAwaitable read( const std::string& path, uint64_t offset = 0, uint64_t size = 0) {
+            return AsyncReadAwaitable(this, path, offset, size);
+        }
+        /**
+         * @brief 批量提交，请求会按文件和 offset 排序合并，默认走 AsyncIOEngine
+         */
+        virtual void submitBatch( std::vector<AsyncReadRequest>&& requests);
+        /**
+         * @brief 订阅 archive 内容的变化，CachingArchive、VirtualFileSystem 靠它让缓存和索引自动跟上
+         *  目前只有 watch 中的 FileSystemArchive 会发事件，包装别的 archive 的实现转给底层；
+         *  返回 0 表示不支持。回调在监视线程上执行，unsubscribeChanges 返回之后不会再被调用，
+         *  所以不能在回调里 unsubscribeChanges
+         */
+        virtual uint32_t subscribeChanges( FileChangeCallback callback) { (void)callback; return 0; }
+        virtual void unsubscribeChanges( uint32_t subscription) { (void)subscription; }
         virtual ~IArchive() {};
     };
 
-    IArchive* CreateFSArchive(const std::string& rootPath);
+    /**
+     * @brief buildIndex 为 true 时在创建时建立路径索引，之后的存在性检查和打开失败都只查哈希表，见 FileSystemArchive
+     */
+    IArchive* CreateFSArchive(const std::string& rootPath, bool buildIndex = false);
+    IArchive* CreatePkgArchive(const std::string& pkgPath);
 
 }
\ No newline at end of file
@@ -0,0 +1,219 @@
+#include "async_io.h"
+#include "archive.h"
+#include "../memory/memory.h"
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+namespace comm {
+
+    IOBuffer::IOBuffer(int64_t size)
+        : _data((uint8_t*)comm_alloc((size_t)size))
+        , _size(size)
+    {}
+
+    IOBuffer& IOBuffer::operator = (IOBuffer&& buffer) {
+        if(this != &buffer) {
+            reset();
+            _data = buffer._data;
+            _size = buffer._size;
+            buffer._data = nullptr;
+            buffer._size = 0;
+        }
+        return *this;
+    }
+
+    void IOBuffer::reset() {
+        if(_data) {
+            comm_free(_data);
+        }
+        _data = nullptr;
+        _size = 0;
+    }
+
+    AsyncIOEngine::AsyncIOEngine(uint32_t workerCount)
+        : _workers()
+        , _jobs()
+        , _mutex()
+        , _jobCV()
+        , _idleCV()
+        , _pending(0)
+        , _exit(false)
+    {
+        if(!workerCount) {
+            // I/O 线程主要在等磁盘，不需要太多，2~4 个足够
+            workerCount = std::clamp<uint32_t>(std::thread::hardware_concurrency() / 2, 2, 4);
+        }
+        for(uint32_t i = 0; i < workerCount; ++i) {
+            _workers.emplace_back(&AsyncIOEngine::workerProc, this);
+        }
+    }
+
+    AsyncIOEngine* AsyncIOEngine::Instance() {
+        // 故意不释放，进程退出时 I/O 线程可能还在跑回调
+        static AsyncIOEngine* engine = new AsyncIOEngine();
+        return engine;
+    }
+
+    AsyncIOEngine::~AsyncIOEngine() {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _exit = true;
+        }
+        _jobCV.notify_all();
+        for(auto& worker : _workers) {
+            worker.join();
+        }
+    }
+
+    void AsyncIOEngine::submit(IArchive* archive, std::vector<AsyncReadRequest>&& requests) {
+        if(requests.empty()) {
+            return;
+        }
+        // 按 文件 + offset 排序，同一个文件的请求放到一个 job 里，只打开一次文件
+        std::sort(requests.begin(), requests.end(), [](AsyncReadRequest const& a, AsyncReadRequest const& b) {
+            int cmp = a.path.compare(b.path);
+            if(cmp != 0) {
+                return cmp < 0;
+            }
+            return a.offset < b.offset;
+        });
+        _pending.fetch_add((uint32_t)requests.size(), std::memory_order_acq_rel);
+        std::unique_lock<std::mutex> lock(_mutex);
+        size_t begin = 0;
+        while(begin < requests.size()) {
+            size_t end = begin + 1;
+            while(end < requests.size() && requests[end].path == requests[begin].path) {
+                ++end;
+            }
+            file_job_t job;
+            job.archive = archive;
+            job.path = requests[begin].path;
+            job.requests.reserve(end - begin);
+            for(size_t i = begin; i < end; ++i) {
+                job.requests.push_back(std::move(requests[i]));
+            }
+            _jobs.push_back(std::move(job));
+            begin = end;
+        }
+        lock.unlock();
+        _jobCV.notify_all();
+    }
+
+    void AsyncIOEngine::waitIdle() {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _idleCV.wait(lock, [this]() {
+            return _pending.load(std::memory_order_acquire) == 0;
+        });
+    }
+
+    void AsyncIOEngine::workerProc() {
+        while(true) {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _jobCV.wait(lock, [this]() {
+                return _exit || !_jobs.empty();
+            });
+            if(_jobs.empty()) { // _exit
+                return;
+            }
+            file_job_t job = std::move(_jobs.front());
+            _jobs.pop_front();
+            lock.unlock();
+            //
+            uint32_t count = (uint32_t)job.requests.size();
+            process(job);
+            if(_pending.fetch_sub(count, std::memory_order_acq_rel) == count) {
+                lock.lock();
+                _idleCV.notify_all();
+            }
+        }
+    }
+
+    static void CompleteRequest(AsyncReadRequest& request, AsyncReadResult& result) {
+        if(request.callback) {
+            request.callback(result);
+        }
+    }
+
+    void AsyncIOEngine::process(file_job_t& job) {
+        auto& requests = job.requests;
+        IStream* stream = job.archive->openIStream(job.path, ReadFlag::binary);
+        if(!stream) {
+            for(auto& request : requests) {
+                AsyncReadResult result = { -1, nullptr, {} };
+                CompleteRequest(request, result);
+            }
+            return;
+        }
+        uint64_t fileSize = (uint64_t)stream->size();
+        // size 为 0 表示读到文件尾，先把所有请求的实际范围裁剪到文件内
+        for(auto& request : requests) {
+            if(request.offset > fileSize) {
+                request.offset = fileSize;
+            }
+            uint64_t avail = fileSize - request.offset;
+            if(!request.size || request.size > avail) {
+                request.size = avail;
+            }
+        }
+        size_t i = 0;
+        while(i < requests.size()) {
+            // 合并相邻/重叠/间隔很小的请求为一次读
+            uint64_t runBegin = requests[i].offset;
+            uint64_t runEnd = requests[i].offset + requests[i].size;
+            size_t j = i + 1;
+            while(j < requests.size()) {
+                uint64_t end = std::max(runEnd, requests[j].offset + requests[j].size);
+                if(requests[j].offset > runEnd + CoalesceGap || end - runBegin > CoalesceMaxSize) {
+                    break;
+                }
+                runEnd = end;
+                ++j;
+            }
+            int64_t bytesRead = -1;
+            // IStream::seek 的偏移是 int，超过 INT_MAX 的请求直接失败，不能截断了读错位置
+            if(runBegin <= (uint64_t)INT_MAX && stream->seek(SeekOption::begin, (int)runBegin) == 0) {
+                bytesRead = 0;
+            }
+            if(j == i + 1) {
+                // 单个请求直接读到目标内存
+                auto& request = requests[i];
+                AsyncReadResult result = { -1, request.buffer, {} };
+                if(!result.data && request.size) {
+                    result.owned = IOBuffer((int64_t)request.size);
+                    result.data = result.owned.data();
+                }
+                if(bytesRead == 0 && request.size) {
+                    bytesRead = stream->read(result.data, (int64_t)request.size);
+                }
+                result.bytesRead = bytesRead;
+                CompleteRequest(request, result);
+            } else {
+                IOBuffer runBuffer((int64_t)(runEnd - runBegin));
+                if(bytesRead == 0) {
+                    bytesRead = stream->read(runBuffer.data(), runBuffer.size());
+                }
+                for(size_t k = i; k < j; ++k) {
+                    auto& request = requests[k];
+                    AsyncReadResult result = { -1, request.buffer, {} };
+                    if(bytesRead >= 0) {
+                        int64_t local = (int64_t)(request.offset - runBegin);
+                        int64_t copySize = std::min<int64_t>((int64_t)request.size, std::max<int64_t>(bytesRead - local, 0));
+                        if(!result.data && copySize) {
+                            result.owned = IOBuffer(copySize);
+                            result.data = result.owned.data();
+                        }
+                        if(copySize) {
+                            memcpy(result.data, runBuffer.data() + local, (size_t)copySize);
+                        }
+                        result.bytesRead = copySize;
+                    }
+                    CompleteRequest(request, result);
+                }
+            }
+            i = j;
+        }
+        stream->close();
+    }
+
+}
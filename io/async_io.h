@@ -0,0 +1,129 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <atomic>
+#include <functional>
+#include <coroutine>
+
+namespace comm {
+
+    class IArchive;
+
+    /**
+     * @brief 异步读取用的缓冲区，内存来自 comm_alloc，只能移动不能拷贝
+     */
+    class IOBuffer {
+    private:
+        uint8_t*    _data;
+        int64_t     _size;
+    public:
+        IOBuffer()
+            : _data(nullptr)
+            , _size(0)
+        {}
+        explicit IOBuffer(int64_t size);
+        IOBuffer(IOBuffer&& buffer)
+            : _data(buffer._data)
+            , _size(buffer._size)
+        {
+            buffer._data = nullptr;
+            buffer._size = 0;
+        }
+        IOBuffer& operator = (IOBuffer&& buffer);
+        IOBuffer(IOBuffer const&) = delete;
+        IOBuffer& operator = (IOBuffer const&) = delete;
+        uint8_t* data() const { return _data; }
+        int64_t size() const { return _size; }
+        void reset();
+        ~IOBuffer() { reset(); }
+    };
+
+    struct AsyncReadResult {
+        int64_t         bytesRead;      // < 0 表示失败（文件不存在、越界等）
+        void*           data;           // 指向调用者提供的 buffer 或者 owned 的数据
+        IOBuffer        owned;          // 调用者没提供 buffer 时由引擎分配，回调里可以 move 走
+    };
+
+    using AsyncReadCallback = std::function<void(AsyncReadResult&)>;
+
+    struct AsyncReadRequest {
+        std::string         path;
+        uint64_t            offset;
+        uint64_t            size;
+        void*               buffer;     // 可以为 nullptr，由引擎分配
+        AsyncReadCallback   callback;
+    };
+
+    /**
+     * @brief IArchive::read 返回的等待体，co_await 得到 AsyncReadResult
+     *  读完之后协程在 JobSystem 的工作线程上恢复，不占用 I/O 线程
+     */
+    class AsyncReadAwaitable {
+    private:
+        IArchive*           _archive;
+        std::string         _path;
+        uint64_t            _offset;
+        uint64_t            _size;
+        AsyncReadResult     _result;
+    public:
+        AsyncReadAwaitable(IArchive* archive, std::string const& path, uint64_t offset, uint64_t size)
+            : _archive(archive)
+            , _path(path)
+            , _offset(offset)
+            , _size(size)
+            , _result { -1, nullptr, {} }
+        {}
+        bool await_ready() const noexcept {
+            return false;
+        }
+        void await_suspend(std::coroutine_handle<> handle);
+        AsyncReadResult await_resume() {
+            return std::move(_result);
+        }
+    };
+
+    /**
+     * @brief 异步 I/O 引擎
+     *  专门的 I/O 线程池，同一个文件的请求按 offset 排序并合并成尽量少的读操作，
+     *  每个文件只打开一次。回调在 I/O 线程上执行，回调里不要做太重的事情。
+     */
+    class AsyncIOEngine {
+    public:
+        constexpr static uint64_t CoalesceGap = 16 * 1024;          // 两段请求间隔小于它就合并成一次读
+        constexpr static uint64_t CoalesceMaxSize = 1024 * 1024;    // 合并后单次读的上限
+    private:
+        struct file_job_t {
+            IArchive*                       archive;
+            std::string                     path;
+            std::vector<AsyncReadRequest>   requests;   // 已按 offset 排好序
+        };
+        std::vector<std::thread>            _workers;
+        std::deque<file_job_t>              _jobs;
+        std::mutex                          _mutex;
+        std::condition_variable             _jobCV;
+        std::condition_variable             _idleCV;
+        std::atomic<uint32_t>               _pending;
+        bool                                _exit;
+    private:
+        AsyncIOEngine(uint32_t workerCount = 0);
+        void workerProc();
+        void process(file_job_t& job);
+    public:
+        // 第一次调用时创建，多个线程同时第一次调用也只会有一个实例
+        static AsyncIOEngine* Instance();
+        void submit(IArchive* archive, std::vector<AsyncReadRequest>&& requests);
+        // 未完成的请求数
+        uint32_t pending() const {
+            return _pending.load(std::memory_order_acquire);
+        }
+        // 阻塞等待所有已提交的请求完成
+        void waitIdle();
+        ~AsyncIOEngine();
+    };
+
+}
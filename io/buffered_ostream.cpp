@@ -0,0 +1,351 @@
+#include "buffered_ostream.h"
+#include "../memory/memory.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <cerrno>
+#include <cstdio>
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <climits>
+#endif
+
+namespace comm {
+
+#ifdef _WIN32
+    static int OpenForWrite(const char* path, bool append) {
+        int flags = _O_WRONLY | _O_CREAT | _O_BINARY | (append ? _O_APPEND : _O_TRUNC);
+        return _open(path, flags, _S_IREAD | _S_IWRITE);
+    }
+    // 同一目录下建一个新的临时文件，_O_EXCL 保证不会和别的写者或者崩溃留下的文件共用
+    static int OpenTempForWrite(const std::string& path, std::string& tempPath) {
+        static std::atomic<uint32_t> counter(0);
+        for(int attempt = 0; attempt < 64; ++attempt) {
+            char suffix[48];
+            snprintf(suffix, sizeof(suffix), ".%lx.%x.tmp", (unsigned long)GetCurrentProcessId(), counter.fetch_add(1, std::memory_order_relaxed));
+            tempPath = path + suffix;
+            int fd = _open(tempPath.c_str(), _O_WRONLY | _O_CREAT | _O_EXCL | _O_BINARY, _S_IREAD | _S_IWRITE);
+            if(fd >= 0 || errno != EEXIST) {
+                return fd;
+            }
+        }
+        return -1;
+    }
+    static int64_t WriteVectored(int fd, const IOVec* vecs, size_t count) {
+        // windows 上没有 writev，逐块写
+        int64_t total = 0;
+        for(size_t i = 0; i < count; ++i) {
+            int rst = _write(fd, vecs[i].base, (unsigned int)vecs[i].length);
+            if(rst < 0) {
+                return total ? total : -1;
+            }
+            total += rst;
+            if((size_t)rst < vecs[i].length) {
+                break;
+            }
+        }
+        return total;
+    }
+    static int64_t SeekFd(int fd, int64_t offset, int whence) { return _lseeki64(fd, offset, whence); }
+    static bool SyncFd(int fd) { return _commit(fd) == 0; }
+    static void CloseFd(int fd) { _close(fd); }
+    static bool ReplaceFile(const std::string& from, const std::string& to) {
+        return !!MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+    }
+    static void SyncParentDirectory(const std::string&) {}
+#else
+    static int OpenForWrite(const char* path, bool append) {
+        int flags = O_WRONLY | O_CREAT | O_CLOEXEC | (append ? O_APPEND : O_TRUNC);
+        return ::open(path, flags, 0644);
+    }
+    // umask 只能通过设置来读，启动时（还没有别的线程建文件）读一次
+    static mode_t ReadUmask() {
+        mode_t mask = ::umask(0);
+        ::umask(mask);
+        return mask;
+    }
+    static const mode_t ProcessUmask = ReadUmask();
+
+    // 同一目录下用 mkostemp 建一个名字唯一的临时文件，不会和别的写者或者崩溃留下的文件共用
+    static int OpenTempForWrite(const std::string& path, std::string& tempPath) {
+        tempPath = path + ".XXXXXX";
+        int fd = ::mkostemp(tempPath.data(), O_CLOEXEC);
+        if(fd < 0) {
+            return -1;
+        }
+        // mkostemp 建出来是 0600，改成和 OpenForWrite 一样：替换已有文件时保留它的权限，新文件是 0644 受 umask 限制
+        struct stat info;
+        mode_t mode = ::stat(path.c_str(), &info) == 0 ? (info.st_mode & 07777) : (0644 & ~ProcessUmask);
+        fchmod(fd, mode);
+        return fd;
+    }
+    static int64_t WriteVectored(int fd, const IOVec* vecs, size_t count) {
+        static_assert(sizeof(IOVec) == sizeof(iovec), "IOVec must be layout compatible with iovec");
+        int iovCount = (int)std::min<size_t>(count, IOV_MAX);
+        return ::writev(fd, (const iovec*)vecs, iovCount);
+    }
+    static int64_t SeekFd(int fd, int64_t offset, int whence) { return ::lseek(fd, offset, whence); }
+    static bool SyncFd(int fd) {
+    #if defined(__APPLE__)
+        return fsync(fd) == 0;
+    #else
+        return fdatasync(fd) == 0;
+    #endif
+    }
+    static void CloseFd(int fd) { ::close(fd); }
+    static bool ReplaceFile(const std::string& from, const std::string& to) {
+        return ::rename(from.c_str(), to.c_str()) == 0;
+    }
+    // rename 之后同步一下目录，保证掉电后目录项也是新的
+    static void SyncParentDirectory(const std::string& path) {
+        auto slash = path.find_last_of('/');
+        std::string dir = slash == std::string::npos ? "." : path.substr(0, slash ? slash : 1);
+        int fd = ::open(dir.c_str(), O_RDONLY | O_CLOEXEC);
+        if(fd >= 0) {
+            fsync(fd);
+            ::close(fd);
+        }
+    }
+#endif
+
+    BufferedOStream::BufferedOStream(int fd, int64_t position, Options const& options)
+        : _fd(fd)
+        , _buffer(nullptr)
+        , _capacity(std::max<uint32_t>(options.bufferSize, 1))
+        , _used(0)
+        , _bypassThreshold(options.bypassThreshold ? options.bypassThreshold : _capacity)
+        , _syncBytes(options.syncBytes)
+        , _unsynced(0)
+        , _position(position)
+        , _size(position)
+        , _syncOnClose(options.syncOnClose)
+        , _failed(false)
+        , _path()
+        , _tempPath()
+    {
+        _buffer = (uint8_t*)comm_alloc(_capacity);
+    }
+
+    void BufferedOStream::setAtomicTarget(const std::string& path, const std::string& tempPath) {
+        _path = path;
+        _tempPath = tempPath;
+    }
+
+    void BufferedOStream::noteWritten(int64_t bytes) {
+        _position += bytes;
+        _size = std::max(_size, _position);
+        if(_syncBytes) {
+            _unsynced += (uint64_t)bytes;
+            if(_unsynced >= _syncBytes) {
+                SyncFd(_fd);
+                _unsynced = 0;
+            }
+        }
+    }
+
+    bool BufferedOStream::writeAll(const IOVec* vecs, size_t count) {
+        // 处理部分写入，把已经写出去的部分从 iovec 里去掉
+        IOVec local[16];
+        std::vector<IOVec> heap;
+        IOVec* pending = local;
+        if(count > sizeof(local) / sizeof(local[0])) {
+            heap.assign(vecs, vecs + count);
+            pending = heap.data();
+        } else {
+            std::copy(vecs, vecs + count, local);
+        }
+        while(count) {
+            while(count && !pending->length) {
+                ++pending;
+                --count;
+            }
+            if(!count) {
+                break;
+            }
+            int64_t rst = WriteVectored(_fd, pending, count);
+            if(rst < 0) {
+                if(errno == EINTR) {
+                    continue;
+                }
+                _failed = true;
+                return false;
+            }
+            // 还有数据却一个字节也没写出去，再试也一样，当失败处理，不能原地打转
+            if(rst == 0) {
+                _failed = true;
+                return false;
+            }
+            noteWritten(rst);
+            while(count && (size_t)rst >= pending->length) {
+                rst -= (int64_t)pending->length;
+                ++pending;
+                --count;
+            }
+            if(count) {
+                pending->base = (const uint8_t*)pending->base + rst;
+                pending->length -= (size_t)rst;
+            }
+        }
+        return true;
+    }
+
+    bool BufferedOStream::flushBuffer() {
+        if(!_used) {
+            return !_failed;
+        }
+        IOVec vec = { _buffer, _used };
+        _used = 0;
+        return writeAll(&vec, 1);
+    }
+
+    int64_t BufferedOStream::write(const void* buffer, int64_t size) {
+        IOVec vec = { buffer, (size_t)size };
+        return writev(std::span<const IOVec>(&vec, 1));
+    }
+
+    int64_t BufferedOStream::writev(std::span<const IOVec> vecs) {
+        if(_failed) {
+            return -1;
+        }
+        size_t total = 0;
+        for(auto const& vec : vecs) {
+            total += vec.length;
+        }
+        if(total >= _bypassThreshold) {
+            // 大块数据不拷贝，缓冲区里的数据放在最前面一起 gather 写出去
+            std::vector<IOVec> gather;
+            gather.reserve(vecs.size() + 1);
+            if(_used) {
+                gather.push_back({ _buffer, _used });
+            }
+            for(auto const& vec : vecs) {
+                if(vec.length) {
+                    gather.push_back(vec);
+                }
+            }
+            _used = 0;
+            if(!writeAll(gather.data(), gather.size())) {
+                return -1;
+            }
+            return (int64_t)total;
+        }
+        for(auto const& vec : vecs) {
+            const uint8_t* src = (const uint8_t*)vec.base;
+            size_t remain = vec.length;
+            while(remain) {
+                if(_used == _capacity && !flushBuffer()) {
+                    return -1;
+                }
+                size_t n = std::min<size_t>(remain, _capacity - _used);
+                memcpy(_buffer + _used, src, n);
+                _used += (uint32_t)n;
+                src += n;
+                remain -= n;
+            }
+        }
+        return (int64_t)total;
+    }
+
+    bool BufferedOStream::flush() {
+        return flushBuffer();
+    }
+
+    int64_t BufferedOStream::seek(SeekOption option, int offset) {
+        if(!flushBuffer()) {
+            return -1;
+        }
+        int whence = SEEK_SET;
+        switch (option) {
+        case SeekOption::begin:
+            whence = SEEK_SET; break;
+        case SeekOption::current:
+            whence = SEEK_CUR; break;
+        case SeekOption::end:
+            whence = SEEK_END; break;
+        default:
+            break;
+        }
+        int64_t position = SeekFd(_fd, offset, whence);
+        if(position < 0) {
+            return -1;
+        }
+        _position = position;
+        return 0;
+    }
+
+    int64_t BufferedOStream::tell() const {
+        return _position + _used;
+    }
+
+    int64_t BufferedOStream::size() const {
+        return std::max(_size, _position + (int64_t)_used);
+    }
+
+    bool BufferedOStream::seekable() const {
+        return true;
+    }
+
+    void BufferedOStream::discard() {
+        _used = 0;
+        _failed = true;
+    }
+
+    BufferedOStream::~BufferedOStream() {
+        if(_fd >= 0) {
+            bool ok = flushBuffer();
+            bool atomic = !_tempPath.empty();
+            if(ok && (_syncOnClose || atomic)) {
+                ok = SyncFd(_fd);
+            }
+            CloseFd(_fd);
+            _fd = -1;
+            if(atomic) {
+                if(ok && ReplaceFile(_tempPath, _path)) {
+                    SyncParentDirectory(_path);
+                } else {
+                    ::remove(_tempPath.c_str());
+                }
+            }
+        }
+        if(_buffer) {
+            comm_free(_buffer);
+            _buffer = nullptr;
+        }
+    }
+
+    void BufferedOStream::close() {
+        this->~BufferedOStream();
+        comm_free(this);
+    }
+
+    OStream* CreateBufferedOStream(const std::string& path, BitFlags<WriteFlag> flags, BufferedOStream::Options const& options) {
+        bool atomic = options.atomic || flags.test(WriteFlag::atomic);
+        // atomic 模式总是从空的临时文件开始写，append 没有意义
+        bool append = !atomic && flags.test(WriteFlag::append);
+        std::string tempPath;
+        int fd = atomic ? OpenTempForWrite(path, tempPath) : OpenForWrite(path.c_str(), append);
+        if(fd < 0) {
+            return nullptr;
+        }
+        int64_t position = append ? SeekFd(fd, 0, SEEK_END) : 0;
+        void* ptr = comm_alloc(sizeof(BufferedOStream));
+        auto stream = new (ptr) BufferedOStream(fd, position < 0 ? 0 : position, options);
+        if(atomic) {
+            stream->setAtomicTarget(path, tempPath);
+        }
+        return stream;
+    }
+
+    OStream* CreateBufferedOStream(const std::string& path, BitFlags<WriteFlag> flags) {
+        return CreateBufferedOStream(path, flags, BufferedOStream::Options{});
+    }
+
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include "archive.h"
+
+namespace comm {
+
+    /**
+     * @brief 带缓冲的文件写入流，直接操作 fd
+     *  - 小块写入先攒在缓冲区里，攒满了一次写出去
+     *  - 超过 bypassThreshold 的写入不经过缓冲区拷贝，和缓冲区里已有的数据一起 writev 出去
+     *  - syncBytes 不为 0 时每写出这么多字节 fdatasync 一次，把同步的开销分摊掉
+     *  - atomic 模式先写同目录下名字唯一的临时文件（path.XXXXXX），close 时 fdatasync + rename，读者永远看不到写了一半的文件
+     */
+    class BufferedOStream : public OStream {
+    public:
+        struct Options {
+            uint32_t    bufferSize = 64 * 1024;
+            uint32_t    bypassThreshold = 0;        // 0 表示等于 bufferSize
+            uint64_t    syncBytes = 0;              // 0 表示不主动同步
+            bool        syncOnClose = false;
+            bool        atomic = false;
+        };
+    private:
+        int             _fd;
+        uint8_t*        _buffer;
+        uint32_t        _capacity;
+        uint32_t        _used;
+        uint32_t        _bypassThreshold;
+        uint64_t        _syncBytes;
+        uint64_t        _unsynced;
+        int64_t         _position;          // 已经写到 fd 的位置，不含缓冲区
+        int64_t         _size;
+        bool            _syncOnClose;
+        bool            _failed;
+        std::string     _path;              // atomic 模式下的目标路径
+        std::string     _tempPath;
+    private:
+        bool writeAll(const IOVec* vecs, size_t count);
+        bool flushBuffer();
+        void noteWritten(int64_t bytes);
+    public:
+        BufferedOStream(int fd, int64_t position, Options const& options);
+        void setAtomicTarget(const std::string& path, const std::string& tempPath);
+        virtual int64_t write( const void* buffer, int64_t size ) override;
+        virtual int64_t writev( std::span<const IOVec> vecs ) override;
+        virtual bool flush() override;
+        virtual int64_t seek(SeekOption option, int offset ) override;
+        virtual int64_t tell() const override;
+        virtual int64_t size() const override;
+        virtual bool seekable() const override;
+        /**
+         * @brief 刷新缓冲区，atomic 模式下会提交（rename），出过错的话只删掉临时文件
+         */
+        virtual void close() override;
+        // atomic 模式下放弃这次写入
+        void discard();
+        virtual ~BufferedOStream() override;
+    };
+
+    OStream* CreateBufferedOStream(const std::string& path, BitFlags<WriteFlag> flags, BufferedOStream::Options const& options);
+    OStream* CreateBufferedOStream(const std::string& path, BitFlags<WriteFlag> flags);
+
+}
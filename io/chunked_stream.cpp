@@ -0,0 +1,302 @@
+#include "chunked_stream.h"
+#include "lz_block.h"
+#include "../memory/memory.h"
+#include <threading/job_system.h>
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+namespace comm {
+
+    bool ChunkedCompress(const void* data, size_t size, std::vector<uint8_t>& output, uint32_t chunkSize) {
+        if(!chunkSize || chunkSize > ChunkedMaxChunkSize || (size + chunkSize - 1) / chunkSize > ChunkedMaxChunkCount) {
+            return false;
+        }
+        chunked_header_t header = {};
+        header.magic = ChunkedMagic;
+        header.chunkSize = chunkSize;
+        header.rawSize = size;
+        header.chunkCount = (uint32_t)((size + chunkSize - 1) / chunkSize);
+        size_t base = output.size();
+        size_t tableSize = sizeof(uint64_t) * ((size_t)header.chunkCount + 1);
+        output.resize(base + sizeof(header) + tableSize);
+        memcpy(output.data() + base, &header, sizeof(header));
+        std::vector<uint64_t> offsets;
+        offsets.reserve((size_t)header.chunkCount + 1);
+        std::vector<uint8_t> compressed(LZBlockBound(chunkSize));
+        const uint8_t* src = (const uint8_t*)data;
+        for(uint32_t i = 0; i < header.chunkCount; ++i) {
+            size_t rawSize = std::min<size_t>(chunkSize, size - (size_t)i * chunkSize);
+            const uint8_t* raw = src + (size_t)i * chunkSize;
+            offsets.push_back(output.size() - base);
+            int64_t compressedSize = LZBlockCompress(raw, rawSize, compressed.data(), compressed.size());
+            if(compressedSize > 0 && (size_t)compressedSize < rawSize) {
+                output.insert(output.end(), compressed.data(), compressed.data() + compressedSize);
+            } else {
+                output.insert(output.end(), raw, raw + rawSize); // 压不动就存原始数据
+            }
+        }
+        offsets.push_back(output.size() - base);
+        memcpy(output.data() + base + sizeof(header), offsets.data(), tableSize);
+        return true;
+    }
+
+    ChunkedIStream::ChunkedIStream(const void* memory, IStream* source, bool ownSource, uint32_t readAhead)
+        : _memory((const uint8_t*)memory)
+        , _source(source)
+        , _ownSource(ownSource)
+        , _sourceMutex()
+        , _header{}
+        , _offsets()
+        , _position(0)
+        , _readAhead(readAhead)
+        , _slots()
+        , _slotMemory(nullptr)
+        , _mutex()
+        , _cv()
+        , _inflight(0)
+    {}
+
+    bool ChunkedIStream::initialize(const uint8_t* headerData, uint64_t available) {
+        if(available < sizeof(chunked_header_t)) {
+            return false;
+        }
+        memcpy(&_header, headerData, sizeof(_header));
+        if(_header.magic != ChunkedMagic || !_header.chunkSize || _header.chunkSize > ChunkedMaxChunkSize
+            || _header.chunkCount > ChunkedMaxChunkCount
+            || _header.chunkCount != (_header.rawSize + _header.chunkSize - 1) / _header.chunkSize) {
+            return false;
+        }
+        // 偏移表放不进数据里就是坏的，先检查再分配
+        uint64_t tableSize = sizeof(uint64_t) * ((uint64_t)_header.chunkCount + 1);
+        if(_memory) {
+            if(available - sizeof(chunked_header_t) < tableSize) {
+                return false;
+            }
+        } else {
+            int64_t sourceSize = _source->size();
+            if(sourceSize >= 0 && ((uint64_t)sourceSize < sizeof(chunked_header_t) || (uint64_t)sourceSize - sizeof(chunked_header_t) < tableSize)) {
+                return false;
+            }
+        }
+        _offsets.resize((size_t)_header.chunkCount + 1);
+        if(_memory) {
+            memcpy(_offsets.data(), headerData + sizeof(chunked_header_t), (size_t)tableSize);
+        } else if(_source->read(_offsets.data(), (int64_t)tableSize) != (int64_t)tableSize) {
+            return false;
+        }
+        uint64_t dataBegin = sizeof(chunked_header_t) + tableSize;
+        for(uint32_t i = 0; i < _header.chunkCount; ++i) {
+            uint64_t storedSize = _offsets[i+1] - _offsets[i];
+            if(_offsets[i] < dataBegin || _offsets[i+1] < _offsets[i] || storedSize > _header.chunkSize) {
+                return false;
+            }
+        }
+        if(_memory && _offsets.back() > available) {
+            return false;
+        }
+        // 当前 chunk + 预读的 chunk
+        _slots.resize((size_t)_readAhead + 1);
+        _slotMemory = (uint8_t*)comm_alloc((size_t)_header.chunkSize * _slots.size());
+        if(!_slotMemory) {
+            return false;
+        }
+        for(size_t i = 0; i < _slots.size(); ++i) {
+            _slots[i] = { -1, SlotState::empty, _slotMemory + i * _header.chunkSize };
+        }
+        return true;
+    }
+
+    bool ChunkedIStream::open(uint64_t memorySize) {
+        if(_memory) {
+            return initialize(_memory, memorySize);
+        }
+        chunked_header_t header;
+        if(_source->seek(SeekOption::begin, 0) != 0 || _source->read(&header, sizeof(header)) != sizeof(header)) {
+            return false;
+        }
+        return initialize((const uint8_t*)&header, sizeof(header));
+    }
+
+    bool ChunkedIStream::decodeChunk(int64_t chunk, uint8_t* dst) {
+        uint64_t rawSize = std::min<uint64_t>(_header.chunkSize, _header.rawSize - (uint64_t)chunk * _header.chunkSize);
+        uint64_t storedSize = _offsets[chunk+1] - _offsets[chunk];
+        const uint8_t* stored = nullptr;
+        IOBuffer buffer;
+        if(_memory) {
+            stored = _memory + _offsets[chunk];
+        } else {
+            // IStream::seek 的偏移是 int，超过 INT_MAX 的 chunk 读不到，不能截断了读错位置
+            if(_offsets[chunk] > (uint64_t)INT_MAX) {
+                return false;
+            }
+            buffer = IOBuffer((int64_t)storedSize);
+            if(storedSize && !buffer.data()) {
+                return false;
+            }
+            std::unique_lock<std::mutex> lock(_sourceMutex);
+            if(_source->seek(SeekOption::begin, (int)_offsets[chunk]) != 0
+                || _source->read(buffer.data(), (int64_t)storedSize) != (int64_t)storedSize) {
+                return false;
+            }
+            stored = buffer.data();
+        }
+        if(storedSize == rawSize) {
+            memcpy(dst, stored, (size_t)rawSize);
+            return true;
+        }
+        return LZBlockDecompress(stored, (size_t)storedSize, dst, (size_t)rawSize);
+    }
+
+    /**
+     * @brief 等 ready() 成立。预读任务可能还排在当前线程自己的任务队列里（在工作线程上读流的时候），
+     *  所以先帮着执行任务，没有可执行的任务了才睡，这时等的任务一定已经在别的线程上跑了
+     */
+    template<class Pred>
+    static void HelpWait(std::unique_lock<std::mutex>& lock, std::condition_variable& cv, Pred ready) {
+        while(!ready()) {
+            lock.unlock();
+            bool helped = JobSystem::Instance()->helpOne();
+            lock.lock();
+            if(!helped) {
+                cv.wait(lock, ready);
+            }
+        }
+    }
+
+    ChunkedIStream::slot_t* ChunkedIStream::acquire(int64_t chunk) {
+        std::unique_lock<std::mutex> lock(_mutex);
+        slot_t& slot = _slots[(size_t)chunk % _slots.size()];
+        // 槽位可能还在被解压线程写（不管是不是要的 chunk），等它结束
+        HelpWait(lock, _cv, [&slot]() { return slot.state != SlotState::pending; });
+        // 上次失败的不记住，可能只是一次读错，重新解压
+        if(slot.chunk != chunk || slot.state == SlotState::failed) {
+            slot.chunk = chunk;
+            slot.state = SlotState::pending;
+            lock.unlock();
+            // 需要的 chunk 直接在当前线程解压，比丢给任务系统再等更快
+            bool rst = decodeChunk(chunk, slot.data);
+            lock.lock();
+            slot.state = rst ? SlotState::ready : SlotState::failed;
+        }
+        return slot.state == SlotState::ready ? &slot : nullptr;
+    }
+
+    void ChunkedIStream::prefetch(int64_t chunk) {
+        if(chunk >= (int64_t)_header.chunkCount) {
+            return;
+        }
+        std::unique_lock<std::mutex> lock(_mutex);
+        slot_t& slot = _slots[(size_t)chunk % _slots.size()];
+        if(slot.chunk == chunk || slot.state == SlotState::pending) {
+            return;
+        }
+        slot.chunk = chunk;
+        slot.state = SlotState::pending;
+        ++_inflight;
+        lock.unlock();
+        JobSystem::Instance()->submit([this, chunk, &slot]() {
+            bool rst = decodeChunk(chunk, slot.data);
+            std::unique_lock<std::mutex> lock(_mutex);
+            slot.state = rst ? SlotState::ready : SlotState::failed;
+            --_inflight;
+            _cv.notify_all();
+        });
+    }
+
+    int64_t ChunkedIStream::read(void* buffer, int64_t size) {
+        uint8_t* dst = (uint8_t*)buffer;
+        int64_t total = 0;
+        while(size > 0 && _position < (int64_t)_header.rawSize) {
+            int64_t chunk = _position / _header.chunkSize;
+            slot_t* slot = acquire(chunk);
+            if(!slot) {
+                return total ? total : -1;
+            }
+            for(uint32_t i = 1; i <= _readAhead; ++i) {
+                prefetch(chunk + i);
+            }
+            int64_t chunkOffset = _position - chunk * _header.chunkSize;
+            int64_t chunkRemain = std::min<int64_t>(_header.chunkSize, (int64_t)_header.rawSize - chunk * _header.chunkSize) - chunkOffset;
+            int64_t copySize = std::min(size, chunkRemain);
+            memcpy(dst, slot->data + chunkOffset, (size_t)copySize);
+            dst += copySize;
+            size -= copySize;
+            total += copySize;
+            _position += copySize;
+        }
+        return total;
+    }
+
+    int64_t ChunkedIStream::seek(SeekOption option, int offset) {
+        int64_t position = 0;
+        switch (option) {
+        case SeekOption::begin:
+            position = offset; break;
+        case SeekOption::current:
+            position = _position + offset; break;
+        case SeekOption::end:
+            position = (int64_t)_header.rawSize + offset; break;
+        default:
+            break;
+        }
+        if(position < 0 || position > (int64_t)_header.rawSize) {
+            return -1;
+        }
+        _position = position;
+        return 0;
+    }
+
+    int64_t ChunkedIStream::tell() const {
+        return _position;
+    }
+
+    int64_t ChunkedIStream::size() const {
+        return (int64_t)_header.rawSize;
+    }
+
+    bool ChunkedIStream::seekable() const {
+        return true;
+    }
+
+    ChunkedIStream::~ChunkedIStream() {
+        // 等所有预读任务结束，它们还引用着 this
+        std::unique_lock<std::mutex> lock(_mutex);
+        HelpWait(lock, _cv, [this]() { return _inflight == 0; });
+        lock.unlock();
+        if(_slotMemory) {
+            comm_free(_slotMemory);
+            _slotMemory = nullptr;
+        }
+        if(_source && _ownSource) {
+            _source->close();
+        }
+        _source = nullptr;
+    }
+
+    void ChunkedIStream::close() {
+        this->~ChunkedIStream();
+        comm_free(this);
+    }
+
+    IStream* CreateChunkedIStream(const void* memory, uint64_t size, uint32_t readAhead) {
+        void* ptr = comm_alloc(sizeof(ChunkedIStream));
+        auto stream = new (ptr) ChunkedIStream(memory, nullptr, false, readAhead);
+        if(!stream->open(size)) {
+            stream->close();
+            return nullptr;
+        }
+        return stream;
+    }
+
+    IStream* CreateChunkedIStream(IStream* source, bool ownSource, uint32_t readAhead) {
+        void* ptr = comm_alloc(sizeof(ChunkedIStream));
+        auto stream = new (ptr) ChunkedIStream(nullptr, source, ownSource, readAhead);
+        if(!stream->open(0)) {
+            stream->close();
+            return nullptr;
+        }
+        return stream;
+    }
+
+}
@@ -0,0 +1,93 @@
+#pragma once
+#include "archive.h"
+#include <mutex>
+#include <condition_variable>
+
+namespace comm {
+
+    /**
+     * @brief 分块压缩流格式
+     *
+     *  | chunked_header_t | uint64_t offsets[chunkCount+1] | chunk 0 | chunk 1 | ... |
+     *
+     *  每个 chunk 独立用 LZ 块压缩（见 lz_block.h），offsets 是相对流起始位置的偏移，
+     *  chunk 的存储大小等于原始大小时表示没压缩。seek 只需要除以 chunkSize 查偏移表，不用从头解压。
+     */
+
+    constexpr uint32_t ChunkedMagic = 0x4b48434c;     // "LCHK"
+
+    struct chunked_header_t {
+        uint32_t    magic;
+        uint32_t    chunkSize;
+        uint64_t    rawSize;
+        uint32_t    chunkCount;
+        uint32_t    reserved;
+    };
+    static_assert(sizeof(chunked_header_t) == 24, "");
+
+    constexpr uint32_t ChunkedDefaultChunkSize = 64 * 1024;
+    // 头是从数据里读出来的，读的时候按这两个上限拒绝损坏的流，不去分配离谱大小的偏移表和解压缓冲区
+    constexpr uint32_t ChunkedMaxChunkSize = 64 * 1024 * 1024;
+    constexpr uint32_t ChunkedMaxChunkCount = 16 * 1024 * 1024;
+
+    // 压缩成分块流格式，追加到 output 后面
+    bool ChunkedCompress(const void* data, size_t size, std::vector<uint8_t>& output, uint32_t chunkSize = ChunkedDefaultChunkSize);
+
+    /**
+     * @brief 分块压缩流的读取
+     *  当前位置所在的 chunk 在读线程上直接解压，后面 readAhead 个 chunk 丢给解压线程预读，
+     *  顺序读的时候基本不用等待。源可以是一块内存（比如 mmap 的资源包），也可以是另一个 IStream。
+     */
+    class ChunkedIStream : public IStream {
+    private:
+        enum class SlotState : uint8_t {
+            empty,
+            pending,
+            ready,
+            failed,
+        };
+        struct slot_t {
+            int64_t     chunk;
+            SlotState   state;
+            uint8_t*    data;
+        };
+        const uint8_t*                  _memory;        // 内存源
+        IStream*                        _source;        // 流源
+        bool                            _ownSource;
+        std::mutex                      _sourceMutex;
+        chunked_header_t                _header;
+        std::vector<uint64_t>           _offsets;
+        int64_t                         _position;
+        uint32_t                        _readAhead;
+        std::vector<slot_t>             _slots;
+        uint8_t*                        _slotMemory;
+        std::mutex                      _mutex;
+        std::condition_variable         _cv;
+        uint32_t                        _inflight;
+    private:
+        bool initialize(const uint8_t* headerData, uint64_t available);
+        bool decodeChunk(int64_t chunk, uint8_t* dst);
+        slot_t* acquire(int64_t chunk);
+        void prefetch(int64_t chunk);
+    public:
+        ChunkedIStream(const void* memory, IStream* source, bool ownSource, uint32_t readAhead);
+        bool open(uint64_t memorySize);
+        uint32_t chunkSize() const { return _header.chunkSize; }
+        uint32_t chunkCount() const { return _header.chunkCount; }
+        virtual int64_t read( void* buffer, int64_t size ) override;
+        virtual int64_t seek( SeekOption option, int offset ) override;
+        virtual int64_t tell() const override;
+        virtual int64_t size() const override;
+        virtual bool seekable() const override;
+        virtual void close() override;
+        virtual ~ChunkedIStream() override;
+    };
+
+    constexpr uint32_t ChunkedDefaultReadAhead = 4;
+
+    // 格式不对返回 nullptr，memory 必须在流关闭之前一直有效
+    IStream* CreateChunkedIStream(const void* memory, uint64_t size, uint32_t readAhead = ChunkedDefaultReadAhead);
+    // ownSource 为 true 时流关闭会一起关闭 source
+    IStream* CreateChunkedIStream(IStream* source, bool ownSource, uint32_t readAhead = ChunkedDefaultReadAhead);
+
+}
@@ -0,0 +1,389 @@
+#include "content_cache.h"
+#include "../memory/memory.h"
+#include <new>
+
+namespace comm {
+
+    static_assert(sizeof(CachedBlob) <= CachedBlob::HeaderSize, "CachedBlob header overflow");
+
+    CachedBlob* CachedBlob::Allocate(uint64_t key, size_t size) {
+        auto memptr = comm_alloc(HeaderSize + size);
+        if(!memptr) {
+            return nullptr;
+        }
+        return new (memptr) CachedBlob(key, size);
+    }
+
+    void CachedBlob::release() {
+        if(_refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            this->~CachedBlob();
+            comm_free(this);
+        }
+    }
+
+    ContentCache::ContentCache(Options const& options)
+        : _options(options)
+        , _shards(nullptr)
+        , _shardMask(0)
+        , _shardCapacity(0)
+        , _hits(0)
+        , _misses(0)
+        , _evictions(0)
+        , _insertions(0)
+    {
+        uint32_t shardCount = 1;
+        while(shardCount < options.shardCount) {
+            shardCount <<= 1;
+        }
+        _shards = new shard_t[shardCount];
+        _shardMask = shardCount - 1;
+        _shardCapacity = options.capacity / shardCount;
+        if(_options.maxEntrySize > _shardCapacity) {
+            _options.maxEntrySize = _shardCapacity;
+        }
+    }
+
+    ContentCache::ContentCache()
+        : ContentCache(Options())
+    {}
+
+    void ContentCache::evict(shard_t& shard) {
+        while(shard.bytes > _shardCapacity && !shard.lru.empty()) {
+            CachedBlob* blob = shard.lru.back();
+            shard.lru.pop_back();
+            shard.map.erase(blob->key());
+            shard.bytes -= blob->size();
+            blob->release();
+            _evictions.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    BlobRef ContentCache::find(uint64_t key) {
+        shard_t& shard = shardOf(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto iter = shard.map.find(key);
+        if(iter == shard.map.end()) {
+            _misses.fetch_add(1, std::memory_order_relaxed);
+            return BlobRef();
+        }
+        shard.lru.splice(shard.lru.begin(), shard.lru, iter->second);
+        CachedBlob* blob = *iter->second;
+        blob->addRef();
+        _hits.fetch_add(1, std::memory_order_relaxed);
+        return BlobRef(blob);
+    }
+
+    uint64_t ContentCache::generation(uint64_t key) {
+        shard_t& shard = shardOf(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        return shard.generation;
+    }
+
+    BlobRef ContentCache::insert(BlobRef&& ref) {
+        CachedBlob* blob = ref.get();
+        if(!blob) {
+            return std::move(ref);
+        }
+        return insert(std::move(ref), generation(blob->key()));
+    }
+
+    BlobRef ContentCache::insert(BlobRef&& ref, uint64_t generation) {
+        CachedBlob* blob = ref.get();
+        if(!blob || blob->size() > _options.maxEntrySize) {
+            return std::move(ref);
+        }
+        shard_t& shard = shardOf(blob->key());
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        if(shard.generation != generation) {
+            // 读的过程中失效过，内容可能是旧的，不缓存
+            return std::move(ref);
+        }
+        auto iter = shard.map.find(blob->key());
+        if(iter != shard.map.end()) {
+            // 别的线程先读进来了，用已有的
+            CachedBlob* exist = *iter->second;
+            exist->addRef();
+            return BlobRef(exist);
+        }
+        blob->addRef();     // 缓存自己持有一个引用
+        shard.lru.push_front(blob);
+        shard.map.emplace(blob->key(), shard.lru.begin());
+        shard.bytes += blob->size();
+        _insertions.fetch_add(1, std::memory_order_relaxed);
+        evict(shard);
+        return std::move(ref);
+    }
+
+    bool ContentCache::invalidate(uint64_t key) {
+        shard_t& shard = shardOf(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        // 不在缓存里也要加，可能有人正在读这个文件准备放进来
+        ++shard.generation;
+        auto iter = shard.map.find(key);
+        if(iter == shard.map.end()) {
+            return false;
+        }
+        CachedBlob* blob = *iter->second;
+        shard.lru.erase(iter->second);
+        shard.map.erase(iter);
+        shard.bytes -= blob->size();
+        blob->release();
+        return true;
+    }
+
+    void ContentCache::clear() {
+        for(uint32_t i = 0; i <= _shardMask; ++i) {
+            shard_t& shard = _shards[i];
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            for(auto blob : shard.lru) {
+                blob->release();
+            }
+            shard.lru.clear();
+            shard.map.clear();
+            shard.bytes = 0;
+            ++shard.generation;
+        }
+    }
+
+    ContentCacheStats ContentCache::stats() const {
+        ContentCacheStats stats = {};
+        stats.hits = _hits.load(std::memory_order_relaxed);
+        stats.misses = _misses.load(std::memory_order_relaxed);
+        stats.evictions = _evictions.load(std::memory_order_relaxed);
+        stats.insertions = _insertions.load(std::memory_order_relaxed);
+        for(uint32_t i = 0; i <= _shardMask; ++i) {
+            shard_t& shard = _shards[i];
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            stats.bytes += shard.bytes;
+            stats.entries += shard.map.size();
+        }
+        return stats;
+    }
+
+    ContentCache::~ContentCache() {
+        clear();
+        delete[] _shards;
+    }
+
+    void ContentCache::destroy() {
+        this->~ContentCache();
+        comm_free(this);
+    }
+
+    ContentCache* CreateContentCache(ContentCache::Options const& options) {
+        auto memptr = comm_alloc(sizeof(ContentCache));
+        return new (memptr) ContentCache(options);
+    }
+
+    void BlobIStream::close() {
+        this->~BlobIStream();
+        comm_free(this);
+    }
+
+    static uint64_t NextCacheSalt() {
+        static std::atomic<uint64_t> counter(0);
+        // 乘一个奇数把相邻的计数打散到高位，不同实例的 key 落到不同的分片
+        return (counter.fetch_add(1, std::memory_order_relaxed) + 1) * 0x9e3779b97f4a7c15ULL;
+    }
+
+    CachingArchive::CachingArchive(IArchive* archive, ContentCache* cache, PathCase pathCase, bool owned)
+        : _archive(archive)
+        , _cache(cache)
+        , _salt(NextCacheSalt())
+        , _pathCase(pathCase)
+        , _subscription(0)
+        , _owned(owned)
+    {
+        _subscription = _archive->subscribeChanges([this](std::vector<FileChangeEvent> const& events) {
+            invalidate(events);
+        });
+    }
+
+    BlobRef CachingArchive::fill(uint64_t key, uint64_t salt, uint64_t generation, IStream* stream) {
+        int64_t size = stream->size();
+        BlobRef ref;
+        if(size >= 0) {
+            // 直接读进 blob 的数据区，之后不再拷贝
+            ref = BlobRef(CachedBlob::Allocate(key, (size_t)size));
+        }
+        int64_t total = 0;
+        while(ref && total < size) {
+            int64_t bytes = stream->read(ref.get()->mutableData() + total, size - total);
+            if(bytes <= 0) {
+                break;
+            }
+            total += bytes;
+        }
+        stream->close();
+        if(!ref || total != size) {
+            return BlobRef();
+        }
+        if(_salt.load(std::memory_order_relaxed) != salt) {
+            return ref;     // 期间 invalidateAll 了
+        }
+        return _cache->insert(std::move(ref), generation);
+    }
+
+    BlobRef CachingArchive::load(const std::string& path) {
+        uint64_t salt = _salt.load(std::memory_order_relaxed);
+        uint64_t key = RelativePathHash(path, _pathCase) ^ salt;
+        BlobRef ref = _cache->find(key);
+        if(ref) {
+            return ref;
+        }
+        uint64_t generation = _cache->generation(key);
+        IStream* stream = _archive->openIStream(path, ReadFlag::binary);
+        if(!stream) {
+            return BlobRef();
+        }
+        return fill(key, salt, generation, stream);
+    }
+
+    void CachingArchive::invalidate(const std::string& path) {
+        _cache->invalidate(keyOf(RelativePathHash(path, _pathCase)));
+    }
+
+    void CachingArchive::invalidate(std::vector<FileChangeEvent> const& events) {
+        for(auto& event : events) {
+            if(event.kind == FileChangeKind::rescan) {
+                invalidateAll();
+                return;
+            }
+            invalidate(event.path);
+        }
+    }
+
+    void CachingArchive::invalidateAll() {
+        _salt.store(NextCacheSalt(), std::memory_order_relaxed);
+    }
+
+    IStream* CachingArchive::openIStream(const std::string& path, BitFlags<ReadFlag> flags) {
+        // 文本方式在 windows 上会转换换行，不走缓存
+        if(!flags.test(ReadFlag::binary)) {
+            return _archive->openIStream(path, flags);
+        }
+        uint64_t salt = _salt.load(std::memory_order_relaxed);
+        uint64_t key = RelativePathHash(path, _pathCase) ^ salt;
+        BlobRef ref = _cache->find(key);
+        if(!ref) {
+            uint64_t generation = _cache->generation(key);
+            IStream* stream = _archive->openIStream(path, flags);
+            // 太大的文件不进缓存，直接用底层的流
+            if(!stream || stream->size() < 0 || (size_t)stream->size() > _cache->maxEntrySize()) {
+                return stream;
+            }
+            ref = fill(key, salt, generation, stream);
+            if(!ref) {
+                return nullptr;
+            }
+        }
+        auto memptr = comm_alloc(sizeof(BlobIStream));
+        return new (memptr) BlobIStream(std::move(ref));
+    }
+
+    /**
+     * @brief 包一层写流，close 之后（atomic 写这时才 rename 到位）再让缓存条目失效一次，
+     *  否则打开到 close 之间读进缓存的旧内容会一直留着。不能比 CachingArchive 活得久
+     */
+    class InvalidatingOStream : public OStream {
+    private:
+        OStream*            _stream;
+        CachingArchive*     _archive;
+        std::string         _path;
+    public:
+        InvalidatingOStream(OStream* stream, CachingArchive* archive, const std::string& path)
+            : _stream(stream)
+            , _archive(archive)
+            , _path(path)
+        {}
+        virtual int64_t write(const void* buffer, int64_t size) override {
+            return _stream->write(buffer, size);
+        }
+        virtual int64_t writev(std::span<const IOVec> vecs) override {
+            return _stream->writev(vecs);
+        }
+        virtual bool flush() override {
+            return _stream->flush();
+        }
+        virtual int64_t seek(SeekOption option, int offset) override {
+            return _stream->seek(option, offset);
+        }
+        virtual int64_t tell() const override {
+            return _stream->tell();
+        }
+        virtual int64_t size() const override {
+            return _stream->size();
+        }
+        virtual bool seekable() const override {
+            return _stream->seekable();
+        }
+        virtual void close() override {
+            _stream->close();
+            _archive->invalidate(_path);
+            this->~InvalidatingOStream();
+            comm_free(this);
+        }
+    };
+
+    OStream* CachingArchive::openOStream(const std::string& path, BitFlags<WriteFlag> flags) {
+        invalidate(path);
+        OStream* stream = _archive->openOStream(path, flags);
+        if(!stream) {
+            return nullptr;
+        }
+        auto memptr = comm_alloc(sizeof(InvalidatingOStream));
+        return new (memptr) InvalidatingOStream(stream, this, path);
+    }
+
+    bool CachingArchive::testExist(const std::string& path) {
+        return _archive->testExist(path);
+    }
+
+    bool CachingArchive::supportListFeature() const {
+        return _archive->supportListFeature();
+    }
+
+    std::vector<IArchive::FileEntity> CachingArchive::listFiles(const std::string& path) {
+        return _archive->listFiles(path);
+    }
+
+    std::vector<IArchive::FileEntity> CachingArchive::listFilesRecursive(const std::string& path) {
+        return _archive->listFilesRecursive(path);
+    }
+
+    std::string CachingArchive::rootPath() {
+        return _archive->rootPath();
+    }
+
+    bool CachingArchive::readonly() const {
+        return _archive->readonly();
+    }
+
+    uint32_t CachingArchive::subscribeChanges(FileChangeCallback callback) {
+        return _archive->subscribeChanges(std::move(callback));
+    }
+
+    void CachingArchive::unsubscribeChanges(uint32_t subscription) {
+        _archive->unsubscribeChanges(subscription);
+    }
+
+    CachingArchive::~CachingArchive() {
+        if(_subscription) {
+            _archive->unsubscribeChanges(_subscription);
+        }
+        if(_owned) {
+            _archive->destroy();
+        }
+    }
+
+    void CachingArchive::destroy() {
+        this->~CachingArchive();
+        comm_free(this);
+    }
+
+    CachingArchive* CreateCachingArchive(IArchive* archive, ContentCache* cache, PathCase pathCase, bool owned) {
+        auto memptr = comm_alloc(sizeof(CachingArchive));
+        return new (memptr) CachingArchive(archive, cache, pathCase, owned);
+    }
+
+}
@@ -0,0 +1,224 @@
+#pragma once
+#include "archive.h"
+#include "memory_stream.h"
+#include "file_watcher.h"
+#include "path.h"
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+namespace comm {
+
+    /**
+     * @brief 缓存里的文件内容，不可修改，引用计数归零时回收
+     *  头和数据在同一块 comm_alloc 的内存里
+     */
+    class CachedBlob {
+    private:
+        std::atomic<uint32_t>   _refs;
+        uint64_t                _key;
+        size_t                  _size;
+    private:
+        CachedBlob(uint64_t key, size_t size)
+            : _refs(1)
+            , _key(key)
+            , _size(size)
+        {}
+    public:
+        constexpr static size_t HeaderSize = 32;
+        // 分配 size 字节，引用计数为 1，数据由调用者填
+        static CachedBlob* Allocate(uint64_t key, size_t size);
+        uint8_t* mutableData() { return (uint8_t*)this + HeaderSize; }
+        const uint8_t* data() const { return (const uint8_t*)this + HeaderSize; }
+        size_t size() const { return _size; }
+        uint64_t key() const { return _key; }
+        void addRef() {
+            _refs.fetch_add(1, std::memory_order_relaxed);
+        }
+        void release();
+    };
+
+    /**
+     * @brief CachedBlob 的引用，拷贝加引用，析构减引用
+     *  被缓存淘汰之后手上的引用仍然有效
+     */
+    class BlobRef {
+    private:
+        CachedBlob*     _blob;
+    public:
+        BlobRef() : _blob(nullptr) {}
+        // 接管一个引用
+        explicit BlobRef(CachedBlob* blob) : _blob(blob) {}
+        BlobRef(BlobRef const& ref) : _blob(ref._blob) {
+            if(_blob) {
+                _blob->addRef();
+            }
+        }
+        BlobRef(BlobRef&& ref) : _blob(ref._blob) {
+            ref._blob = nullptr;
+        }
+        BlobRef& operator = (BlobRef const& ref) {
+            BlobRef(ref).swap(*this);
+            return *this;
+        }
+        BlobRef& operator = (BlobRef&& ref) {
+            BlobRef(std::move(ref)).swap(*this);
+            return *this;
+        }
+        void swap(BlobRef& ref) {
+            std::swap(_blob, ref._blob);
+        }
+        void reset() {
+            if(_blob) {
+                _blob->release();
+                _blob = nullptr;
+            }
+        }
+        explicit operator bool() const { return _blob != nullptr; }
+        const uint8_t* data() const { return _blob ? _blob->data() : nullptr; }
+        size_t size() const { return _blob ? _blob->size() : 0; }
+        CachedBlob* get() const { return _blob; }
+        ~BlobRef() { reset(); }
+    };
+
+    struct ContentCacheStats {
+        uint64_t    hits;
+        uint64_t    misses;
+        uint64_t    evictions;
+        uint64_t    insertions;
+        uint64_t    bytes;
+        uint64_t    entries;
+    };
+
+    /**
+     * @brief 按 key（一般是规范路径的哈希）缓存文件内容，总大小有上限
+     *  key 按高位分到若干个分片，每个分片一把锁、一条 LRU 链，多线程查找基本不会互相挡
+     */
+    class ContentCache {
+    public:
+        struct Options {
+            size_t      capacity = 64 << 20;    // 字节，平均分给各个分片
+            uint32_t    shardCount = 16;        // 会向上取成 2 的幂
+            size_t      maxEntrySize = 8 << 20; // 超过这个大小的文件不缓存
+        };
+    private:
+        struct shard_t {
+            std::mutex                                                      mutex;
+            std::list<CachedBlob*>                                          lru;        // 头部最近使用
+            std::unordered_map<uint64_t, std::list<CachedBlob*>::iterator>  map;
+            size_t                                                          bytes = 0;
+            uint64_t                                                        generation = 0;     // 分片里有 key 失效就加一
+        };
+        Options                     _options;
+        shard_t*                    _shards;
+        uint32_t                    _shardMask;
+        size_t                      _shardCapacity;
+        std::atomic<uint64_t>       _hits;
+        std::atomic<uint64_t>       _misses;
+        std::atomic<uint64_t>       _evictions;
+        std::atomic<uint64_t>       _insertions;
+    private:
+        shard_t& shardOf(uint64_t key) const {
+            // 低位给哈希表用，分片用高位
+            return _shards[(key >> 40) & _shardMask];
+        }
+        void evict(shard_t& shard);
+    public:
+        ContentCache(Options const& options);
+        ContentCache();
+        ContentCache(ContentCache const&) = delete;
+        ContentCache& operator = (ContentCache const&) = delete;
+        // 命中会把条目移到 LRU 头部
+        BlobRef find(uint64_t key);
+        // key 已经存在时保留旧的并返回旧的，blob 被释放
+        BlobRef insert(BlobRef&& blob);
+        /**
+         * @brief 读文件之前先取 generation(key)，读完用它 insert：
+         *  期间 key 所在的分片有过 invalidate（文件可能被改了）就不进缓存，原样返回 blob
+         *  按分片记录，同分片别的 key 失效也会让这次不缓存，只是少缓存一次
+         */
+        uint64_t generation(uint64_t key);
+        BlobRef insert(BlobRef&& blob, uint64_t generation);
+        bool invalidate(uint64_t key);
+        void clear();
+        size_t maxEntrySize() const {
+            return _options.maxEntrySize;
+        }
+        ContentCacheStats stats() const;
+        void destroy();
+        ~ContentCache();
+    };
+
+    ContentCache* CreateContentCache(ContentCache::Options const& options);
+
+    /**
+     * @brief 缓存里的内容上的只读流，不拷贝数据，close 时释放引用
+     */
+    class BlobIStream : public MemoryIStream {
+    private:
+        BlobRef     _ref;
+    public:
+        BlobIStream(BlobRef&& ref)
+            : MemoryIStream(ref.data(), (int64_t)ref.size())
+            , _ref(std::move(ref))
+        {}
+        virtual void close() override;
+        virtual ~BlobIStream() override {}
+    };
+
+    /**
+     * @brief 挂在 IArchive 前面的读缓存
+     *  二进制方式打开的文件整个读进缓存，之后再打开直接返回缓存上的视图流。
+     *  写入会让对应的条目失效（打开时和 close 时各一次，atomic 写在 close 时才 rename 过去）；底层 archive 支持 subscribeChanges（比如 watch 中的 FileSystemArchive）时，
+     *  外部修改的文件也会自动失效，否则需要自己调用 invalidate。
+     *  多个 CachingArchive 可以共用一个 ContentCache，key 里混入了每个实例不同的盐。
+     */
+    class CachingArchive : public IArchive {
+    private:
+        IArchive*               _archive;
+        ContentCache*           _cache;
+        std::atomic<uint64_t>   _salt;
+        PathCase                _pathCase;
+        uint32_t                _subscription;
+        bool                    _owned;
+    private:
+        uint64_t keyOf(uint64_t pathHash) const {
+            return pathHash ^ _salt.load(std::memory_order_relaxed);
+        }
+        /**
+         * @brief 把 stream 整个读进缓存，stream 会被 close
+         *  salt、generation 是打开 stream 之前取的，读的过程中条目被失效了就只返回内容、不进缓存
+         */
+        BlobRef fill(uint64_t key, uint64_t salt, uint64_t generation, IStream* stream);
+    public:
+        CachingArchive(IArchive* archive, ContentCache* cache, PathCase pathCase, bool owned);
+        // 返回整个文件的内容，没有缓存时读进缓存，文件不存在返回空引用
+        BlobRef load(const std::string& path);
+        void invalidate(const std::string& path);
+        void invalidate(std::vector<FileChangeEvent> const& events);
+        // 换一个盐，旧的条目都访问不到了，之后被 LRU 自然淘汰
+        void invalidateAll();
+        IArchive* archive() const { return _archive; }
+        ContentCache* cache() const { return _cache; }
+        //
+        virtual IStream* openIStream( const std::string& path, BitFlags<ReadFlag> flags) override;
+        virtual OStream* openOStream( const std::string& path, BitFlags<WriteFlag> flags) override;
+        virtual bool testExist( const std::string& path ) override;
+        virtual bool supportListFeature() const override;
+        virtual std::vector<FileEntity> listFiles( const std::string& path ) override;
+        virtual std::vector<FileEntity> listFilesRecursive( const std::string& path ) override;
+        virtual std::string rootPath() override;
+        virtual bool readonly() const override;
+        virtual uint32_t subscribeChanges( FileChangeCallback callback) override;
+        virtual void unsubscribeChanges( uint32_t subscription) override;
+        virtual void destroy() override;
+        virtual ~CachingArchive() override;
+    };
+
+    /**
+     * @param owned 为 true 时 CachingArchive 销毁时一起 destroy 底层的 archive（cache 不归它管）
+     */
+    CachingArchive* CreateCachingArchive(IArchive* archive, ContentCache* cache, PathCase pathCase = PathCase::sensitive, bool owned = false);
+
+}
@@ -0,0 +1,279 @@
+#include "file_watcher.h"
+#if defined(__linux__)
+#include "../memory/memory.h"
+#include <chrono>
+#include <algorithm>
+#include <sys/inotify.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <cerrno>
+
+namespace comm {
+
+    FileWatcher::FileWatcher(const std::string& root, Options const& options)
+        : _root(root)
+        , _options(options)
+        , _callback()
+        , _thread()
+        , _inotify(-1)
+        , _wakeup(-1)
+        , _running(false)
+        , _watches()
+        , _pending()
+        , _rescan(false)
+    {}
+
+    FileWatcher::FileWatcher(const std::string& root)
+        : FileWatcher(root, Options())
+    {}
+
+    void FileWatcher::record(std::string&& path, FileChangeKind kind) {
+        auto iter = _pending.find(path);
+        if(iter == _pending.end()) {
+            _pending.emplace(std::move(path), kind);
+            return;
+        }
+        // 合并同一个文件的多次变化，只关心批次开始和结束时的状态差异
+        FileChangeKind prev = iter->second;
+        if(prev == FileChangeKind::added) {
+            if(kind == FileChangeKind::removed) {
+                _pending.erase(iter);   // 批次内新建又删掉了
+            }
+        } else if(prev == FileChangeKind::removed) {
+            if(kind != FileChangeKind::removed) {
+                iter->second = FileChangeKind::modified;    // 删掉又重建
+            }
+        } else if(kind == FileChangeKind::removed) {
+            iter->second = FileChangeKind::removed;
+        }
+    }
+
+    void FileWatcher::flush() {
+        std::vector<FileChangeEvent> events;
+        if(_rescan) {
+            events.push_back(FileChangeEvent { std::string(), FileChangeKind::rescan });
+        } else {
+            events.reserve(_pending.size());
+            for(auto& item : _pending) {
+                events.push_back(FileChangeEvent { item.first, item.second });
+            }
+        }
+        _pending.clear();
+        _rescan = false;
+        if(!events.empty() && _callback) {
+            _callback(events);
+        }
+    }
+
+    constexpr uint32_t WatchMask = IN_CREATE | IN_DELETE | IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_FROM | IN_MOVED_TO
+        | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR | IN_DONT_FOLLOW | IN_EXCL_UNLINK;
+
+    void FileWatcher::watchTree(std::string const& relative, bool emitFiles) {
+        std::string fullpath = relative.empty() ? _root : _root + "/" + relative;
+        int wd = inotify_add_watch(_inotify, fullpath.c_str(), WatchMask);
+        if(wd < 0) {
+            return;
+        }
+        _watches[wd] = relative;
+        // 先加 watch 再遍历，遍历期间新建的文件要么被遍历到要么产生事件，不会漏
+        DIR* dir = opendir(fullpath.c_str());
+        if(!dir) {
+            return;
+        }
+        while(auto entry = readdir(dir)) {
+            const char* name = entry->d_name;
+            if(name[0] == '.' && (name[1] == 0 || (name[1] == '.' && name[2] == 0))) {
+                continue;
+            }
+            unsigned char dtype = entry->d_type;
+            std::string child = relative.empty() ? std::string(name) : relative + "/" + name;
+            if(dtype == DT_UNKNOWN) {
+                struct stat st;
+                if(lstat((_root + "/" + child).c_str(), &st) != 0) {
+                    continue;
+                }
+                dtype = S_ISDIR(st.st_mode) ? DT_DIR : (S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN);
+            }
+            if(dtype == DT_DIR) {
+                watchTree(child, emitFiles);
+            } else if(dtype == DT_REG && emitFiles) {
+                record(std::move(child), FileChangeKind::added);
+            }
+        }
+        closedir(dir);
+    }
+
+    void FileWatcher::rewatch() {
+        for(auto& item : _watches) {
+            inotify_rm_watch(_inotify, item.first);
+        }
+        _watches.clear();
+        watchTree(std::string(), false);
+        _rescan = true;
+    }
+
+    void FileWatcher::run() {
+        using clock = std::chrono::steady_clock;
+        alignas(struct inotify_event) char buffer[16384];
+        clock::time_point first, last, retry;
+        while(_running) {
+            int timeout = -1;
+            if(_watches.empty()) {
+                // 根目录不在，每秒试一次，重新监视上了就整体重新扫描
+                auto now = clock::now();
+                if(now >= retry) {
+                    watchTree(std::string(), false);
+                    if(!_watches.empty()) {
+                        _rescan = true;
+                        last = first = now;
+                        continue;
+                    }
+                    retry = now + std::chrono::seconds(1);
+                }
+                timeout = (int)std::chrono::duration_cast<std::chrono::milliseconds>(retry - now).count() + 1;
+            }
+            if(!_pending.empty() || _rescan) {
+                auto now = clock::now();
+                auto quiet = std::chrono::duration_cast<std::chrono::milliseconds>(now - last).count();
+                auto age = std::chrono::duration_cast<std::chrono::milliseconds>(now - first).count();
+                if(quiet >= _options.debounce || age >= _options.maxLatency) {
+                    flush();
+                    continue;
+                }
+                int wait = (int)std::min<int64_t>(_options.debounce - quiet, _options.maxLatency - age);
+                timeout = timeout < 0 ? wait : std::min(timeout, wait);
+            }
+            pollfd fds[2] = {
+                { _inotify, POLLIN, 0 },
+                { _wakeup, POLLIN, 0 },
+            };
+            int rst = poll(fds, 2, timeout);
+            if(rst < 0 && errno != EINTR) {
+                break;
+            }
+            if(rst <= 0 || !(fds[0].revents & POLLIN)) {
+                continue;
+            }
+            bool hadPending = !_pending.empty() || _rescan;
+            while(true) {
+                ssize_t bytes = read(_inotify, buffer, sizeof(buffer));
+                if(bytes <= 0) {
+                    break;
+                }
+                for(ssize_t pos = 0; pos < bytes;) {
+                    auto event = (struct inotify_event const*)(buffer + pos);
+                    pos += sizeof(struct inotify_event) + event->len;
+                    if(event->mask & IN_Q_OVERFLOW) {
+                        rewatch();
+                        continue;
+                    }
+                    auto iter = _watches.find(event->wd);
+                    if(iter == _watches.end()) {
+                        continue;
+                    }
+                    if(event->mask & IN_IGNORED) {
+                        _watches.erase(iter);
+                        continue;
+                    }
+                    if(event->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+                        if(iter->second.empty()) {
+                            // 根目录没了，原来的 watch 都作废，重新监视（不在的话之后定时重试）
+                            rewatch();
+                        }
+                        continue;
+                    }
+                    if(!event->len) {
+                        continue;
+                    }
+                    std::string path = iter->second.empty() ? std::string(event->name) : iter->second + "/" + event->name;
+                    if(event->mask & IN_ISDIR) {
+                        if(event->mask & (IN_CREATE | IN_MOVED_TO)) {
+                            watchTree(path, true);
+                        } else if(event->mask & IN_MOVED_FROM) {
+                            // 移走的目录下的文件不会有单独的事件，子目录 watch 的路径也失效了
+                            rewatch();
+                        }
+                        continue;
+                    }
+                    if(event->mask & (IN_CREATE | IN_MOVED_TO)) {
+                        record(std::move(path), FileChangeKind::added);
+                    } else if(event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                        record(std::move(path), FileChangeKind::removed);
+                    } else if(event->mask & (IN_MODIFY | IN_CLOSE_WRITE)) {
+                        record(std::move(path), FileChangeKind::modified);
+                    }
+                }
+            }
+            if(!_pending.empty() || _rescan) {
+                last = clock::now();
+                if(!hadPending) {
+                    first = last;
+                }
+            }
+        }
+        if(!_pending.empty() || _rescan) {
+            flush();
+        }
+    }
+
+    bool FileWatcher::start(FileChangeCallback callback) {
+        if(_running) {
+            return false;
+        }
+        _inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if(_inotify < 0) {
+            return false;
+        }
+        _wakeup = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        watchTree(std::string(), false);
+        if(_wakeup < 0 || _watches.empty()) {
+            stop();
+            return false;
+        }
+        _callback = std::move(callback);
+        _running = true;
+        _thread = std::thread(&FileWatcher::run, this);
+        return true;
+    }
+
+    void FileWatcher::stop() {
+        if(_running.exchange(false)) {
+            uint64_t one = 1;
+            (void)!write(_wakeup, &one, sizeof(one));
+        }
+        if(_thread.joinable()) {
+            _thread.join();
+        }
+        if(_inotify >= 0) {
+            close(_inotify);
+            _inotify = -1;
+        }
+        if(_wakeup >= 0) {
+            close(_wakeup);
+            _wakeup = -1;
+        }
+        _watches.clear();
+        _pending.clear();
+        _rescan = false;
+    }
+
+    FileWatcher::~FileWatcher() {
+        stop();
+    }
+
+    void FileWatcher::destroy() {
+        this->~FileWatcher();
+        comm_free(this);
+    }
+
+    FileWatcher* CreateFileWatcher(const std::string& root, FileWatcher::Options const& options) {
+        auto memptr = comm_alloc(sizeof(FileWatcher));
+        return new (memptr) FileWatcher(root, options);
+    }
+
+}
+
+#endif
@@ -0,0 +1,76 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <functional>
+#include <thread>
+#include <atomic>
+#include <unordered_map>
+
+namespace comm {
+
+    enum class FileChangeKind : uint8_t {
+        added,
+        modified,
+        removed,
+        rescan,         // 事件丢失（队列溢出、目录被移动...），path 为空，需要整体重新扫描
+    };
+
+    struct FileChangeEvent {
+        std::string         path;   // 相对监视根目录的规范路径
+        FileChangeKind      kind;
+    };
+
+    using FileChangeCallback = std::function<void(std::vector<FileChangeEvent> const& events)>;
+
+#if defined(__linux__)
+
+    /**
+     * @brief 递归监视一个目录树的文件变化，基于 inotify，只在 linux 上编译（其它平台没有这个类）
+     *  事件在监视线程上合并：同一个文件的多次变化只保留一条，
+     *  安静 debounce 毫秒之后（或者最早的事件等了 maxLatency 毫秒之后）整批交给回调。
+     *  回调在监视线程上执行，不要在回调里 stop。
+     *  根目录被删掉或者移走之后每秒试着重新监视一次，重新建起来时发一次 rescan。
+     */
+    class FileWatcher {
+    public:
+        struct Options {
+            uint32_t    debounce = 100;     // 毫秒
+            uint32_t    maxLatency = 1000;  // 毫秒，持续有写入时也至少这么久回调一次
+        };
+    private:
+        std::string             _root;
+        Options                 _options;
+        FileChangeCallback      _callback;
+        std::thread             _thread;
+        int                     _inotify;
+        int                     _wakeup;    // eventfd，用来叫醒监视线程退出
+        std::atomic<bool>       _running;
+        // 以下只在 start 和监视线程里访问
+        std::unordered_map<int, std::string>                _watches;   // inotify wd -> 相对目录
+        std::unordered_map<std::string, FileChangeKind>     _pending;
+        bool                                                _rescan;
+    private:
+        void run();
+        void record(std::string&& path, FileChangeKind kind);
+        // 监视 relative 及其所有子目录，emitFiles 时把已有的文件当作新增（新建/移入的目录）
+        void watchTree(std::string const& relative, bool emitFiles);
+        void rewatch();
+        void flush();
+    public:
+        FileWatcher(const std::string& root, Options const& options);
+        FileWatcher(const std::string& root);
+        bool start(FileChangeCallback callback);
+        void stop();
+        bool running() const {
+            return _running;
+        }
+        void destroy();
+        ~FileWatcher();
+    };
+
+    FileWatcher* CreateFileWatcher(const std::string& root, FileWatcher::Options const& options);
+
+#endif
+
+}
@@ -1,56 +1,149 @@
 #include "filesystem_archive.h"
+#include "buffered_ostream.h"
+#include "path.h"
 #include "../memory/memory.h"
+#include "../memory/object_pool.h"
+#include "../profile/profiler.h"
+#include <sys/stat.h>
+#include <algorithm>
+#include <functional>
+#include <ctime>
 #ifdef _WIN32
 #include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <cstring>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
 #endif
 
 namespace comm {
 
 std::string FormatFilePath(const std::string& _filepath)
 {
-    int nSec = 0;
-    std::string curSec;
-    std::string fpath;
-    if (_filepath[0] == '/') {
-        fpath.push_back('/');
-    }
-    const char* ptr = _filepath.c_str();
-    while (*ptr != 0) {
-        if (*ptr == '\\' || *ptr == '/') {
-            if (curSec.length() > 0) {
-                if (curSec == ".") {
-                } else if (curSec == ".." && nSec >= 2) {
-                    int secleft = 2;
-                    while (!(fpath.empty() && secleft == 0)) {
-                        if (fpath.back() == '\\' || fpath.back() == '/') {
-                            --secleft;
-                            break;
-                        }
-                        fpath.pop_back();
-                    }
-                    fpath.pop_back(); // pop back '/'
-                } else {
-                    if (!fpath.empty() && fpath.back() != '/')
-                        fpath.push_back('/');
-                    fpath.append(curSec);
-                    ++nSec;
-                }
-                curSec.clear();
+    return NormalizePath(_filepath);
+}
+
+#ifndef _WIN32
+/**
+ * @brief 基于 openat 的目录遍历，子目录相对父目录的 fd 打开，不用反复拼接绝对路径
+ *  linux 上直接用 getdents64 一次取一批目录项，其它 posix 平台用 readdir
+ */
+using WalkVisitor = std::function<void(std::string const& relative, IArchive::FileEntityType type, struct stat const* st)>;
+
+#if defined(__linux__)
+struct linux_dirent64_t {
+    uint64_t        d_ino;
+    int64_t         d_off;
+    unsigned short  d_reclen;
+    unsigned char   d_type;
+    char            d_name[1];
+};
+#endif
+
+static void PosixWalkDirectory(int dirfd, std::string& relative, bool recursive, bool needStat, WalkVisitor const& visitor)
+{
+    auto visit = [&](const char* name, unsigned char dtype) {
+        if (name[0] == '.' && (name[1] == 0 || (name[1] == '.' && name[2] == 0))) {
+            return;
+        }
+        struct stat st;
+        bool hasStat = false;
+        bool isDirectory = false;
+        if (needStat || dtype == DT_UNKNOWN || dtype == DT_LNK) {
+            if (fstatat(dirfd, name, &st, 0) != 0) {
+                return;
+            }
+            hasStat = true;
+            if (!S_ISDIR(st.st_mode) && !S_ISREG(st.st_mode)) {
+                return;
             }
+            isDirectory = S_ISDIR(st.st_mode);
+        } else if (dtype == DT_DIR || dtype == DT_REG) {
+            isDirectory = dtype == DT_DIR;
         } else {
-            curSec.push_back(*ptr);
-            if (*ptr == ':') {
-                --nSec;
+            return; // socket, fifo ...
+        }
+        size_t length = relative.length();
+        if (length) {
+            relative.push_back('/');
+        }
+        relative.append(name);
+        visitor(relative, isDirectory ? IArchive::FileEntityType::directory : IArchive::FileEntityType::file, hasStat ? &st : nullptr);
+        // 不跟随目录的符号链接，避免死循环
+        if (recursive && isDirectory && dtype != DT_LNK) {
+            int fd = openat(dirfd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC | O_NOFOLLOW);
+            if (fd >= 0) {
+                PosixWalkDirectory(fd, relative, recursive, needStat, visitor);
+                close(fd);
             }
         }
-        ++ptr;
+        relative.resize(length);
+    };
+#if defined(__linux__)
+    alignas(8) char buffer[8192];
+    while (true) {
+        long bytes = syscall(SYS_getdents64, dirfd, buffer, sizeof(buffer));
+        if (bytes <= 0) {
+            break;
+        }
+        for (long pos = 0; pos < bytes;) {
+            auto entry = (linux_dirent64_t*)(buffer + pos);
+            visit(entry->d_name, entry->d_type);
+            pos += entry->d_reclen;
+        }
+    }
+#else
+    int fd = dup(dirfd);
+    DIR* dir = fd >= 0 ? fdopendir(fd) : nullptr;
+    if (!dir) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        return;
+    }
+    while (auto entry = readdir(dir)) {
+        visit(entry->d_name, entry->d_type);
+    }
+    closedir(dir);
+#endif
+}
+
+static void PosixWalk(const std::string& root, bool recursive, bool needStat, WalkVisitor const& visitor)
+{
+    int fd = open(root.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        return;
     }
-    if (curSec.length() > 0) {
-        if (!fpath.empty() && fpath.back() != '/')
-            fpath.push_back('/');
-        fpath.append(curSec);
+    std::string relative;
+    PosixWalkDirectory(fd, relative, recursive, needStat, visitor);
+    close(fd);
+}
+#endif
+
+static bool StatRegularFile(const char* path, FileIndexEntry& entry)
+{
+    struct stat st;
+    if (stat(path, &st) != 0 || (st.st_mode & S_IFMT) != S_IFREG) {
+        return false;
     }
-    return fpath;
+    entry.size = (uint64_t)st.st_size;
+    entry.mtime = (int64_t)st.st_mtime;
+    return true;
+}
+
+// 流对象开开关关很频繁，走带线程缓存的对象池；池子不析构，免得退出时还有流没关
+static ObjectPool<FileIStream>& FileIStreamPool() {
+    static ObjectPool<FileIStream>* pool = new ObjectPool<FileIStream>(0, true);
+    return *pool;
+}
+
+static ObjectPool<FileOStream>& FileOStreamPool() {
+    static ObjectPool<FileOStream>* pool = new ObjectPool<FileOStream>(0, true);
+    return *pool;
 }
 
 int64_t FileIStream::read(void* buffer, int64_t size)
@@ -61,11 +154,11 @@ int64_t FileIStream::seek(SeekOption option, int offset)
 {
     switch (option) {
     case SeekOption::begin:
-        return fseek(_file, SEEK_SET, offset);
+        return fseek(_file, offset, SEEK_SET);
     case SeekOption::current:
-        return fseek(_file, SEEK_CUR, offset);
+        return fseek(_file, offset, SEEK_CUR);
     case SeekOption::end:
-        return fseek(_file, SEEK_END, offset);
+        return fseek(_file, offset, SEEK_END);
     default:
         break;
     }
@@ -90,8 +183,7 @@ void FileIStream::close()
     }
     _size = 0;
     _file = nullptr;
-    this->~FileIStream();
-    comm_free(this);
+    FileIStreamPool().destroy(this);
 }
 
 int64_t FileOStream::write(const void* buffer, int64_t size)
@@ -128,13 +220,78 @@ void FileOStream::close()
         fclose(_file);
         _file = nullptr;
     }
-    this->~FileOStream();
-    comm_free(this);
+    FileOStreamPool().destroy(this);
+}
+
+bool FileSystemArchive::lookupIndex(uint64_t hash, FileIndexEntry& entry)
+{
+    SharedMutexLock lock(_indexMutex);
+    lock.lock_shared();
+    auto iter = _index.find(hash);
+    if (iter == _index.end()) {
+        return false;
+    }
+    entry = iter->second;
+    return true;
+}
+
+void FileSystemArchive::buildIndex()
+{
+    std::unordered_map<uint64_t, FileIndexEntry> index;
+#ifdef _WIN32
+    PathBuffer fullpath;
+    for (auto& entity : IArchive::listFilesRecursive("")) {
+        FileIndexEntry entry;
+        fullpath.join(_rootpath, entity.name, PathCasePolicy);
+        if (entity.type == FileEntityType::file && StatRegularFile(fullpath.c_str(), entry)) {
+            index.emplace(fullpath.hash(), entry);
+        }
+    }
+#else
+    // 遍历出来的相对路径本身就是规范的，直接求哈希
+    PosixWalk(_rootpath, true, true, [&index](std::string const& relative, FileEntityType type, struct stat const* st) {
+        if (type == FileEntityType::file) {
+            uint64_t hash = PathHash(relative.c_str(), relative.length(), PathCasePolicy);
+            index.emplace(hash, FileIndexEntry { (uint64_t)st->st_size, (int64_t)st->st_mtime });
+        }
+    });
+#endif
+    SharedMutexLock lock(_indexMutex);
+    lock.lock();
+    _index.swap(index);
+    _indexed = true;
+}
+
+void FileSystemArchive::dropIndex()
+{
+    SharedMutexLock lock(_indexMutex);
+    lock.lock();
+    _index.clear();
+    _indexed = false;
+}
+
+bool FileSystemArchive::queryFile(const std::string& path, FileIndexEntry& entry)
+{
+    PathBuffer fullpath;
+    fullpath.join(_rootpath, path, PathCasePolicy);
+    if (_indexed) {
+        return lookupIndex(fullpath.hash(), entry);
+    }
+    return StatRegularFile(fullpath.c_str(), entry);
 }
 
 IStream* FileSystemArchive::openIStream(const std::string& path, BitFlags<ReadFlag> flags)
 {
-    std::string fullpath = _rootpath + "/" + path;
+    LWC_PROFILE_ZONE("FileSystemArchive::openIStream");
+    // 拼接和规范化都在栈上完成，顺便得到索引用的哈希
+    PathBuffer fullpath;
+    fullpath.join(_rootpath, path, PathCasePolicy);
+    if (_indexed) {
+        FileIndexEntry entry;
+        if (!lookupIndex(fullpath.hash(), entry)) {
+            return nullptr; // 索引里没有就不用 fopen 了
+        }
+    }
     char const* openFlag = nullptr; 
     if( flags.test(ReadFlag::binary)) {
         openFlag = "rb";
@@ -148,15 +305,21 @@ IStream* FileSystemArchive::openIStream(const std::string& path, BitFlags<ReadFl
         fseek( file, 0, SEEK_END);
         int64_t fileSize = ftell(file);
         fseek( file, 0, SEEK_SET);
-        void *ptr = comm_alloc(sizeof(FileIStream));
-        FileIStream* istream = new (ptr) FileIStream(file, fileSize);
-        return istream;
+        return FileIStreamPool().create(file, fileSize);
     }
 }
 
 OStream* FileSystemArchive::openOStream(const std::string& path, BitFlags<WriteFlag> flags)
 {
-    std::string fullpath = _rootpath + "/" + path;
+    PathBuffer fullpath;
+    fullpath.join(_rootpath, path, PathCasePolicy);
+    if(flags.test(WriteFlag::buffered) || flags.test(WriteFlag::atomic)) {
+        OStream* stream = CreateBufferedOStream(std::string(fullpath.view()), flags);
+        if(stream) {
+            registerIndex(fullpath.hash());
+        }
+        return stream;
+    }
     std::string openFlag = "w";
     if(flags.test(WriteFlag::binary)){
         openFlag.push_back('b');
@@ -164,7 +327,6 @@ OStream* FileSystemArchive::openOStream(const std::string& path, BitFlags<WriteF
     if(flags.test(WriteFlag::append)){
         openFlag.push_back('a');
     }
-    // fullpath = FormatFilePath(fullpath);
     auto file = fopen(fullpath.c_str(), openFlag.c_str() );
     if(!file) {
         return nullptr;
@@ -172,20 +334,27 @@ OStream* FileSystemArchive::openOStream(const std::string& path, BitFlags<WriteF
         fseek( file, 0, SEEK_END);
         int64_t fileSize = ftell(file);
         fseek( file, 0, SEEK_SET);
-        void *ptr = comm_alloc(sizeof(FileOStream));
-        FileOStream* ostream = new (ptr) FileOStream(file, fileSize);
+        FileOStream* ostream = FileOStreamPool().create(file, fileSize);
+        registerIndex(fullpath.hash());
         return ostream;
     }
     return nullptr;
 }
 
-bool FileSystemArchive::testExist(const std::string& path) {
-    auto rst = this->openIStream(path, (uint32_t)ReadFlag::binary);
-    if(rst) {
-        rst->close();
-        return true;
+void FileSystemArchive::registerIndex(uint64_t hash)
+{
+    if (!_indexed) {
+        return;
     }
-    return false;
+    // 新写的文件先登记进索引，大小和时间以下次刷新为准
+    SharedMutexLock lock(_indexMutex);
+    lock.lock();
+    _index.emplace(hash, FileIndexEntry { 0, (int64_t)time(nullptr) });
+}
+
+bool FileSystemArchive::testExist(const std::string& path) {
+    FileIndexEntry entry;
+    return queryFile(path, entry);
 }
 
 bool FileSystemArchive::supportListFeature() const {
@@ -194,7 +363,7 @@ bool FileSystemArchive::supportListFeature() const {
 
 std::vector<IArchive::FileEntity> FileSystemArchive::listFiles(const std::string& path) {
     /**
-     * @brief  win32 实现
+     * @brief  win32 用 FindFirstFile，posix 用 openat + getdents
      * 
      */
     std::vector<IArchive::FileEntity> rst;
@@ -209,10 +378,26 @@ std::vector<IArchive::FileEntity> FileSystemArchive::listFiles(const std::string
             rst.emplace_back(data.cFileName, IArchive::FileEntityType::directory);
         }
     }
+    #else
+    PosixWalk(_rootpath + "/" + path, false, false, [&rst](std::string const& relative, FileEntityType type, struct stat const*) {
+        rst.emplace_back(std::string(relative), type);
+    });
     #endif
     return rst;
 }
 
+std::vector<IArchive::FileEntity> FileSystemArchive::listFilesRecursive(const std::string& path) {
+#ifdef _WIN32
+    return IArchive::listFilesRecursive(path);
+#else
+    std::vector<IArchive::FileEntity> rst;
+    PosixWalk(_rootpath + "/" + path, true, false, [&rst](std::string const& relative, FileEntityType type, struct stat const*) {
+        rst.emplace_back(std::string(relative), type);
+    });
+    return rst;
+#endif
+}
+
 std::string FileSystemArchive::rootPath() {
     return _rootpath;
 }
@@ -221,14 +406,119 @@ bool FileSystemArchive::readonly() const {
     return false;
 }
 
+void FileSystemArchive::applyChanges(std::vector<FileChangeEvent> const& events)
+{
+    if (_indexed) {
+        // 先在锁外 stat，再一次性改索引
+        std::vector<std::pair<uint64_t, FileIndexEntry>> updates;
+        std::vector<uint64_t> removals;
+        bool rescan = false;
+        PathBuffer fullpath;
+        for (auto& event : events) {
+            if (event.kind == FileChangeKind::rescan) {
+                rescan = true;
+                break;
+            }
+            fullpath.join(_rootpath, event.path, PathCasePolicy);
+            FileIndexEntry entry;
+            if (event.kind != FileChangeKind::removed && StatRegularFile(fullpath.c_str(), entry)) {
+                updates.emplace_back(fullpath.hash(), entry);
+            } else {
+                removals.push_back(fullpath.hash());
+            }
+        }
+        if (rescan) {
+            buildIndex();
+        } else {
+            SharedMutexLock lock(_indexMutex);
+            lock.lock();
+            for (auto hash : removals) {
+                _index.erase(hash);
+            }
+            for (auto& update : updates) {
+                _index[update.first] = update.second;
+            }
+        }
+    }
+#if defined(__linux__)
+    if (_watchCallback) {
+        _watchCallback(events);
+    }
+#endif
+    std::lock_guard<std::mutex> lock(_subscriberMutex);
+    for (auto& subscriber : _subscribers) {
+        subscriber.second(events);
+    }
+}
+
+uint32_t FileSystemArchive::subscribeChanges(FileChangeCallback callback)
+{
+    std::lock_guard<std::mutex> lock(_subscriberMutex);
+    uint32_t subscription = ++_subscriberCounter;
+    _subscribers.emplace_back(subscription, std::move(callback));
+    return subscription;
+}
+
+void FileSystemArchive::unsubscribeChanges(uint32_t subscription)
+{
+    std::lock_guard<std::mutex> lock(_subscriberMutex);
+    auto iter = std::find_if(_subscribers.begin(), _subscribers.end(), [subscription](auto const& subscriber) {
+        return subscriber.first == subscription;
+    });
+    if (iter != _subscribers.end()) {
+        _subscribers.erase(iter);
+    }
+}
+
+#if defined(__linux__)
+bool FileSystemArchive::watch(FileChangeCallback callback, FileWatcher::Options const& options)
+{
+    unwatch();
+    _watchCallback = std::move(callback);
+    _watcher = CreateFileWatcher(_rootpath, options);
+    if (!_watcher->start([this](std::vector<FileChangeEvent> const& events) { applyChanges(events); })) {
+        _watcher->destroy();
+        _watcher = nullptr;
+        _watchCallback = nullptr;
+        return false;
+    }
+    return true;
+}
+
+bool FileSystemArchive::watch(FileChangeCallback callback)
+{
+    return watch(std::move(callback), FileWatcher::Options());
+}
+
+void FileSystemArchive::unwatch()
+{
+    if (_watcher) {
+        _watcher->destroy();
+        _watcher = nullptr;
+    }
+    _watchCallback = nullptr;
+}
+#endif
+
+FileSystemArchive::~FileSystemArchive()
+{
+#if defined(__linux__)
+    unwatch();
+#endif
+}
+
 void FileSystemArchive::destroy() {
     this->~FileSystemArchive();
     comm_free(this);
 }
 
-IArchive* CreateFSArchive(const std::string& rootPath) {
+IArchive* CreateFSArchive(const std::string& rootPath, bool buildIndex) {
     auto memptr = comm_alloc(sizeof(FileSystemArchive));
-    return new (memptr) FileSystemArchive(rootPath);
+    auto archive = new (memptr) FileSystemArchive(rootPath);
+    if(buildIndex) {
+        archive->buildIndex();
+    }
+    return archive;
 }
 
 }
\ No newline at end of file
@@ -1,4 +1,10 @@
 #include "archive.h"
+#include "path.h"
+#include "file_watcher.h"
+#include <unordered_map>
+#include <atomic>
+#include <mutex>
+#include <threading/shared_mutex.hpp>
 
 namespace comm {
 
@@ -46,22 +52,92 @@ namespace comm {
         virtual ~FileOStream(){}
     };
 
+    /**
+     * @brief 路径索引里记录的文件信息
+     */
+    struct FileIndexEntry {
+        uint64_t    size;
+        int64_t     mtime;      // 秒
+    };
+
     class FileSystemArchive : public IArchive {
+    public:
+    #ifdef _WIN32
+        constexpr static PathCase PathCasePolicy = PathCase::insensitive;
+    #else
+        constexpr static PathCase PathCasePolicy = PathCase::sensitive;
+    #endif
+    private:
+        std::string                                         _rootpath;
+        /**
+         * @brief 可选的路径索引（规范化的相对路径的 64 位哈希 -> 文件信息，见 io/path.h）
+         *  建立之后 testExist 和打开不存在的文件都只查表，不再走系统调用
+         */
+        std::unordered_map<uint64_t, FileIndexEntry>        _index;
+        std::atomic<bool>                                   _indexed;
+        SharedMutex                                         _indexMutex;
+    #if defined(__linux__)
+        FileWatcher*                                        _watcher;
+        FileChangeCallback                                  _watchCallback;
+    #endif
+        std::mutex                                          _subscriberMutex;   // 分发事件时也拿着，保证取消订阅之后不再回调
+        std::vector<std::pair<uint32_t, FileChangeCallback>> _subscribers;
+        uint32_t                                            _subscriberCounter;
     private:
-        std::string _rootpath;
+        bool lookupIndex(uint64_t hash, FileIndexEntry& entry);
+        void registerIndex(uint64_t hash);
+        // 监视线程上调用，先让索引跟上变化再通知外面
+        void applyChanges(std::vector<FileChangeEvent> const& events);
     public:
         FileSystemArchive(const std::string root)
             : _rootpath(root)
+            , _index()
+            , _indexed(false)
+            , _indexMutex()
+        #if defined(__linux__)
+            , _watcher(nullptr)
+            , _watchCallback()
+        #endif
+            , _subscriberMutex()
+            , _subscribers()
+            , _subscriberCounter(0)
         {}
+        // 遍历根目录建立索引，已经有索引的话相当于刷新
+        void buildIndex();
+        void refreshIndex() {
+            buildIndex();
+        }
+        void dropIndex();
+        bool indexed() const {
+            return _indexed;
+        }
+        // 没有索引时会直接 stat
+        bool queryFile( const std::string& path, FileIndexEntry& entry );
+    #if defined(__linux__)
+        /**
+         * @brief 监视根目录下的文件变化，用来代替轮询 mtime 做热加载（只有 linux 上有，见 FileWatcher）
+         *  有索引的话索引会自动更新，之后在监视线程上回调 callback（可以为空），再通知 subscribeChanges 的订阅者：
+         *  包着它的 CachingArchive 会让变了的条目失效，挂着它的 VirtualFileSystem 会更新合并索引
+         */
+        bool watch( FileChangeCallback callback, FileWatcher::Options const& options );
+        bool watch( FileChangeCallback callback );
+        void unwatch();
+        bool watching() const {
+            return _watcher != nullptr;
+        }
+    #endif
+        virtual uint32_t subscribeChanges( FileChangeCallback callback) override;
+        virtual void unsubscribeChanges( uint32_t subscription) override;
         virtual IStream* openIStream( const std::string& path, BitFlags<ReadFlag> flags) override;
         virtual OStream* openOStream( const std::string& path, BitFlags<WriteFlag> flags) override;
         virtual bool testExist( const std::string& path ) override;
         virtual bool supportListFeature() const override;
         virtual std::vector<FileEntity> listFiles( const std::string& path ) override;
+        virtual std::vector<FileEntity> listFilesRecursive( const std::string& path ) override;
         virtual std::string rootPath() override;
         virtual bool readonly() const override;
         virtual void destroy() override;
-        virtual ~FileSystemArchive() override {}
+        virtual ~FileSystemArchive() override;
     };
 
 }
\ No newline at end of file
@@ -0,0 +1,163 @@
+#include "lz_block.h"
+#include <cstring>
+
+namespace comm {
+
+    constexpr uint32_t LZMinMatch = 4;
+    constexpr uint32_t LZHashBits = 12;
+    constexpr uint32_t LZMaxOffset = 65535;
+
+    inline uint32_t LZRead32(const uint8_t* ptr) {
+        uint32_t val;
+        memcpy(&val, ptr, sizeof(val));
+        return val;
+    }
+
+    inline uint32_t LZHash(uint32_t seq) {
+        return (seq * 2654435761u) >> (32 - LZHashBits);
+    }
+
+    // 写扩展长度（每个字节 255 表示还有后续）
+    inline bool LZWriteLength(uint8_t*& op, const uint8_t* oend, size_t length) {
+        while(length >= 255) {
+            if(op >= oend) {
+                return false;
+            }
+            *op++ = 255;
+            length -= 255;
+        }
+        if(op >= oend) {
+            return false;
+        }
+        *op++ = (uint8_t)length;
+        return true;
+    }
+
+    inline bool LZWriteSequence(uint8_t*& op, const uint8_t* oend, const uint8_t* literal, size_t literalLength, size_t offset, size_t matchLength) {
+        if(op >= oend) {
+            return false;
+        }
+        uint8_t* token = op++;
+        size_t matchCode = matchLength ? matchLength - LZMinMatch : 0;
+        *token = (uint8_t)(((literalLength < 15 ? literalLength : 15) << 4) | (matchCode < 15 ? matchCode : 15));
+        if(literalLength >= 15 && !LZWriteLength(op, oend, literalLength - 15)) {
+            return false;
+        }
+        if((size_t)(oend - op) < literalLength) {
+            return false;
+        }
+        memcpy(op, literal, literalLength);
+        op += literalLength;
+        if(!matchLength) { // 最后一段只有字面量
+            return true;
+        }
+        if(oend - op < 2) {
+            return false;
+        }
+        *op++ = (uint8_t)(offset & 0xff);
+        *op++ = (uint8_t)(offset >> 8);
+        if(matchCode >= 15 && !LZWriteLength(op, oend, matchCode - 15)) {
+            return false;
+        }
+        return true;
+    }
+
+    int64_t LZBlockCompress(const void* src, size_t srcSize, void* dst, size_t dstCapacity) {
+        const uint8_t* base = (const uint8_t*)src;
+        const uint8_t* ip = base;
+        const uint8_t* anchor = base;
+        const uint8_t* iend = base + srcSize;
+        uint8_t* op = (uint8_t*)dst;
+        const uint8_t* oend = op + dstCapacity;
+        uint32_t table[1 << LZHashBits] = {}; // 位置 + 1，0 表示空
+        if(srcSize > LZMinMatch) {
+            const uint8_t* ilimit = iend - LZMinMatch;
+            while(ip <= ilimit) {
+                uint32_t seq = LZRead32(ip);
+                uint32_t hash = LZHash(seq);
+                uint32_t candidate = table[hash];
+                table[hash] = (uint32_t)(ip - base) + 1;
+                if(candidate) {
+                    const uint8_t* ref = base + candidate - 1;
+                    if((size_t)(ip - ref) <= LZMaxOffset && LZRead32(ref) == seq) {
+                        size_t matchLength = LZMinMatch;
+                        while(ip + matchLength < iend && ref[matchLength] == ip[matchLength]) {
+                            ++matchLength;
+                        }
+                        if(!LZWriteSequence(op, oend, anchor, (size_t)(ip - anchor), (size_t)(ip - ref), matchLength)) {
+                            return -1;
+                        }
+                        ip += matchLength;
+                        anchor = ip;
+                        continue;
+                    }
+                }
+                ++ip;
+            }
+        }
+        if(!LZWriteSequence(op, oend, anchor, (size_t)(iend - anchor), 0, 0)) {
+            return -1;
+        }
+        return (int64_t)(op - (uint8_t*)dst);
+    }
+
+    inline bool LZReadLength(const uint8_t*& ip, const uint8_t* iend, size_t& length) {
+        uint8_t val;
+        do {
+            if(ip >= iend) {
+                return false;
+            }
+            val = *ip++;
+            length += val;
+        } while(val == 255);
+        return true;
+    }
+
+    bool LZBlockDecompress(const void* src, size_t srcSize, void* dst, size_t dstSize) {
+        const uint8_t* ip = (const uint8_t*)src;
+        const uint8_t* iend = ip + srcSize;
+        uint8_t* op = (uint8_t*)dst;
+        uint8_t* obase = op;
+        uint8_t* oend = op + dstSize;
+        while(ip < iend) {
+            uint8_t token = *ip++;
+            size_t literalLength = token >> 4;
+            if(literalLength == 15 && !LZReadLength(ip, iend, literalLength)) {
+                return false;
+            }
+            if((size_t)(iend - ip) < literalLength || (size_t)(oend - op) < literalLength) {
+                return false;
+            }
+            memcpy(op, ip, literalLength);
+            ip += literalLength;
+            op += literalLength;
+            if(ip == iend) { // 最后一段
+                break;
+            }
+            if(iend - ip < 2) {
+                return false;
+            }
+            size_t offset = (size_t)ip[0] | ((size_t)ip[1] << 8);
+            ip += 2;
+            size_t matchLength = token & 0xf;
+            if(matchLength == 15 && !LZReadLength(ip, iend, matchLength)) {
+                return false;
+            }
+            matchLength += LZMinMatch;
+            if(!offset || (size_t)(op - obase) < offset || (size_t)(oend - op) < matchLength) {
+                return false;
+            }
+            const uint8_t* ref = op - offset;
+            if(offset >= matchLength) {
+                memcpy(op, ref, matchLength);
+                op += matchLength;
+            } else { // 重叠的匹配只能逐字节复制
+                for(size_t i = 0; i < matchLength; ++i) {
+                    *op++ = *ref++;
+                }
+            }
+        }
+        return op == oend;
+    }
+
+}
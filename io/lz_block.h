@@ -0,0 +1,24 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+namespace comm {
+
+    /**
+     * @brief 简单的 LZ77 块压缩（格式和 LZ4 block 类似）
+     *  token(高4位字面量长度，低4位匹配长度-4) + 扩展长度 + 字面量 + 2字节偏移 + 扩展长度
+     *  压缩比一般，但解压非常快，资源包用它做逐条目压缩
+     */
+
+    // 最坏情况下压缩结果的大小
+    inline size_t LZBlockBound(size_t size) {
+        return size + size / 255 + 16;
+    }
+
+    // 返回压缩后的大小，dst 放不下返回 -1
+    int64_t LZBlockCompress(const void* src, size_t srcSize, void* dst, size_t dstCapacity);
+
+    // dstSize 必须是原始大小，数据损坏或者大小不符返回 false
+    bool LZBlockDecompress(const void* src, size_t srcSize, void* dst, size_t dstSize);
+
+}
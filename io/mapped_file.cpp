@@ -0,0 +1,93 @@
+#include "mapped_file.h"
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace comm {
+
+    MappedFile::MappedFile()
+        : _data(nullptr)
+        , _size(0)
+    #ifdef _WIN32
+        , _file(nullptr)
+        , _mapping(nullptr)
+    #endif
+    {}
+
+#ifdef _WIN32
+    bool MappedFile::open(const std::string& path) {
+        close();
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if(file == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+        LARGE_INTEGER fileSize;
+        if(!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+            CloseHandle(file);
+            return false;
+        }
+        HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if(!mapping) {
+            CloseHandle(file);
+            return false;
+        }
+        void* ptr = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if(!ptr) {
+            CloseHandle(mapping);
+            CloseHandle(file);
+            return false;
+        }
+        _file = file;
+        _mapping = mapping;
+        _data = (const uint8_t*)ptr;
+        _size = (uint64_t)fileSize.QuadPart;
+        return true;
+    }
+
+    void MappedFile::close() {
+        if(_data) {
+            UnmapViewOfFile(_data);
+            CloseHandle((HANDLE)_mapping);
+            CloseHandle((HANDLE)_file);
+        }
+        _data = nullptr;
+        _size = 0;
+        _file = _mapping = nullptr;
+    }
+#else
+    bool MappedFile::open(const std::string& path) {
+        close();
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if(fd < 0) {
+            return false;
+        }
+        struct stat st;
+        if(fstat(fd, &st) != 0 || st.st_size == 0) {
+            ::close(fd);
+            return false;
+        }
+        void* ptr = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd); // 映射建立之后 fd 就不需要了
+        if(ptr == MAP_FAILED) {
+            return false;
+        }
+        _data = (const uint8_t*)ptr;
+        _size = (uint64_t)st.st_size;
+        return true;
+    }
+
+    void MappedFile::close() {
+        if(_data) {
+            munmap((void*)_data, (size_t)_size);
+        }
+        _data = nullptr;
+        _size = 0;
+    }
+#endif
+
+}
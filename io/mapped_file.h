@@ -0,0 +1,30 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+namespace comm {
+
+    /**
+     * @brief 只读的文件内存映射
+     */
+    class MappedFile {
+    private:
+        const uint8_t*  _data;
+        uint64_t        _size;
+    #ifdef _WIN32
+        void*           _file;
+        void*           _mapping;
+    #endif
+    public:
+        MappedFile();
+        MappedFile(MappedFile const&) = delete;
+        MappedFile& operator = (MappedFile const&) = delete;
+        bool open(const std::string& path);
+        void close();
+        const uint8_t* data() const { return _data; }
+        uint64_t size() const { return _size; }
+        bool valid() const { return !!_data; }
+        ~MappedFile() { close(); }
+    };
+
+}
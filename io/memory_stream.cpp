@@ -0,0 +1,66 @@
+#include "memory_stream.h"
+#include "../memory/memory.h"
+#include <cstring>
+
+namespace comm {
+
+    int64_t MemoryIStream::read(void* buffer, int64_t size) {
+        int64_t avail = _size - _position;
+        if(size > avail) {
+            size = avail;
+        }
+        if(size <= 0) {
+            return 0;
+        }
+        memcpy(buffer, _data + _position, (size_t)size);
+        _position += size;
+        return size;
+    }
+
+    int64_t MemoryIStream::seek(SeekOption option, int offset) {
+        int64_t position = 0;
+        switch (option) {
+        case SeekOption::begin:
+            position = offset; break;
+        case SeekOption::current:
+            position = _position + offset; break;
+        case SeekOption::end:
+            position = _size + offset; break;
+        default:
+            break;
+        }
+        if(position < 0 || position > _size) {
+            return -1;
+        }
+        _position = position;
+        return 0;
+    }
+
+    int64_t MemoryIStream::tell() const {
+        return _position;
+    }
+
+    int64_t MemoryIStream::size() const {
+        return _size;
+    }
+
+    bool MemoryIStream::seekable() const {
+        return true;
+    }
+
+    void MemoryIStream::close() {
+        this->~MemoryIStream();
+        comm_free(this);
+    }
+
+    IStream* CreateMemoryIStream(const void* data, int64_t size) {
+        void* ptr = comm_alloc(sizeof(MemoryIStream));
+        return new (ptr) MemoryIStream(data, size);
+    }
+
+    IStream* CreateMemoryIStream(IOBuffer&& buffer) {
+        void* ptr = comm_alloc(sizeof(MemoryIStream));
+        return new (ptr) MemoryIStream(std::move(buffer));
+    }
+
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include "archive.h"
+
+namespace comm {
+
+    /**
+     * @brief 内存上的只读流
+     *  可以是对外部内存的视图（比如 mmap 的资源包），也可以持有一块 comm_alloc 分配的内存，close 时一起回收
+     */
+    class MemoryIStream : public IStream {
+    private:
+        const uint8_t*  _data;
+        int64_t         _size;
+        int64_t         _position;
+        IOBuffer        _owned;
+    public:
+        MemoryIStream(const void* data, int64_t size)
+            : _data((const uint8_t*)data)
+            , _size(size)
+            , _position(0)
+            , _owned()
+        {}
+        MemoryIStream(IOBuffer&& buffer)
+            : _data(buffer.data())
+            , _size(buffer.size())
+            , _position(0)
+            , _owned(std::move(buffer))
+        {}
+        const uint8_t* data() const { return _data; }
+        virtual int64_t read( void* buffer, int64_t size ) override;
+        virtual int64_t seek( SeekOption option, int offset ) override;
+        virtual int64_t tell() const override;
+        virtual int64_t size() const override;
+        virtual bool seekable() const override;
+        virtual void close() override;
+        virtual ~MemoryIStream() override {}
+    };
+
+    IStream* CreateMemoryIStream(const void* data, int64_t size);
+    IStream* CreateMemoryIStream(IOBuffer&& buffer);
+
+}
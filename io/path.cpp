@@ -0,0 +1,161 @@
+#include "path.h"
+#include "../memory/memory.h"
+#include <cstring>
+
+namespace comm {
+
+    constexpr uint32_t PathMaxTrackedDepth = 64;
+
+    inline bool IsPathSeparator(char c) {
+        return c == '/' || c == '\\';
+    }
+
+    static size_t NormalizePathImpl(const char* path, size_t length, char* out, size_t capacity, uint64_t* hashOut, PathCase pathCase, bool relative) {
+        /**
+         * @brief 每个已输出的段记录它的起始位置（含前面的 '/'）和输出它之前的哈希，
+         *  遇到 ".." 直接回退到记录的位置和哈希，所以哈希可以和规范化在同一遍里完成
+         */
+        struct segment_t {
+            size_t      start;
+            uint64_t    hash;
+            bool        pinned;     // ".." 或者盘符，不能被回退
+            bool        drive;
+        };
+        segment_t segments[PathMaxTrackedDepth];
+        uint32_t depth = 0;         // 已输出的段数
+        bool untracked = false;     // 段数超过了记录的上限，最后要重新算哈希
+        size_t n = 0;
+        uint64_t hash = PathHashSeed;
+        bool absolute = length && IsPathSeparator(path[0]);
+        if(absolute && !relative) {
+            if(!capacity) {
+                return PathInvalid;
+            }
+            out[n++] = '/';
+            hash = PathHashStep(hash, '/', pathCase);
+        }
+        size_t rootLength = n;
+        size_t i = 0;
+        while(i < length) {
+            while(i < length && IsPathSeparator(path[i])) {
+                ++i;
+            }
+            size_t segmentBegin = i;
+            while(i < length && !IsPathSeparator(path[i])) {
+                ++i;
+            }
+            size_t segmentLength = i - segmentBegin;
+            const char* segment = path + segmentBegin;
+            if(!segmentLength || (segmentLength == 1 && segment[0] == '.')) {
+                continue;
+            }
+            bool dotdot = segmentLength == 2 && segment[0] == '.' && segment[1] == '.';
+            if(dotdot) {
+                if(depth && (untracked || depth > PathMaxTrackedDepth || !segments[depth-1].pinned)) {
+                    if(depth <= PathMaxTrackedDepth && !untracked) {
+                        n = segments[depth-1].start;
+                        hash = segments[depth-1].hash;
+                    } else {
+                        // 超出记录的深度，往回找上一个 '/'
+                        while(n > rootLength && out[n-1] != '/') {
+                            --n;
+                        }
+                        if(n > rootLength) {
+                            --n;
+                        }
+                        untracked = true;
+                    }
+                    --depth;
+                    continue;
+                }
+                if(absolute || (depth == 1 && segments[0].drive)) {
+                    continue; // 不能越过根
+                }
+            }
+            size_t start = n;
+            uint64_t hashBefore = hash;
+            if(n > rootLength) {
+                if(n >= capacity) {
+                    return PathInvalid;
+                }
+                out[n++] = '/';
+                hash = PathHashStep(hash, '/', pathCase);
+            }
+            if(capacity - n < segmentLength) {
+                return PathInvalid;
+            }
+            // 原地规范化时 n <= segmentBegin，从前往后拷贝是安全的
+            for(size_t k = 0; k < segmentLength; ++k) {
+                char c = segment[k];
+                out[n++] = c;
+                hash = PathHashStep(hash, c, pathCase);
+            }
+            if(depth < PathMaxTrackedDepth) {
+                bool drive = depth == 0 && segment[segmentLength-1] == ':';
+                segments[depth] = { start, hashBefore, dotdot || drive, drive };
+            } else if(dotdot) {
+                untracked = true;
+            }
+            ++depth;
+        }
+        if(hashOut) {
+            *hashOut = untracked ? PathHash(out, n, pathCase) : hash;
+        }
+        return n;
+    }
+
+    size_t NormalizePath(const char* path, size_t length, char* out, size_t capacity, uint64_t* hash, PathCase pathCase) {
+        return NormalizePathImpl(path, length, out, capacity, hash, pathCase, false);
+    }
+
+    size_t NormalizeRelativePath(const char* path, size_t length, char* out, size_t capacity, uint64_t* hash, PathCase pathCase) {
+        return NormalizePathImpl(path, length, out, capacity, hash, pathCase, true);
+    }
+
+    std::string NormalizePath(std::string_view path) {
+        std::string rst(path);
+        rst.resize(NormalizePath(rst.data(), rst.length(), rst.data(), rst.length()));
+        return rst;
+    }
+
+    void PathBuffer::reserve(size_t capacity) {
+        if(capacity <= _capacity) {
+            return;
+        }
+        char* data = (char*)comm_alloc(capacity);
+        memcpy(data, _data, _length + 1);
+        if(_data != _inline) {
+            comm_free(_data);
+        }
+        _data = data;
+        _capacity = capacity;
+    }
+
+    void PathBuffer::assignRelative(std::string_view path, PathCase pathCase) {
+        join(std::string_view(), path, pathCase);
+    }
+
+    void PathBuffer::join(std::string_view root, std::string_view path, PathCase pathCase) {
+        _length = 0;
+        _data[0] = 0;
+        // 规范化的结果不会比输入长，root + '/' + path + '\0' 一定放得下
+        reserve(root.length() + path.length() + 2);
+        if(!root.empty()) {
+            memcpy(_data, root.data(), root.length());
+            _length = root.length();
+            if(!IsPathSeparator(root.back())) {
+                _data[_length++] = '/';
+            }
+        }
+        size_t n = NormalizeRelativePath(path.data(), path.length(), _data + _length, _capacity - _length - 1, &_hash, pathCase);
+        _length += n;
+        _data[_length] = 0;
+    }
+
+    PathBuffer::~PathBuffer() {
+        if(_data != _inline) {
+            comm_free(_data);
+        }
+    }
+
+}
@@ -0,0 +1,101 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+namespace comm {
+
+    /**
+     * @brief 路径规范化 & 路径哈希
+     *  - '/' 和 '\\' 同等对待，输出统一用 '/'
+     *  - 合并重复的分隔符，去掉 "."，".." 回退上一级（不会越过根，相对路径开头的 ".." 保留）
+     *  - 去掉末尾的分隔符
+     *  - 规范化的同时计算结果的 64 位哈希（FNV-1a），insensitive 时哈希忽略 ASCII 大小写，输出保持原样
+     *  输出长度不会超过输入，所以可以原地规范化（out == path），整个过程不分配内存。
+     */
+
+    enum class PathCase : uint8_t {
+        sensitive,
+        insensitive,
+    };
+
+    constexpr size_t PathInvalid = ~(size_t)0;
+    constexpr uint64_t PathHashSeed = 0xcbf29ce484222325ULL;
+    constexpr uint64_t PathHashPrime = 0x100000001b3ULL;
+
+    inline uint64_t PathHashStep(uint64_t hash, char c, PathCase pathCase) {
+        if(pathCase == PathCase::insensitive && c >= 'A' && c <= 'Z') {
+            c = (char)(c - 'A' + 'a');
+        }
+        hash ^= (uint8_t)c;
+        hash *= PathHashPrime;
+        return hash;
+    }
+
+    // 对已经规范化过的路径求哈希
+    inline uint64_t PathHash(const char* path, size_t length, PathCase pathCase = PathCase::sensitive) {
+        uint64_t hash = PathHashSeed;
+        for(size_t i = 0; i < length; ++i) {
+            hash = PathHashStep(hash, path[i], pathCase);
+        }
+        return hash;
+    }
+
+    /**
+     * @brief 规范化 path 写入 out，返回长度（不写结尾的 0），capacity 不够返回 PathInvalid
+     *  hash 不为空时输出规范化结果的哈希
+     */
+    size_t NormalizePath(const char* path, size_t length, char* out, size_t capacity, uint64_t* hash = nullptr, PathCase pathCase = PathCase::sensitive);
+
+    /**
+     * @brief 同 NormalizePath，但是去掉开头的 '/'，用于 archive 内的相对路径（"/a/b" 和 "a/b" 是同一个文件）
+     */
+    size_t NormalizeRelativePath(const char* path, size_t length, char* out, size_t capacity, uint64_t* hash = nullptr, PathCase pathCase = PathCase::sensitive);
+
+    std::string NormalizePath(std::string_view path);
+
+    /**
+     * @brief 栈上的路径缓冲区，一般的路径都放得下，超长的路径才会退回 comm_alloc
+     */
+    class PathBuffer {
+    public:
+        constexpr static size_t InlineCapacity = 512;
+    private:
+        char        _inline[InlineCapacity];
+        char*       _data;
+        size_t      _capacity;
+        size_t      _length;
+        uint64_t    _hash;
+    private:
+        void reserve(size_t capacity);
+    public:
+        PathBuffer()
+            : _data(_inline)
+            , _capacity(InlineCapacity)
+            , _length(0)
+            , _hash(PathHashSeed)
+        {
+            _inline[0] = 0;
+        }
+        PathBuffer(PathBuffer const&) = delete;
+        PathBuffer& operator = (PathBuffer const&) = delete;
+        // 规范化成 archive 内的相对路径
+        void assignRelative(std::string_view path, PathCase pathCase = PathCase::sensitive);
+        // root 原样拷贝，path 规范化成相对路径拼在后面，hash 只包含 path 部分（和 assignRelative 的一致）
+        void join(std::string_view root, std::string_view path, PathCase pathCase = PathCase::sensitive);
+        const char* c_str() const { return _data; }
+        size_t length() const { return _length; }
+        uint64_t hash() const { return _hash; }
+        std::string_view view() const { return std::string_view(_data, _length); }
+        ~PathBuffer();
+    };
+
+    // 相对路径规范化之后的哈希
+    inline uint64_t RelativePathHash(std::string_view path, PathCase pathCase = PathCase::sensitive) {
+        PathBuffer buffer;
+        buffer.assignRelative(path, pathCase);
+        return buffer.hash();
+    }
+
+}
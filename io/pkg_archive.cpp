@@ -0,0 +1,223 @@
+#include "pkg_archive.h"
+#include "memory_stream.h"
+#include "lz_block.h"
+#include "chunked_stream.h"
+#include "path.h"
+#include "../memory/memory.h"
+#include <unordered_set>
+#include <string_view>
+
+namespace comm {
+
+    namespace {
+        // 一个字节的 LZ 输入最多展开出 255 字节（扩展长度每字节 255），原始大小超过这个的条目肯定是坏的
+        constexpr uint64_t LZMaxExpansion = 255;
+
+        bool CheckEntrySize(pkg_entry_t const& entry) {
+            switch ((PkgCompression)entry.compression) {
+            case PkgCompression::none:
+                return entry.size == entry.storedSize;
+            case PkgCompression::lzblock:
+                return entry.size <= entry.storedSize * LZMaxExpansion && entry.size <= (uint64_t)INT64_MAX;
+            default:
+                return true;
+            }
+        }
+    }
+
+    bool PkgArchive::open() {
+        if(!_file.open(_path)) {
+            return false;
+        }
+        const uint8_t* base = _file.data();
+        uint64_t fileSize = _file.size();
+        if(fileSize < sizeof(pkg_header_t)) {
+            _file.close();
+            return false;
+        }
+        auto header = (const pkg_header_t*)base;
+        uint64_t tocSize = (uint64_t)header->entryCount * sizeof(pkg_entry_t)
+            + (uint64_t)header->bucketCount * sizeof(uint32_t)
+            + header->nameTableSize;
+        if( header->magic != PkgMagic || header->version != PkgVersion
+            || (header->bucketCount & (header->bucketCount - 1)) || header->bucketCount < header->entryCount
+            || header->tocOffset % alignof(pkg_entry_t) || header->tocOffset > fileSize || tocSize > fileSize - header->tocOffset
+        ) {
+            _file.close();
+            return false;
+        }
+        _header = header;
+        _entries = (const pkg_entry_t*)(base + header->tocOffset);
+        _buckets = (const uint32_t*)(_entries + header->entryCount);
+        _names = (const char*)(_buckets + header->bucketCount);
+        for(uint32_t i = 0; i < header->entryCount; ++i) {
+            auto const& entry = _entries[i];
+            if( entry.offset > header->tocOffset || entry.storedSize > header->tocOffset - entry.offset
+                || (uint64_t)entry.nameOffset + entry.nameLength > header->nameTableSize
+                || !CheckEntrySize(entry)
+            ) {
+                _header = nullptr;
+                _file.close();
+                return false;
+            }
+        }
+        // findEntry 直接拿 bucket 的值下标，损坏的包不能让它越界
+        for(uint32_t i = 0; i < header->bucketCount; ++i) {
+            if(_buckets[i] > header->entryCount) {
+                _header = nullptr;
+                _file.close();
+                return false;
+            }
+        }
+        return true;
+    }
+
+    const pkg_entry_t* PkgArchive::findEntry(uint64_t hash, std::string_view name) const {
+        if(!_header || !_header->bucketCount) {
+            return nullptr;
+        }
+        uint32_t mask = _header->bucketCount - 1;
+        uint32_t bucket = (uint32_t)hash & mask;
+        for(uint32_t probe = 0; probe < _header->bucketCount; ++probe) {
+            uint32_t index = _buckets[bucket];
+            if(!index) {
+                return nullptr;
+            }
+            auto entry = &_entries[index - 1];
+            // 哈希相同的不存在的路径不能拿到别的文件
+            if(entry->hash == hash && std::string_view(_names + entry->nameOffset, entry->nameLength) == name) {
+                return entry;
+            }
+            bucket = (bucket + 1) & mask;
+        }
+        return nullptr;
+    }
+
+    const pkg_entry_t* PkgArchive::findEntry(const char* path, size_t length) const {
+        PathBuffer canonical;
+        canonical.assignRelative(std::string_view(path, length));
+        return findEntry(canonical.hash(), canonical.view());
+    }
+
+    IStream* PkgArchive::openIStream(const std::string& path, BitFlags<ReadFlag>) {
+        auto entry = findEntry(path.c_str(), path.length());
+        if(!entry) {
+            return nullptr;
+        }
+        const uint8_t* data = _file.data() + entry->offset;
+        switch ((PkgCompression)entry->compression) {
+        case PkgCompression::none:
+            return CreateMemoryIStream(data, (int64_t)entry->size);
+        case PkgCompression::lzblock: {
+            IOBuffer buffer((int64_t)entry->size);
+            if(!buffer.data() || !LZBlockDecompress(data, (size_t)entry->storedSize, buffer.data(), (size_t)entry->size)) {
+                return nullptr;
+            }
+            return CreateMemoryIStream(std::move(buffer));
+        }
+        case PkgCompression::chunked:
+            return CreateChunkedIStream(data, entry->storedSize);
+        default:
+            break;
+        }
+        return nullptr;
+    }
+
+    OStream* PkgArchive::openOStream(const std::string&, BitFlags<WriteFlag>) {
+        return nullptr;
+    }
+
+    bool PkgArchive::testExist(const std::string& path) {
+        return !!findEntry(path.c_str(), path.length());
+    }
+
+    bool PkgArchive::supportListFeature() const {
+        return true;
+    }
+
+    std::vector<IArchive::FileEntity> PkgArchive::listFiles(const std::string& path) {
+        std::vector<IArchive::FileEntity> rst;
+        if(!_header) {
+            return rst;
+        }
+        PathBuffer canonical;
+        canonical.assignRelative(path);
+        std::string dir(canonical.view());
+        if(!dir.empty()) {
+            dir.push_back('/');
+        }
+        std::unordered_set<std::string> directories;
+        for(uint32_t i = 0; i < _header->entryCount; ++i) {
+            auto const& entry = _entries[i];
+            std::string_view name(_names + entry.nameOffset, entry.nameLength);
+            if(name.length() <= dir.length() || name.compare(0, dir.length(), dir) != 0) {
+                continue;
+            }
+            name.remove_prefix(dir.length());
+            auto slash = name.find('/');
+            if(slash == std::string_view::npos) {
+                rst.emplace_back(std::string(name), IArchive::FileEntityType::file);
+            } else {
+                std::string subdir(name.substr(0, slash));
+                if(directories.insert(subdir).second) {
+                    rst.emplace_back(std::move(subdir), IArchive::FileEntityType::directory);
+                }
+            }
+        }
+        return rst;
+    }
+
+    std::vector<IArchive::FileEntity> PkgArchive::listFilesRecursive(const std::string& path) {
+        std::vector<IArchive::FileEntity> rst;
+        if(!_header) {
+            return rst;
+        }
+        PathBuffer canonical;
+        canonical.assignRelative(path);
+        std::string dir(canonical.view());
+        if(!dir.empty()) {
+            dir.push_back('/');
+        }
+        std::unordered_set<std::string_view> directories;
+        for(uint32_t i = 0; i < _header->entryCount; ++i) {
+            auto const& entry = _entries[i];
+            std::string_view name(_names + entry.nameOffset, entry.nameLength);
+            if(name.length() <= dir.length() || name.compare(0, dir.length(), dir) != 0) {
+                continue;
+            }
+            name.remove_prefix(dir.length());
+            // 包里只记录文件，目录从路径里推出来
+            for(auto slash = name.find('/'); slash != std::string_view::npos; slash = name.find('/', slash + 1)) {
+                if(directories.insert(name.substr(0, slash)).second) {
+                    rst.emplace_back(std::string(name.substr(0, slash)), IArchive::FileEntityType::directory);
+                }
+            }
+            rst.emplace_back(std::string(name), IArchive::FileEntityType::file);
+        }
+        return rst;
+    }
+
+    std::string PkgArchive::rootPath() {
+        return _path;
+    }
+
+    bool PkgArchive::readonly() const {
+        return true;
+    }
+
+    void PkgArchive::destroy() {
+        this->~PkgArchive();
+        comm_free(this);
+    }
+
+    IArchive* CreatePkgArchive(const std::string& pkgPath) {
+        auto memptr = comm_alloc(sizeof(PkgArchive));
+        auto archive = new (memptr) PkgArchive(pkgPath);
+        if(!archive->open()) {
+            archive->destroy();
+            return nullptr;
+        }
+        return archive;
+    }
+
+}
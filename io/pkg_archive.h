@@ -0,0 +1,49 @@
+#pragma once
+#include "archive.h"
+#include "mapped_file.h"
+#include "pkg_format.h"
+#include <string_view>
+
+namespace comm {
+
+    /**
+     * @brief 资源包（只读），整个包 mmap 进来
+     *  打开条目 = 一次哈希探测 + 指针偏移，未压缩的条目直接返回映射内存上的流，不拷贝
+     */
+    class PkgArchive : public IArchive {
+    private:
+        std::string             _path;
+        MappedFile              _file;
+        const pkg_header_t*     _header;
+        const pkg_entry_t*      _entries;
+        const uint32_t*         _buckets;
+        const char*             _names;
+    public:
+        PkgArchive(const std::string& path)
+            : _path(path)
+            , _file()
+            , _header(nullptr)
+            , _entries(nullptr)
+            , _buckets(nullptr)
+            , _names(nullptr)
+        {}
+        bool open();
+        const pkg_entry_t* findEntry( const char* path, size_t length ) const;
+        // name 是规范化过的相对路径，hash 是它的 PathHash
+        const pkg_entry_t* findEntry( uint64_t hash, std::string_view name ) const;
+        uint32_t entryCount() const {
+            return _header ? _header->entryCount : 0;
+        }
+        virtual IStream* openIStream( const std::string& path, BitFlags<ReadFlag> flags) override;
+        virtual OStream* openOStream( const std::string& path, BitFlags<WriteFlag> flags) override;
+        virtual bool testExist( const std::string& path ) override;
+        virtual bool supportListFeature() const override;
+        virtual std::vector<FileEntity> listFiles( const std::string& path ) override;
+        virtual std::vector<FileEntity> listFilesRecursive( const std::string& path ) override;
+        virtual std::string rootPath() override;
+        virtual bool readonly() const override;
+        virtual void destroy() override;
+        virtual ~PkgArchive() override {}
+    };
+
+}
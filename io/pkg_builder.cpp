@@ -0,0 +1,167 @@
+#include "pkg_builder.h"
+#include "lz_block.h"
+#include "chunked_stream.h"
+#include "path.h"
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+namespace comm {
+
+    static bool ReadWholeFile(const std::string& path, std::vector<uint8_t>& data) {
+        FILE* file = fopen(path.c_str(), "rb");
+        if(!file) {
+            return false;
+        }
+        fseek(file, 0, SEEK_END);
+        long size = ftell(file);
+        fseek(file, 0, SEEK_SET);
+        if(size < 0) {
+            fclose(file);
+            return false;
+        }
+        data.resize((size_t)size);
+        size_t readSize = size ? fread(data.data(), 1, (size_t)size, file) : 0;
+        fclose(file);
+        return readSize == (size_t)size;
+    }
+
+    static bool WritePadding(FILE* file, uint64_t& position, uint64_t alignment) {
+        static const uint8_t Zeros[256] = {};
+        uint64_t aligned = (position + alignment - 1) & ~(alignment - 1);
+        while(position < aligned) {
+            size_t n = (size_t)std::min<uint64_t>(aligned - position, sizeof(Zeros));
+            if(fwrite(Zeros, 1, n, file) != n) {
+                return false;
+            }
+            position += n;
+        }
+        return true;
+    }
+
+    bool PkgBuilder::addItem(item_t&& item) {
+        PathBuffer canonical;
+        canonical.assignRelative(item.name);
+        if(!canonical.length() || canonical.length() > UINT16_MAX) {
+            return false;
+        }
+        uint64_t hash = canonical.hash();
+        if(!_hashes.emplace(hash, _items.size()).second) {
+            return false;
+        }
+        item.name = canonical.view();
+        _items.push_back(std::move(item));
+        return true;
+    }
+
+    bool PkgBuilder::addFile(const std::string& packPath, const std::string& diskPath) {
+        return addItem({ packPath, diskPath, {} });
+    }
+
+    bool PkgBuilder::addData(const std::string& packPath, const void* data, size_t size) {
+        item_t item = { packPath, {}, {} };
+        item.data.assign((const uint8_t*)data, (const uint8_t*)data + size);
+        return addItem(std::move(item));
+    }
+
+    bool PkgBuilder::write(const std::string& outputPath) {
+        uint64_t alignment = _options.alignment ? _options.alignment : 1;
+        if(alignment & (alignment - 1)) {
+            return false;
+        }
+        FILE* file = fopen(outputPath.c_str(), "wb");
+        if(!file) {
+            return false;
+        }
+        pkg_header_t header = {};
+        header.magic = PkgMagic;
+        header.version = PkgVersion;
+        header.alignment = (uint32_t)alignment;
+        header.entryCount = (uint32_t)_items.size();
+        std::vector<pkg_entry_t> entries;
+        std::string names;
+        entries.reserve(_items.size());
+        uint64_t position = 0;
+        bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+        position += sizeof(header);
+        std::vector<uint8_t> fileData;
+        std::vector<uint8_t> compressed;
+        for(size_t i = 0; ok && i < _items.size(); ++i) {
+            auto& item = _items[i];
+            const std::vector<uint8_t>* data = &item.data;
+            if(!item.diskPath.empty()) {
+                if(!ReadWholeFile(item.diskPath, fileData)) {
+                    ok = false;
+                    break;
+                }
+                data = &fileData;
+            }
+            pkg_entry_t entry = {};
+            entry.hash = PathHash(item.name.c_str(), item.name.length());
+            entry.size = data->size();
+            entry.nameOffset = (uint32_t)names.length();
+            entry.nameLength = (uint16_t)item.name.length();
+            names.append(item.name);
+            const uint8_t* stored = data->data();
+            entry.storedSize = data->size();
+            entry.compression = (uint8_t)PkgCompression::none;
+            if(_options.compress && data->size() >= _options.minCompressSize) {
+                int64_t compressedSize = -1;
+                PkgCompression compression = PkgCompression::lzblock;
+                if(data->size() >= _options.chunkedThreshold) {
+                    compressed.clear();
+                    if(ChunkedCompress(data->data(), data->size(), compressed, _options.chunkSize)) {
+                        compressedSize = (int64_t)compressed.size();
+                        compression = PkgCompression::chunked;
+                    }
+                } else {
+                    compressed.resize(LZBlockBound(data->size()));
+                    compressedSize = LZBlockCompress(data->data(), data->size(), compressed.data(), compressed.size());
+                }
+                if(compressedSize > 0 && (double)compressedSize < (double)data->size() * _options.maxCompressRatio) {
+                    stored = compressed.data();
+                    entry.storedSize = (uint64_t)compressedSize;
+                    entry.compression = (uint8_t)compression;
+                }
+            }
+            ok = WritePadding(file, position, alignment);
+            entry.offset = position;
+            if(ok && entry.storedSize) {
+                ok = fwrite(stored, 1, (size_t)entry.storedSize, file) == entry.storedSize;
+            }
+            position += entry.storedSize;
+            entries.push_back(entry);
+        }
+        // 哈希表，负载不超过 50%
+        uint32_t bucketCount = 1;
+        while(bucketCount < entries.size() * 2) {
+            bucketCount <<= 1;
+        }
+        std::vector<uint32_t> buckets(bucketCount, 0);
+        for(uint32_t i = 0; i < (uint32_t)entries.size(); ++i) {
+            uint32_t bucket = (uint32_t)entries[i].hash & (bucketCount - 1);
+            while(buckets[bucket]) {
+                bucket = (bucket + 1) & (bucketCount - 1);
+            }
+            buckets[bucket] = i + 1;
+        }
+        ok = ok && WritePadding(file, position, alignof(pkg_entry_t));
+        header.tocOffset = position;
+        header.bucketCount = bucketCount;
+        header.nameTableSize = (uint32_t)names.length();
+        if(ok && !entries.empty()) {
+            ok = fwrite(entries.data(), sizeof(pkg_entry_t), entries.size(), file) == entries.size();
+        }
+        ok = ok && fwrite(buckets.data(), sizeof(uint32_t), buckets.size(), file) == buckets.size();
+        if(ok && !names.empty()) {
+            ok = fwrite(names.data(), 1, names.length(), file) == names.length();
+        }
+        ok = ok && fseek(file, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, file) == 1;
+        fclose(file);
+        if(!ok) {
+            remove(outputPath.c_str());
+        }
+        return ok;
+    }
+
+}
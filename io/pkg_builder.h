@@ -0,0 +1,51 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "pkg_format.h"
+
+namespace comm {
+
+    /**
+     * @brief 资源包打包器，见 pkg_format.h
+     *  文件内容在 write 的时候才读，添加大量文件不会占很多内存
+     */
+    class PkgBuilder {
+    public:
+        struct Options {
+            uint32_t    alignment = 16;             // 条目对齐，必须是 2 的幂
+            bool        compress = true;
+            uint32_t    minCompressSize = 64;       // 太小的文件不压缩
+            float       maxCompressRatio = 0.9f;    // 压缩后没有小于这个比例就存原始数据
+            uint32_t    chunkedThreshold = 1024 * 1024; // 超过这个大小用分块压缩，读的时候不用整个解压
+            uint32_t    chunkSize = 64 * 1024;
+        };
+    private:
+        struct item_t {
+            std::string             name;           // 规范化后的包内路径
+            std::string             diskPath;       // 为空时用 data
+            std::vector<uint8_t>    data;
+        };
+        Options                                 _options;
+        std::vector<item_t>                     _items;
+        std::unordered_map<uint64_t, size_t>    _hashes;
+    private:
+        bool addItem(item_t&& item);
+    public:
+        PkgBuilder()
+            : PkgBuilder(Options{})
+        {}
+        PkgBuilder(Options const& options)
+            : _options(options)
+            , _items()
+            , _hashes()
+        {}
+        // packPath 重复或者哈希冲突时返回 false
+        bool addFile(const std::string& packPath, const std::string& diskPath);
+        bool addData(const std::string& packPath, const void* data, size_t size);
+        size_t count() const { return _items.size(); }
+        bool write(const std::string& outputPath);
+    };
+
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+namespace comm {
+
+    /**
+     * @brief 资源包文件格式
+     *
+     *  | pkg_header_t | 数据区（每个条目按 alignment 对齐） | pkg_entry_t[entryCount] | uint32_t bucket[bucketCount] | 路径字符串表 |
+     *
+     *  bucket 是开放寻址的哈希表（线性探测），存的是 条目索引+1，0 表示空，
+     *  bucketCount 为 2 的幂，负载不超过 50%。所有整数都是小端。
+     *  路径按 NormalizeRelativePath 规范化后区分大小写求哈希，见 io/path.h
+     */
+
+    constexpr uint32_t PkgMagic = 0x474b504c;      // "LPKG"
+    constexpr uint16_t PkgVersion = 1;
+
+    enum class PkgCompression : uint8_t {
+        none    = 0,
+        lzblock = 1,        // 整个条目一个 LZ 块，见 lz_block.h
+        chunked = 2,        // 分块压缩流，大条目用，可以随机访问，见 chunked_stream.h
+    };
+
+    struct pkg_header_t {
+        uint32_t    magic;
+        uint16_t    version;
+        uint16_t    reserved;
+        uint32_t    alignment;          // 数据区条目的对齐
+        uint32_t    entryCount;
+        uint32_t    bucketCount;
+        uint32_t    nameTableSize;
+        uint64_t    tocOffset;          // pkg_entry_t 数组的位置，后面紧跟 bucket 和路径表
+    };
+    static_assert(sizeof(pkg_header_t) == 32, "");
+
+    struct pkg_entry_t {
+        uint64_t    hash;               // 规范化路径的 64 位哈希
+        uint64_t    offset;             // 数据在包内的偏移
+        uint64_t    size;               // 原始大小
+        uint64_t    storedSize;         // 包内大小（压缩后）
+        uint32_t    nameOffset;         // 路径在字符串表里的偏移
+        uint16_t    nameLength;
+        uint8_t     compression;        // PkgCompression
+        uint8_t     reserved;
+    };
+    static_assert(sizeof(pkg_entry_t) == 40, "");
+
+}
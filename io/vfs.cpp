@@ -0,0 +1,458 @@
+#include "vfs.h"
+#include "../memory/memory.h"
+#include <algorithm>
+
+namespace comm {
+
+    // 在已有的哈希上继续累加，用来求 "挂载点/相对路径" 的哈希而不用拼字符串
+    static uint64_t ContinuePathHash(uint64_t hash, std::string_view str, PathCase pathCase) {
+        for(char c : str) {
+            hash = PathHashStep(hash, c, pathCase);
+        }
+        return hash;
+    }
+
+    // 和哈希一样，insensitive 时只忽略 ASCII 大小写
+    static bool PathEqual(std::string_view a, std::string_view b, PathCase pathCase) {
+        if(a.length() != b.length()) {
+            return false;
+        }
+        if(pathCase == PathCase::sensitive) {
+            return a == b;
+        }
+        for(size_t i = 0; i < a.length(); ++i) {
+            char x = a[i] >= 'A' && a[i] <= 'Z' ? a[i] - 'A' + 'a' : a[i];
+            char y = b[i] >= 'A' && b[i] <= 'Z' ? b[i] - 'A' + 'a' : b[i];
+            if(x != y) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    VirtualFileSystem::VirtualFileSystem(PathCase pathCase)
+        : _mounts()
+        , _index()
+        , _mountCounter(0)
+        , _pathCase(pathCase)
+        , _mutex()
+    {}
+
+    bool VirtualFileSystem::higher(mount_t const* a, mount_t const* b) {
+        if(a->priority != b->priority) {
+            return a->priority > b->priority;
+        }
+        return a->id > b->id;
+    }
+
+    // "挂载点/" 的哈希，后面接着算 archive 里的相对路径
+    static uint64_t MountPrefixHash(std::string const& mountPoint, PathCase pathCase) {
+        uint64_t prefixHash = PathHashSeed;
+        if(!mountPoint.empty()) {
+            prefixHash = ContinuePathHash(prefixHash, mountPoint, pathCase);
+            prefixHash = PathHashStep(prefixHash, '/', pathCase);
+        }
+        return prefixHash;
+    }
+
+    void VirtualFileSystem::scanMount(mount_t* mount) {
+        mount->files.clear();
+        mount->indexed = mount->archive->supportListFeature();
+        if(!mount->indexed) {
+            return;
+        }
+        uint64_t prefixHash = MountPrefixHash(mount->mountPoint, _pathCase);
+        // listFilesRecursive 返回的相对路径已经是规范的
+        for(auto const& entity : mount->archive->listFilesRecursive(std::string())) {
+            if(entity.type == FileEntityType::file) {
+                mount->files.insert(ContinuePathHash(prefixHash, entity.name, _pathCase));
+            }
+        }
+    }
+
+    void VirtualFileSystem::indexMount(mount_t* mount) {
+        for(uint64_t hash : mount->files) {
+            auto& winner = _index[hash];
+            if(!winner || higher(mount, winner)) {
+                winner = mount;
+            }
+        }
+    }
+
+    void VirtualFileSystem::unindexMount(mount_t* mount) {
+        for(uint64_t hash : mount->files) {
+            auto iter = _index.find(hash);
+            if(iter == _index.end() || iter->second != mount) {
+                continue;
+            }
+            // 按优先级找下一个也有这个文件的挂载
+            mount_t* next = nullptr;
+            for(auto candidate : _mounts) {
+                if(candidate != mount && candidate->files.count(hash)) {
+                    next = candidate;
+                    break;
+                }
+            }
+            if(next) {
+                iter->second = next;
+            } else {
+                _index.erase(iter);
+            }
+        }
+    }
+
+    void VirtualFileSystem::reindexPath(uint64_t hash) {
+        // _mounts 按优先级排好了，第一个有这个文件的就是胜者
+        for(auto mount : _mounts) {
+            if(mount->files.count(hash)) {
+                _index[hash] = mount;
+                return;
+            }
+        }
+        _index.erase(hash);
+    }
+
+    void VirtualFileSystem::applyChanges(mount_t* mount, std::vector<FileChangeEvent> const& events) {
+        SharedMutexLock lock(_mutex);
+        lock.lock();
+        if(std::find(_mounts.begin(), _mounts.end(), mount) == _mounts.end()) {
+            // 还在 mount() 里扫描，扫描结果可能已经过时了，挂上的时候再扫一遍
+            mount->stale = true;
+            return;
+        }
+        if(!mount->indexed) {
+            return;     // 没有索引的挂载每次都现查，不用管
+        }
+        for(auto& event : events) {
+            if(event.kind == FileChangeKind::rescan) {
+                unindexMount(mount);
+                scanMount(mount);
+                indexMount(mount);
+                return;
+            }
+        }
+        uint64_t prefixHash = MountPrefixHash(mount->mountPoint, _pathCase);
+        for(auto& event : events) {
+            uint64_t hash = ContinuePathHash(prefixHash, event.path, _pathCase);
+            if(event.kind == FileChangeKind::removed) {
+                mount->files.erase(hash);
+            } else {
+                mount->files.insert(hash);
+            }
+            reindexPath(hash);
+        }
+    }
+
+    VirtualFileSystem::mount_t* VirtualFileSystem::findMount(uint32_t id) const {
+        for(auto mount : _mounts) {
+            if(mount->id == id) {
+                return mount;
+            }
+        }
+        return nullptr;
+    }
+
+    bool VirtualFileSystem::matchMountPoint(mount_t const* mount, std::string_view path, std::string_view& subpath) const {
+        std::string_view mountPoint = mount->mountPoint;
+        if(mountPoint.empty()) {
+            subpath = path;
+            return true;
+        }
+        if(path.length() < mountPoint.length() || !PathEqual(path.substr(0, mountPoint.length()), mountPoint, _pathCase)) {
+            return false;
+        }
+        if(path.length() == mountPoint.length()) {
+            subpath = std::string_view();
+            return true;
+        }
+        if(path[mountPoint.length()] != '/') {
+            return false;
+        }
+        subpath = path.substr(mountPoint.length() + 1);
+        return true;
+    }
+
+    VirtualFileSystem::mount_t* VirtualFileSystem::resolveMount(PathBuffer const& path, std::string_view& subpath) const {
+        mount_t* indexed = nullptr;
+        std::string_view indexedSubpath;
+        auto iter = _index.find(path.hash());
+        if(iter != _index.end() && matchMountPoint(iter->second, path.view(), indexedSubpath)) {
+            indexed = iter->second;
+        }
+        // 没有索引的挂载只能逐个探测，按优先级走到索引命中的挂载为止，比它优先的补丁包之类的要先看
+        for(auto mount : _mounts) {
+            if(mount == indexed) {
+                break;
+            }
+            if(!mount->indexed && matchMountPoint(mount, path.view(), subpath) && mount->archive->testExist(std::string(subpath))) {
+                return mount;
+            }
+        }
+        subpath = indexedSubpath;
+        return indexed;
+    }
+
+    uint32_t VirtualFileSystem::mount(IArchive* archive, int32_t priority, const std::string& mountPoint, bool owned) {
+        if(!archive) {
+            return InvalidMount;
+        }
+        auto mount = new mount_t();
+        mount->archive = archive;
+        mount->priority = priority;
+        PathBuffer normalized;
+        normalized.assignRelative(mountPoint, _pathCase);
+        mount->mountPoint = normalized.view();
+        mount->owned = owned;
+        mount->stale = false;
+        // 先订阅再扫描，扫描期间的变化不会漏掉；不能在锁里订阅，通知回调要拿这把锁
+        mount->subscription = archive->subscribeChanges([this, mount](std::vector<FileChangeEvent> const& events) {
+            applyChanges(mount, events);
+        });
+        // 扫描 archive 比较慢，不占着锁
+        scanMount(mount);
+        SharedMutexLock lock(_mutex);
+        lock.lock();
+        mount->id = _mountCounter++;
+        auto pos = std::upper_bound(_mounts.begin(), _mounts.end(), mount, [](mount_t const* a, mount_t const* b) {
+            return higher(a, b);
+        });
+        _mounts.insert(pos, mount);
+        if(mount->stale) {
+            scanMount(mount);
+            mount->stale = false;
+        }
+        indexMount(mount);
+        return mount->id;
+    }
+
+    bool VirtualFileSystem::unmount(uint32_t mountID) {
+        mount_t* mount = nullptr;
+        {
+            SharedMutexLock lock(_mutex);
+            lock.lock();
+            mount = findMount(mountID);
+            if(!mount) {
+                return false;
+            }
+            unindexMount(mount);
+            _mounts.erase(std::find(_mounts.begin(), _mounts.end(), mount));
+        }
+        // 锁外取消订阅，正在跑的通知回调可能在等这把锁
+        if(mount->subscription) {
+            mount->archive->unsubscribeChanges(mount->subscription);
+        }
+        if(mount->owned) {
+            mount->archive->destroy();
+        }
+        delete mount;
+        return true;
+    }
+
+    bool VirtualFileSystem::refresh(uint32_t mountID) {
+        SharedMutexLock lock(_mutex);
+        lock.lock();
+        mount_t* mount = findMount(mountID);
+        if(!mount) {
+            return false;
+        }
+        unindexMount(mount);
+        scanMount(mount);
+        indexMount(mount);
+        return true;
+    }
+
+    IArchive* VirtualFileSystem::resolve(const std::string& path, std::string* subpath) {
+        PathBuffer normalized;
+        normalized.assignRelative(path, _pathCase);
+        SharedMutexLock lock(_mutex);
+        lock.lock_shared();
+        std::string_view sub;
+        auto mount = resolveMount(normalized, sub);
+        if(!mount) {
+            return nullptr;
+        }
+        if(subpath) {
+            *subpath = sub;
+        }
+        return mount->archive;
+    }
+
+    size_t VirtualFileSystem::indexedCount() {
+        SharedMutexLock lock(_mutex);
+        lock.lock_shared();
+        return _index.size();
+    }
+
+    IStream* VirtualFileSystem::openIStream(const std::string& path, BitFlags<ReadFlag> flags) {
+        PathBuffer normalized;
+        normalized.assignRelative(path, _pathCase);
+        SharedMutexLock lock(_mutex);
+        lock.lock_shared();
+        std::string_view subpath;
+        auto mount = resolveMount(normalized, subpath);
+        if(!mount) {
+            return nullptr;
+        }
+        return mount->archive->openIStream(std::string(subpath), flags);
+    }
+
+    OStream* VirtualFileSystem::openOStream(const std::string& path, BitFlags<WriteFlag> flags) {
+        PathBuffer normalized;
+        normalized.assignRelative(path, _pathCase);
+        // 打开文件期间读者照常查找，只有登记索引的时候才升级成写锁
+        SharedMutexLock lock(_mutex);
+        lock.lock_upgrade();
+        // 写到优先级最高的可写挂载上，并且让它在索引里胜出
+        for(auto mount : _mounts) {
+            std::string_view subpath;
+            if(mount->archive->readonly() || !matchMountPoint(mount, normalized.view(), subpath)) {
+                continue;
+            }
+            OStream* stream = mount->archive->openOStream(std::string(subpath), flags);
+            if(!stream) {
+                return nullptr;
+            }
+            if(mount->indexed && !mount->files.count(normalized.hash())) {
+                lock.upgrade();
+                mount->files.insert(normalized.hash());
+                auto& winner = _index[normalized.hash()];
+                if(!winner || higher(mount, winner)) {
+                    winner = mount;
+                }
+            }
+            return stream;
+        }
+        return nullptr;
+    }
+
+    bool VirtualFileSystem::testExist(const std::string& path) {
+        return resolve(path) != nullptr;
+    }
+
+    bool VirtualFileSystem::supportListFeature() const {
+        return true;
+    }
+
+    std::vector<IArchive::FileEntity> VirtualFileSystem::listFiles(const std::string& path) {
+        PathBuffer dir;
+        dir.assignRelative(path, _pathCase);
+        std::vector<FileEntity> rst;
+        std::unordered_set<std::string> names;
+        auto append = [&](std::string&& name, FileEntityType type) {
+            if(names.insert(name).second) {
+                rst.emplace_back(std::move(name), type);
+            }
+        };
+        SharedMutexLock lock(_mutex);
+        lock.lock_shared();
+        for(auto mount : _mounts) {
+            std::string_view subpath;
+            if(matchMountPoint(mount, dir.view(), subpath)) {
+                if(mount->archive->supportListFeature()) {
+                    for(auto& entity : mount->archive->listFiles(std::string(subpath))) {
+                        append(std::move(entity.name), entity.type);
+                    }
+                }
+                continue;
+            }
+            // 挂载点在 dir 下面，挂载点的第一级就是 dir 里的一个目录
+            std::string_view mountPoint = mount->mountPoint;
+            if(!dir.length()) {
+                append(std::string(mountPoint.substr(0, mountPoint.find('/'))), FileEntityType::directory);
+            } else if(mountPoint.length() > dir.length() && mountPoint.compare(0, dir.length(), dir.view()) == 0
+                && mountPoint[dir.length()] == '/') {
+                auto rest = mountPoint.substr(dir.length() + 1);
+                append(std::string(rest.substr(0, rest.find('/'))), FileEntityType::directory);
+            }
+        }
+        return rst;
+    }
+
+    std::vector<IArchive::FileEntity> VirtualFileSystem::listFilesRecursive(const std::string& path) {
+        PathBuffer dir;
+        dir.assignRelative(path, _pathCase);
+        std::vector<FileEntity> rst;
+        std::unordered_set<std::string> names;
+        auto append = [&](std::string&& name, FileEntityType type) {
+            if(names.insert(name).second) {
+                rst.emplace_back(std::move(name), type);
+            }
+        };
+        SharedMutexLock lock(_mutex);
+        lock.lock_shared();
+        for(auto mount : _mounts) {
+            if(!mount->archive->supportListFeature()) {
+                continue;
+            }
+            std::string_view subpath;
+            if(matchMountPoint(mount, dir.view(), subpath)) {
+                for(auto& entity : mount->archive->listFilesRecursive(std::string(subpath))) {
+                    append(std::move(entity.name), entity.type);
+                }
+                continue;
+            }
+            std::string_view mountPoint = mount->mountPoint;
+            if(dir.length()) {
+                if(mountPoint.length() <= dir.length() || mountPoint.compare(0, dir.length(), dir.view()) != 0
+                    || mountPoint[dir.length()] != '/') {
+                    continue;
+                }
+                mountPoint.remove_prefix(dir.length() + 1);
+            }
+            // 挂载点相对 dir 的每一级都是目录
+            for(auto slash = mountPoint.find('/'); slash != std::string_view::npos; slash = mountPoint.find('/', slash + 1)) {
+                append(std::string(mountPoint.substr(0, slash)), FileEntityType::directory);
+            }
+            append(std::string(mountPoint), FileEntityType::directory);
+            std::string prefix(mountPoint);
+            prefix.push_back('/');
+            for(auto& entity : mount->archive->listFilesRecursive(std::string())) {
+                append(prefix + entity.name, entity.type);
+            }
+        }
+        return rst;
+    }
+
+    std::string VirtualFileSystem::rootPath() {
+        return std::string();
+    }
+
+    bool VirtualFileSystem::readonly() const {
+        SharedMutexLock lock(const_cast<SharedMutex&>(_mutex));
+        lock.lock_shared();
+        for(auto mount : _mounts) {
+            if(!mount->archive->readonly()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    VirtualFileSystem::~VirtualFileSystem() {
+        // 先全部取消订阅，之后不会再有回调来碰 _mounts
+        for(auto mount : _mounts) {
+            if(mount->subscription) {
+                mount->archive->unsubscribeChanges(mount->subscription);
+            }
+        }
+        for(auto mount : _mounts) {
+            if(mount->owned) {
+                mount->archive->destroy();
+            }
+            delete mount;
+        }
+        _mounts.clear();
+        _index.clear();
+    }
+
+    void VirtualFileSystem::destroy() {
+        this->~VirtualFileSystem();
+        comm_free(this);
+    }
+
+    VirtualFileSystem* CreateVirtualFileSystem(PathCase pathCase) {
+        auto memptr = comm_alloc(sizeof(VirtualFileSystem));
+        return new (memptr) VirtualFileSystem(pathCase);
+    }
+
+}
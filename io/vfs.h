@@ -0,0 +1,79 @@
+#pragma once
+#include "archive.h"
+#include "path.h"
+#include <unordered_map>
+#include <unordered_set>
+#include <threading/shared_mutex.hpp>
+
+namespace comm {
+
+    /**
+     * @brief 虚拟文件系统，把多个 IArchive 按优先级叠加挂载（补丁目录、DLC 包、基础资源目录...）
+     *  挂载时把各个 archive 的文件列表合并成一张 路径哈希 -> 胜出的挂载 的表，
+     *  查找一个路径只需要一次哈希探测，不用挨个 archive 去 testExist。
+     *  增删挂载时只更新受影响的路径。不支持列表功能的 archive 没法建索引，比索引命中的挂载优先（或者索引没命中）时按优先级逐个探测它们。
+     */
+    class VirtualFileSystem : public IArchive {
+    public:
+        constexpr static uint32_t InvalidMount = ~0u;
+    private:
+        struct mount_t {
+            uint32_t                        id;
+            IArchive*                       archive;
+            int32_t                         priority;       // 越大越优先，相同优先级后挂载的优先
+            std::string                     mountPoint;     // 规范化的挂载点，空表示根
+            bool                            owned;          // unmount 时 destroy archive
+            bool                            indexed;
+            bool                            stale;          // 挂上之前就收到了变化，挂上时要重新扫描
+            uint32_t                        subscription;   // archive->subscribeChanges 的返回值
+            std::unordered_set<uint64_t>    files;
+        };
+        std::vector<mount_t*>                       _mounts;        // 按优先级从高到低
+        std::unordered_map<uint64_t, mount_t*>      _index;
+        uint32_t                                    _mountCounter;
+        PathCase                                    _pathCase;
+        SharedMutex                                 _mutex;
+    private:
+        static bool higher(mount_t const* a, mount_t const* b);
+        void scanMount(mount_t* mount);
+        void indexMount(mount_t* mount);
+        void unindexMount(mount_t* mount);
+        mount_t* findMount(uint32_t id) const;
+        // hash 的胜者重新在所有挂载里选一次
+        void reindexPath(uint64_t hash);
+        // archive 的变化通知，在监视线程上调用
+        void applyChanges(mount_t* mount, std::vector<FileChangeEvent> const& events);
+        // 返回胜出的挂载，subpath 输出 archive 内的路径
+        mount_t* resolveMount(PathBuffer const& path, std::string_view& subpath) const;
+        bool matchMountPoint(mount_t const* mount, std::string_view path, std::string_view& subpath) const;
+    public:
+        VirtualFileSystem(PathCase pathCase);
+        /**
+         * @brief 挂载 archive，返回挂载 id
+         * @param mountPoint archive 的根在 vfs 里的位置，空表示根目录
+         * @param owned 为 true 时卸载或者 vfs 销毁的时候会 destroy 这个 archive
+         */
+        uint32_t mount(IArchive* archive, int32_t priority, const std::string& mountPoint = std::string(), bool owned = false);
+        bool unmount(uint32_t mountID);
+        // archive 内容变化之后重新扫描这个挂载；支持 subscribeChanges 的 archive（watch 中的 FileSystemArchive）会自动更新，不用调
+        bool refresh(uint32_t mountID);
+        // 路径最终落在哪个 archive 上，没有返回 nullptr
+        IArchive* resolve(const std::string& path, std::string* subpath = nullptr);
+        size_t indexedCount();
+        //
+        virtual IStream* openIStream( const std::string& path, BitFlags<ReadFlag> flags) override;
+        virtual OStream* openOStream( const std::string& path, BitFlags<WriteFlag> flags) override;
+        virtual bool testExist( const std::string& path ) override;
+        virtual bool supportListFeature() const override;
+        virtual std::vector<FileEntity> listFiles( const std::string& path ) override;
+        virtual std::vector<FileEntity> listFilesRecursive( const std::string& path ) override;
+        virtual std::string rootPath() override;
+        virtual bool readonly() const override;
+        virtual void destroy() override;
+        virtual ~VirtualFileSystem() override;
+    };
+
+    // 挂载 Windows 目录时用 PathCase::insensitive，和 FileSystemArchive 的约定一致
+    VirtualFileSystem* CreateVirtualFileSystem(PathCase pathCase = PathCase::sensitive);
+
+}
@@ -1,5 +1,6 @@
 #pragma once
 #include <cstdint>
+#include <cstddef>
 
 namespace comm {
     // constexpr uint32_t FlightCount = 2;
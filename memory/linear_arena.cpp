@@ -0,0 +1,76 @@
+#include "linear_arena.h"
+#include "memory.h"
+#include <algorithm>
+#include <cassert>
+
+namespace comm {
+
+    LinearArena::LinearArena(size_t chunkSize)
+        : _head(nullptr)
+        , _current(nullptr)
+        , _offset(0)
+        , _used(0)
+        , _chunkSize(chunkSize)
+    {}
+
+    LinearArena::~LinearArena() {
+        while(_head) {
+            chunk_t* next = _head->next;
+            comm_free(_head);
+            _head = next;
+        }
+    }
+
+    void* LinearArena::allocSlow(size_t size, size_t alignment) {
+        assert(alignment && (alignment & (alignment - 1)) == 0);
+        // 最坏情况下对齐要多占 alignment - 1 个字节（数据区本身是 16 字节对齐的）
+        size_t required = size + (alignment > DefaultAlignment ? alignment - 1 : 0);
+        chunk_t* next = _current ? _current->next : _head;
+        if(!next || next->size < required) {
+            // 后面没有块或者放不下：新建一块插在当前块后面，原来的块往后挪，以后还能复用
+            size_t chunkSize = std::max(_chunkSize, required);
+            chunk_t* chunk = (chunk_t*)comm_alloc(sizeof(chunk_t) + chunkSize);
+            if(!chunk) {
+                return nullptr;
+            }
+            chunk->size = chunkSize;
+            chunk->next = next;
+            if(_current) {
+                _current->next = chunk;
+            } else {
+                _head = chunk;
+            }
+            next = chunk;
+        }
+        // 当前块剩下的尾巴算作用掉了，rewind 的时候一起退回
+        if(_current) {
+            _used += _current->size - _offset;
+        }
+        _current = next;
+        _offset = 0;
+        return alloc(size, alignment);
+    }
+
+    void LinearArena::trim() {
+        chunk_t*& next = _current ? _current->next : _head;
+        while(next) {
+            chunk_t* chunk = next;
+            next = chunk->next;
+            comm_free(chunk);
+        }
+    }
+
+    size_t LinearArena::bytesReserved() const {
+        size_t bytes = 0;
+        for(chunk_t* chunk = _head; chunk; chunk = chunk->next) {
+            bytes += chunk->size;
+        }
+        return bytes;
+    }
+
+    LinearArena& ScratchArena() {
+        static thread_local LinearArena arena;
+        return arena;
+    }
+
+}
@@ -0,0 +1,138 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <memory_resource>
+
+namespace comm {
+
+    /**
+     * @brief 线性（栈式）分配器，给解析、拼路径这类临时工作用
+     *  从 comm_alloc 拿大块内存，块内只移动指针；不能单独释放，用 mark()/rewind() 整段退回，代价是 O(1)。
+     *  退回之后后面的块留着下次复用，不还给 comm_alloc，trim() 才真正释放。
+     *  不调用析构函数，放进来的对象要么是平凡析构的，要么自己负责析构。
+     */
+    class LinearArena {
+    private:
+        struct chunk_t {
+            chunk_t*    next;
+            size_t      size;       // 可用的字节数，不含头
+            size_t      padding[2]; // 头凑够 32 字节，数据区按 16 字节对齐
+        };
+    public:
+        static constexpr size_t DefaultChunkSize = 64 * 1024;
+        static constexpr size_t DefaultAlignment = alignof(std::max_align_t);
+
+        struct Marker {
+            chunk_t*    chunk;      // nullptr 表示还没有分配过
+            size_t      offset;
+            size_t      used;
+        };
+    private:
+        chunk_t*        _head;
+        chunk_t*        _current;
+        size_t          _offset;    // _current 里已经用掉的字节
+        size_t          _used;
+        size_t          _chunkSize;
+    private:
+        void* allocSlow(size_t size, size_t alignment);
+    public:
+        explicit LinearArena(size_t chunkSize = DefaultChunkSize);
+        LinearArena(LinearArena const&) = delete;
+        LinearArena& operator = (LinearArena const&) = delete;
+        ~LinearArena();
+
+        /**
+         * @brief alignment 必须是 2 的幂
+         */
+        void* alloc(size_t size, size_t alignment = DefaultAlignment) {
+            if(_current) {
+                uintptr_t base = (uintptr_t)(_current + 1);
+                uintptr_t begin = (base + _offset + alignment - 1) & ~(uintptr_t)(alignment - 1);
+                if(begin + size <= base + _current->size) {
+                    _used += begin + size - (base + _offset);
+                    _offset = begin + size - base;
+                    return (void*)begin;
+                }
+            }
+            return allocSlow(size, alignment);
+        }
+
+        template<class T>
+        T* allocArray(size_t count) {
+            return (T*)alloc(sizeof(T) * count, alignof(T));
+        }
+
+        Marker mark() const {
+            return { _current, _offset, _used };
+        }
+
+        // 退回到 marker 的位置，marker 之后分配的内存全部作废
+        void rewind(Marker const& marker) {
+            _current = marker.chunk;
+            _offset = marker.offset;
+            _used = marker.used;
+        }
+
+        void reset() {
+            rewind({ nullptr, 0, 0 });
+        }
+
+        // 释放当前块之后的空闲块
+        void trim();
+
+        size_t bytesUsed() const {
+            return _used;
+        }
+        size_t bytesReserved() const;
+    };
+
+    /**
+     * @brief 作用域结束时自动 rewind
+     */
+    class LinearArenaScope {
+    private:
+        LinearArena&            _arena;
+        LinearArena::Marker     _marker;
+    public:
+        explicit LinearArenaScope(LinearArena& arena)
+            : _arena(arena)
+            , _marker(arena.mark())
+        {}
+        LinearArenaScope(LinearArenaScope const&) = delete;
+        LinearArenaScope& operator = (LinearArenaScope const&) = delete;
+        ~LinearArenaScope() {
+            _arena.rewind(_marker);
+        }
+    };
+
+    /**
+     * @brief 让 std::pmr 容器从 LinearArena 分配，deallocate 什么都不做，内存跟着 arena 的 rewind 一起回收
+     *
+     *  LinearArenaScope scope(ScratchArena());
+     *  LinearArenaResource resource(ScratchArena());
+     *  std::pmr::vector<Token> tokens(&resource);
+     */
+    class LinearArenaResource : public std::pmr::memory_resource {
+    private:
+        LinearArena&    _arena;
+    public:
+        explicit LinearArenaResource(LinearArena& arena)
+            : _arena(arena)
+        {}
+    private:
+        void* do_allocate(size_t bytes, size_t alignment) override {
+            return _arena.alloc(bytes, alignment);
+        }
+        void do_deallocate(void*, size_t, size_t) override {
+        }
+        bool do_is_equal(std::pmr::memory_resource const& other) const noexcept override {
+            return this == &other;
+        }
+    };
+
+    /**
+     * @brief 当前线程的临时 arena，用的时候配合 LinearArenaScope，不要把里面的指针带出作用域
+     */
+    LinearArena& ScratchArena();
+
+}
@@ -1,14 +1,25 @@
 #include "memory.h"
 #include <cstdlib>
+#if LWC_NUMA_ALLOC
+#include "numa_arena.h"
+#endif
 
 namespace comm {
 
     void* comm_alloc(size_t size) {
+    #if LWC_NUMA_ALLOC
+        return NumaAlloc(size);
+    #else
         return malloc(size);
+    #endif
     }
 
     void comm_free(void* ptr) {
-        return free(ptr);
+    #if LWC_NUMA_ALLOC
+        NumaFree(ptr);
+    #else
+        free(ptr);
+    #endif
     }
 
 }
\ No newline at end of file
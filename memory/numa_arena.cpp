@@ -0,0 +1,417 @@
+#include "numa_arena.h"
+#include "virtual_arena.h"
+#include "../threading/adaptive_mutex.hpp"
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace comm {
+
+    namespace {
+
+        constexpr uint32_t MaxNodes = 64;
+        constexpr uint32_t LargeClass = ~0u;
+        constexpr uint32_t CacheSlots = 32;
+        constexpr size_t CarveBytes = 64 * 1024;           // 空闲链表空了一次切这么多
+        constexpr size_t CacheBytes = 128 * 1024;          // 线程缓存每个级别最多留这么多字节
+    #if defined(__linux__)
+        constexpr int MpolPreferred = 1;                    // <numaif.h> 的 MPOL_PREFERRED，不为它依赖 libnuma
+    #endif
+
+        // 16 字节一级到 64，之后每翻一倍分 4 级
+        constexpr uint32_t SizeClass(size_t size) {
+            if(size <= 64) {
+                return size ? (uint32_t)((size + 15) / 16 - 1) : 0;
+            }
+            uint32_t n = (uint32_t)std::bit_width(size - 1) - 1;
+            return 4 + (n - 6) * 4 + (uint32_t)((size - 1 - ((size_t)1 << n)) >> (n - 2));
+        }
+
+        constexpr size_t ClassSize(uint32_t sizeClass) {
+            if(sizeClass < 4) {
+                return (sizeClass + 1) * 16;
+            }
+            uint32_t n = 6 + (sizeClass - 4) / 4;
+            return ((size_t)1 << n) + ((size_t)((sizeClass - 4) % 4 + 1) << (n - 2));
+        }
+
+        constexpr uint32_t ClassCount = SizeClass(NumaMaxSmallSize) + 1;
+        static_assert(ClassSize(ClassCount - 1) == NumaMaxSmallSize);
+
+        constexpr uint32_t CacheLimit(uint32_t sizeClass) {
+            size_t count = CacheBytes / ClassSize(sizeClass);
+            return count > CacheSlots ? CacheSlots : (count < 4 ? 4 : (uint32_t)count);
+        }
+
+        // 每块前面的头，空闲时链表指针放在头后面的用户区
+        struct block_header_t {
+            uint32_t    node;
+            uint32_t    sizeClass;      // LargeClass 表示直接映射的大块
+            uint64_t    size;           // 大块映射的总字节数
+        };
+        static_assert(sizeof(block_header_t) == 16);
+
+        struct free_block_t {
+            free_block_t*   next;
+        };
+
+        struct alignas(64) numa_node_t {
+            AdaptiveMutex           mutex { "NumaArena" };
+            VirtualArena            arena;
+            bool                    reserveFailed = false;
+            free_block_t*           freeLists[ClassCount] = {};
+            std::atomic<uint64_t>   allocations { 0 };
+            std::atomic<uint64_t>   frees { 0 };
+            std::atomic<uint64_t>   remoteFrees { 0 };
+            std::atomic<size_t>     bytesInUse { 0 };
+            std::atomic<size_t>     largeBytes { 0 };
+        };
+
+        struct numa_state_t {
+            uint32_t        nodeCount;
+            numa_node_t*    nodes;
+        };
+
+    #if defined(__linux__)
+        // /sys/devices/system/node/online 形如 "0" 或 "0-1,3"
+        uint32_t DetectNodeCount() {
+            FILE* file = fopen("/sys/devices/system/node/online", "r");
+            if(!file) {
+                return 1;
+            }
+            char text[256] = {};
+            size_t length = fread(text, 1, sizeof(text) - 1, file);
+            fclose(file);
+            text[length] = 0;
+            uint32_t maxNode = 0;
+            for(char* cursor = text; *cursor;) {
+                char* end = cursor;
+                unsigned long value = strtoul(cursor, &end, 10);
+                if(end == cursor) {
+                    ++cursor;
+                    continue;
+                }
+                maxNode = std::max(maxNode, (uint32_t)value);
+                cursor = end;
+            }
+            return std::min(maxNode + 1, MaxNodes);
+        }
+
+        void BindRangeToNode(void* address, size_t bytes, uint32_t node) {
+            unsigned long mask[MaxNodes / (sizeof(unsigned long) * 8)] = {};
+            mask[node / (sizeof(unsigned long) * 8)] = 1ul << (node % (sizeof(unsigned long) * 8));
+            // 失败（容器里没权限、内核没开 NUMA）就退回 first-touch
+            syscall(SYS_mbind, address, bytes, MpolPreferred, mask, (unsigned long)MaxNodes + 1, 0u);
+        }
+    #endif
+
+        numa_state_t& State() {
+            // 故意不释放，线程退出时还要往里还块
+            static numa_state_t* state = [] {
+                numa_state_t* state = new numa_state_t();
+            #if defined(__linux__)
+                state->nodeCount = DetectNodeCount();
+            #else
+                state->nodeCount = 1;
+            #endif
+                state->nodes = new numa_node_t[state->nodeCount];
+                return state;
+            }();
+            return *state;
+        }
+
+        /**
+         * @brief 线程缓存，平凡析构，其它 thread_local 析构时还能安全地访问；
+         *  真正的清理放在 ThreadCacheFlusher 的析构里，清理之后标记 dead，之后的释放直接还给节点
+         */
+        struct thread_cache_t {
+            uint32_t    node;
+            bool        bound;
+            bool        dead;
+            uint32_t    counts[ClassCount];
+            void*       slots[ClassCount][CacheSlots];
+        };
+
+        thread_local thread_cache_t ThreadCache;
+
+        // 锁内调用
+        free_block_t* TakeBlock(numa_node_t& arenaNode, uint32_t node, uint32_t sizeClass) {
+            if(free_block_t* block = arenaNode.freeLists[sizeClass]) {
+                arenaNode.freeLists[sizeClass] = block->next;
+                return block;
+            }
+            if(!arenaNode.arena.valid()) {
+                if(arenaNode.reserveFailed) {
+                    return nullptr;
+                }
+                // 64 位下每个节点保留 64GB 地址，保留不到就逐级减半
+                size_t reserveBytes = sizeof(void*) == 8 ? (size_t)64 << 30 : (size_t)256 << 20;
+                while(!arenaNode.arena.reserve(reserveBytes) && reserveBytes > ((size_t)64 << 20)) {
+                    reserveBytes /= 2;
+                }
+                if(!arenaNode.arena.valid()) {
+                    arenaNode.reserveFailed = true;
+                    return nullptr;
+                }
+            #if defined(__linux__)
+                if(State().nodeCount > 1) {
+                    BindRangeToNode(arenaNode.arena.data(), arenaNode.arena.reserved(), node);
+                }
+            #endif
+            }
+            size_t blockSize = sizeof(block_header_t) + ClassSize(sizeClass);
+            size_t count = CarveBytes / blockSize ? CarveBytes / blockSize : 1;
+            uint8_t* memory = (uint8_t*)arenaNode.arena.alloc(blockSize * count, sizeof(block_header_t));
+            if(!memory) {
+                return nullptr;
+            }
+            for(size_t i = 0; i < count; ++i) {
+                block_header_t* header = (block_header_t*)(memory + blockSize * i);
+                header->node = node;
+                header->sizeClass = sizeClass;
+                header->size = 0;
+                if(i) {
+                    free_block_t* block = (free_block_t*)(header + 1);
+                    block->next = arenaNode.freeLists[sizeClass];
+                    arenaNode.freeLists[sizeClass] = block;
+                }
+            }
+            return (free_block_t*)((block_header_t*)memory + 1);
+        }
+
+        // 锁内调用
+        void GiveBlock(numa_node_t& arenaNode, uint32_t sizeClass, void* ptr) {
+            free_block_t* block = (free_block_t*)ptr;
+            block->next = arenaNode.freeLists[sizeClass];
+            arenaNode.freeLists[sizeClass] = block;
+        }
+
+        void FlushThreadCache(thread_cache_t& cache) {
+            numa_node_t& arenaNode = State().nodes[cache.node];
+            std::lock_guard<AdaptiveMutex> lock(arenaNode.mutex);
+            for(uint32_t sizeClass = 0; sizeClass < ClassCount; ++sizeClass) {
+                for(uint32_t i = 0; i < cache.counts[sizeClass]; ++i) {
+                    GiveBlock(arenaNode, sizeClass, cache.slots[sizeClass][i]);
+                }
+                cache.counts[sizeClass] = 0;
+            }
+        }
+
+        struct thread_cache_flusher_t {
+            ~thread_cache_flusher_t() {
+                if(ThreadCache.bound) {
+                    FlushThreadCache(ThreadCache);
+                }
+                ThreadCache.dead = true;
+            }
+        };
+
+        thread_local thread_cache_flusher_t ThreadCacheFlusher;
+
+        uint32_t DetectCurrentNode() {
+            uint32_t nodeCount = State().nodeCount;
+            if(nodeCount == 1) {
+                return 0;
+            }
+        #if defined(__linux__)
+            unsigned cpu = 0;
+            unsigned node = 0;
+            if(syscall(SYS_getcpu, &cpu, &node, nullptr) == 0) {
+                return node % nodeCount;
+            }
+        #endif
+            return 0;
+        }
+
+        // 线程退出清理之后返回 nullptr
+        thread_cache_t* LocalCache() {
+            thread_cache_t& cache = ThreadCache;
+            if(cache.dead) {
+                return nullptr;
+            }
+            if(!cache.bound) {
+                (void)&ThreadCacheFlusher;  // 第一次用到时构造，线程退出时析构
+                cache.node = DetectCurrentNode();
+                cache.bound = true;
+            }
+            return &cache;
+        }
+
+        void* AllocLarge(size_t size, uint32_t node) {
+            size_t total = size + sizeof(block_header_t);
+        #if defined(__linux__)
+            size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+            total = (total + pageSize - 1) & ~(pageSize - 1);
+            void* memory = mmap(nullptr, total, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if(memory == MAP_FAILED) {
+                return nullptr;
+            }
+            if(State().nodeCount > 1) {
+                BindRangeToNode(memory, total, node);
+            }
+        #else
+            void* memory = malloc(total);
+            if(!memory) {
+                return nullptr;
+            }
+        #endif
+            block_header_t* header = (block_header_t*)memory;
+            header->node = node;
+            header->sizeClass = LargeClass;
+            header->size = total;
+            numa_node_t& arenaNode = State().nodes[node];
+            arenaNode.allocations.fetch_add(1, std::memory_order_relaxed);
+            arenaNode.bytesInUse.fetch_add(total, std::memory_order_relaxed);
+            arenaNode.largeBytes.fetch_add(total, std::memory_order_relaxed);
+            return header + 1;
+        }
+
+    }
+
+    uint32_t NumaNodeCount() {
+        return State().nodeCount;
+    }
+
+    uint32_t CurrentNumaNode() {
+        thread_cache_t* cache = LocalCache();
+        return cache ? cache->node : DetectCurrentNode();
+    }
+
+    void BindThreadToNumaNode(uint32_t node) {
+        thread_cache_t* cache = LocalCache();
+        if(!cache) {
+            return;
+        }
+        node %= State().nodeCount;
+        if(cache->node != node) {
+            FlushThreadCache(*cache);
+            cache->node = node;
+        }
+    }
+
+    void* NumaAllocOnNode(size_t size, uint32_t node) {
+        numa_state_t& state = State();
+        node %= state.nodeCount;
+        if(size > NumaMaxSmallSize) {
+            return AllocLarge(size, node);
+        }
+        uint32_t sizeClass = SizeClass(size);
+        numa_node_t& arenaNode = state.nodes[node];
+        void* ptr = nullptr;
+        thread_cache_t* cache = LocalCache();
+        if(cache && cache->node == node) {
+            uint32_t& count = cache->counts[sizeClass];
+            if(!count) {
+                std::lock_guard<AdaptiveMutex> lock(arenaNode.mutex);
+                uint32_t batch = CacheLimit(sizeClass) / 2;
+                while(count < batch) {
+                    free_block_t* block = TakeBlock(arenaNode, node, sizeClass);
+                    if(!block) {
+                        break;
+                    }
+                    cache->slots[sizeClass][count++] = block;
+                }
+            }
+            if(count) {
+                ptr = cache->slots[sizeClass][--count];
+            }
+        } else {
+            std::lock_guard<AdaptiveMutex> lock(arenaNode.mutex);
+            ptr = TakeBlock(arenaNode, node, sizeClass);
+        }
+        if(!ptr) {
+            // 节点的地址空间用完了，退回直接映射
+            return AllocLarge(size, node);
+        }
+        arenaNode.allocations.fetch_add(1, std::memory_order_relaxed);
+        arenaNode.bytesInUse.fetch_add(ClassSize(sizeClass), std::memory_order_relaxed);
+        return ptr;
+    }
+
+    void* NumaAlloc(size_t size) {
+        return NumaAllocOnNode(size, CurrentNumaNode());
+    }
+
+    void NumaFree(void* ptr) {
+        if(!ptr) {
+            return;
+        }
+        block_header_t* header = (block_header_t*)ptr - 1;
+        uint32_t node = header->node;
+        numa_node_t& arenaNode = State().nodes[node];
+        thread_cache_t* cache = LocalCache();
+        arenaNode.frees.fetch_add(1, std::memory_order_relaxed);
+        if(cache && cache->node != node) {
+            arenaNode.remoteFrees.fetch_add(1, std::memory_order_relaxed);
+        }
+        if(header->sizeClass == LargeClass) {
+            size_t total = (size_t)header->size;
+            arenaNode.bytesInUse.fetch_sub(total, std::memory_order_relaxed);
+            arenaNode.largeBytes.fetch_sub(total, std::memory_order_relaxed);
+        #if defined(__linux__)
+            munmap(header, total);
+        #else
+            free(header);
+        #endif
+            return;
+        }
+        uint32_t sizeClass = header->sizeClass;
+        arenaNode.bytesInUse.fetch_sub(ClassSize(sizeClass), std::memory_order_relaxed);
+        if(cache && cache->node == node) {
+            uint32_t& count = cache->counts[sizeClass];
+            uint32_t limit = CacheLimit(sizeClass);
+            if(count == limit) {
+                // 满了还一半给节点
+                std::lock_guard<AdaptiveMutex> lock(arenaNode.mutex);
+                for(uint32_t i = limit / 2; i < limit; ++i) {
+                    GiveBlock(arenaNode, sizeClass, cache->slots[sizeClass][i]);
+                }
+                count = limit / 2;
+            }
+            cache->slots[sizeClass][count++] = ptr;
+            return;
+        }
+        std::lock_guard<AdaptiveMutex> lock(arenaNode.mutex);
+        GiveBlock(arenaNode, sizeClass, ptr);
+    }
+
+    std::vector<NumaNodeStats> CollectNumaStats() {
+        numa_state_t& state = State();
+        std::vector<NumaNodeStats> result(state.nodeCount);
+        for(uint32_t node = 0; node < state.nodeCount; ++node) {
+            numa_node_t& arenaNode = state.nodes[node];
+            NumaNodeStats& stats = result[node];
+            stats.node = node;
+            {
+                std::lock_guard<AdaptiveMutex> lock(arenaNode.mutex);
+                stats.bytesCommitted = arenaNode.arena.committed();
+            }
+            stats.bytesInUse = arenaNode.bytesInUse.load(std::memory_order_relaxed);
+            stats.largeBytes = arenaNode.largeBytes.load(std::memory_order_relaxed);
+            stats.allocations = arenaNode.allocations.load(std::memory_order_relaxed);
+            stats.frees = arenaNode.frees.load(std::memory_order_relaxed);
+            stats.remoteFrees = arenaNode.remoteFrees.load(std::memory_order_relaxed);
+        }
+        return result;
+    }
+
+    void ReportNumaStats(FILE* file) {
+        fprintf(file, "%-6s %14s %14s %14s %12s %12s %12s\n",
+            "node", "committed", "in use", "large", "alloc", "free", "remote");
+        for(auto const& stats : CollectNumaStats()) {
+            fprintf(file, "%-6u %14zu %14zu %14zu %12llu %12llu %12llu\n", stats.node,
+                stats.bytesCommitted, stats.bytesInUse, stats.largeBytes,
+                (unsigned long long)stats.allocations, (unsigned long long)stats.frees,
+                (unsigned long long)stats.remoteFrees);
+        }
+    }
+
+}
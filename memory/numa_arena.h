@@ -0,0 +1,47 @@
+#pragma once
+
+/**
+ * @file numa_arena.h
+ * @brief 按 NUMA 节点分开的内存区，给 comm_alloc 用
+ *  每个节点一块 VirtualArena（保留 64GB 地址，用到才提交），linux 上用 mbind 把这段地址的策略设成优先放在该节点，
+ *  mbind 失败时退回 first-touch（谁先写谁所在的节点）。小块（<= MaxSmallSize）按大小级别从节点的空闲链表拿，
+ *  每个线程对自己绑定的节点还有一层线程缓存，大部分分配释放不进锁；大块直接 mmap 再 mbind。
+ *  线程第一次分配时按所在 CPU 绑到本地节点，之后一直用这个节点，BindThreadToNumaNode 可以手动改。
+ *  别的节点的块释放时还回它自己的节点，不进当前线程的缓存。
+ *  CMakeLists.txt 里打开 ENABLE_NUMA_ALLOC（定义 LWC_NUMA_ALLOC）时 comm_alloc/comm_free 走这里；
+ *  单节点的机器、非 linux 平台只有一个节点，不调用 mbind，行为就是一个带线程缓存的大小级别分配器。
+ */
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <vector>
+
+namespace comm {
+
+    struct NumaNodeStats {
+        uint32_t    node;
+        size_t      bytesCommitted;     // 节点内存区已经提交的字节
+        size_t      bytesInUse;         // 交给调用者的字节（按大小级别算，含大块）
+        size_t      largeBytes;         // 其中直接 mmap 的大块
+        uint64_t    allocations;
+        uint64_t    frees;
+        uint64_t    remoteFrees;        // 在别的节点的线程上释放的次数
+    };
+
+    constexpr size_t NumaMaxSmallSize = 256 * 1024;
+
+    uint32_t NumaNodeCount();
+    // 当前线程绑定的节点，还没绑定时按所在 CPU 绑定
+    uint32_t CurrentNumaNode();
+    // 线程换节点时原来缓存的块还给原节点
+    void BindThreadToNumaNode(uint32_t node);
+
+    void* NumaAlloc(size_t size);
+    void* NumaAllocOnNode(size_t size, uint32_t node);
+    void NumaFree(void* ptr);
+
+    std::vector<NumaNodeStats> CollectNumaStats();
+    void ReportNumaStats(FILE* file);
+
+}
@@ -0,0 +1,383 @@
+#pragma once
+#include "memory.h"
+#include "../threading/adaptive_mutex.hpp"
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <unordered_map>
+#include <utility>
+
+#if defined(__SANITIZE_ADDRESS__)
+#define LWC_OBJECT_POOL_ASAN 1
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define LWC_OBJECT_POOL_ASAN 1
+#endif
+#endif
+#if LWC_OBJECT_POOL_ASAN
+#include <sanitizer/asan_interface.h>
+#endif
+
+namespace comm {
+
+    struct ObjectPoolStats {
+        size_t      live;           // 正在用的对象
+        size_t      capacity;       // 所有块加起来能放多少个
+        size_t      chunks;
+        size_t      bytesReserved;  // 从 comm_alloc 拿的字节数
+    };
+
+    // ObjectPool<T, false> 用的空锁
+    struct NullMutex {
+        void lock() {}
+        void unlock() {}
+    };
+
+    /**
+     * @brief 定长对象池：按块从 comm_alloc 拿内存（块内按缓存行对齐），空闲的槽用侵入式单链表串起来，
+     *  create/destroy 只是链表头的出入。每个槽在对象后面留一个字节标记是否在用，forEach 遍历活着的对象靠它。
+     *  ThreadSafe 为 false 时没有锁，给本来就不跨线程的结构用（比如 tlsf::Pool 的节点）；
+     *  为 true 时用 AdaptiveMutex 保护，可以再打开线程缓存：每个线程给每个池留一个小弹匣（MagazineSize 个槽），
+     *  空了或满了才一次搬半个弹匣进出全局链表，大部分 create/destroy 不进锁。
+     *  线程缓存按池的 id 找弹匣，池析构之后留在别的线程弹匣里的旧槽会被直接丢掉（内存已经跟着块还掉了）。
+     */
+    template<class T, bool ThreadSafe = true>
+    class ObjectPool {
+    private:
+        static constexpr size_t CacheLine = 64;
+        static constexpr size_t SlotAlign = alignof(T) > alignof(void*) ? alignof(T) : alignof(void*);
+        static constexpr size_t LiveOffset = sizeof(T) > sizeof(void*) ? sizeof(T) : sizeof(void*);
+        static constexpr size_t SlotSize = (LiveOffset + 1 + SlotAlign - 1) & ~(SlotAlign - 1);
+        static constexpr size_t DataAlign = SlotAlign > CacheLine ? SlotAlign : CacheLine;
+        static constexpr size_t DefaultChunkBytes = 16 * 1024;
+        static constexpr uint32_t MagazineSize = 32;
+        static constexpr uint32_t MagazineWays = 4;
+
+        struct free_slot_t {
+            free_slot_t*    next;
+        };
+
+        struct chunk_t {
+            chunk_t*    next;
+            uint8_t*    slots;      // DataAlign 对齐
+            uint32_t    count;
+            uint32_t    used;       // 已经切出去过的槽数，只增不减
+        };
+
+        struct magazine_t {
+            uint64_t    poolId;
+            uint32_t    count;
+            void*       slots[MagazineSize];
+        };
+
+        using mutex_t = std::conditional_t<ThreadSafe, AdaptiveMutex, NullMutex>;
+
+        /**
+         * @brief 活着的线程安全池，线程退出或者弹匣换主人时，旧槽要还给还活着的池
+         *  故意不释放，线程的 thread_local 可能比它析构得晚
+         */
+        struct registry_t {
+            std::mutex                              mutex;
+            std::unordered_map<uint64_t, ObjectPool*> pools;
+            std::atomic<uint64_t>                   nextId { 1 };
+        };
+
+        static registry_t& Registry() {
+            static registry_t* registry = new registry_t();
+            return *registry;
+        }
+
+        // 把弹匣里的槽还给它的主人，主人已经没了就丢掉
+        static void Flush(magazine_t& magazine) {
+            if(magazine.count) {
+                registry_t& registry = Registry();
+                std::lock_guard<std::mutex> lock(registry.mutex);
+                auto iter = registry.pools.find(magazine.poolId);
+                if(iter != registry.pools.end()) {
+                    iter->second->releaseBatch(magazine.slots, magazine.count);
+                }
+            }
+            magazine.poolId = 0;
+            magazine.count = 0;
+        }
+
+        struct thread_cache_t {
+            magazine_t  magazines[MagazineWays] = {};
+            ~thread_cache_t() {
+                for(auto& magazine : magazines) {
+                    Flush(magazine);
+                }
+            }
+        };
+
+        inline static thread_local thread_cache_t ThreadCache;
+
+    private:
+        mutex_t         _mutex;
+        free_slot_t*    _freeList;
+        chunk_t*        _chunks;        // 最新的块在最前面，只有它还可能有没切过的槽
+        uint32_t        _chunkObjects;
+        bool            _threadCache;
+        uint64_t        _id;
+
+    private:
+        static uint8_t& liveFlag(void* slot) {
+            return ((uint8_t*)slot)[LiveOffset];
+        }
+
+        static void setLive(void* slot, uint8_t live) {
+            std::atomic_ref<uint8_t>(liveFlag(slot)).store(live, std::memory_order_relaxed);
+        }
+
+        static bool isLive(void* slot) {
+            return std::atomic_ref<uint8_t>(liveFlag(slot)).load(std::memory_order_relaxed) != 0;
+        }
+
+        // ASan 下空闲的槽除了头上的链表指针都标成不可访问，销毁之后还在用对象能被查出来
+        static void poisonSlot([[maybe_unused]] void* slot) {
+        #if LWC_OBJECT_POOL_ASAN
+            ASAN_POISON_MEMORY_REGION((uint8_t*)slot + sizeof(void*), LiveOffset - sizeof(void*));
+        #endif
+        }
+
+        static void unpoisonSlot([[maybe_unused]] void* slot) {
+        #if LWC_OBJECT_POOL_ASAN
+            ASAN_UNPOISON_MEMORY_REGION(slot, LiveOffset);
+        #endif
+        }
+
+        // 锁内调用
+        void* takeSlot() {
+            if(_freeList) {
+                free_slot_t* slot = _freeList;
+                _freeList = slot->next;
+                return slot;
+            }
+            if(!_chunks || _chunks->used == _chunks->count) {
+                size_t bytes = sizeof(chunk_t) + DataAlign - 1 + SlotSize * _chunkObjects;
+                chunk_t* chunk = (chunk_t*)comm_alloc(bytes);
+                if(!chunk) {
+                    return nullptr;
+                }
+                chunk->next = _chunks;
+                chunk->slots = (uint8_t*)(((uintptr_t)(chunk + 1) + DataAlign - 1) & ~(uintptr_t)(DataAlign - 1));
+                chunk->count = _chunkObjects;
+                chunk->used = 0;
+                _chunks = chunk;
+            }
+            void* slot = _chunks->slots + SlotSize * _chunks->used++;
+            liveFlag(slot) = 0;
+            return slot;
+        }
+
+        void giveSlot(void* slot) {
+            free_slot_t* node = (free_slot_t*)slot;
+            node->next = _freeList;
+            _freeList = node;
+        }
+
+        uint32_t acquireBatch(void** slots, uint32_t count) {
+            std::lock_guard<mutex_t> lock(_mutex);
+            uint32_t taken = 0;
+            while(taken < count) {
+                void* slot = takeSlot();
+                if(!slot) {
+                    break;
+                }
+                slots[taken++] = slot;
+            }
+            return taken;
+        }
+
+        void releaseBatch(void* const* slots, uint32_t count) {
+            std::lock_guard<mutex_t> lock(_mutex);
+            for(uint32_t i = 0; i < count; ++i) {
+                giveSlot(slots[i]);
+            }
+        }
+
+        magazine_t& localMagazine() {
+            magazine_t& magazine = ThreadCache.magazines[_id & (MagazineWays - 1)];
+            if(magazine.poolId != _id) {
+                Flush(magazine);
+                magazine.poolId = _id;
+            }
+            return magazine;
+        }
+
+        void* acquireSlot() {
+            if constexpr (ThreadSafe) {
+                if(_threadCache) {
+                    magazine_t& magazine = localMagazine();
+                    if(!magazine.count) {
+                        magazine.count = acquireBatch(magazine.slots, MagazineSize / 2);
+                        if(!magazine.count) {
+                            return nullptr;
+                        }
+                    }
+                    return magazine.slots[--magazine.count];
+                }
+            }
+            std::lock_guard<mutex_t> lock(_mutex);
+            return takeSlot();
+        }
+
+        void releaseSlot(void* slot) {
+            if constexpr (ThreadSafe) {
+                if(_threadCache) {
+                    magazine_t& magazine = localMagazine();
+                    if(magazine.count == MagazineSize) {
+                        magazine.count -= MagazineSize / 2;
+                        releaseBatch(magazine.slots + magazine.count, MagazineSize / 2);
+                    }
+                    magazine.slots[magazine.count++] = slot;
+                    return;
+                }
+            }
+            std::lock_guard<mutex_t> lock(_mutex);
+            giveSlot(slot);
+        }
+
+    public:
+        /**
+         * @brief chunkObjects 为 0 时每块大约 16KB；threadCache 只在 ThreadSafe 时有效
+         */
+        explicit ObjectPool(uint32_t chunkObjects = 0, bool threadCache = false)
+            : _mutex()
+            , _freeList(nullptr)
+            , _chunks(nullptr)
+            , _chunkObjects(chunkObjects ? chunkObjects : (uint32_t)(DefaultChunkBytes / SlotSize > 8 ? DefaultChunkBytes / SlotSize : 8))
+            , _threadCache(ThreadSafe && threadCache)
+            , _id(0)
+        {
+            if constexpr (ThreadSafe) {
+                registry_t& registry = Registry();
+                std::lock_guard<std::mutex> lock(registry.mutex);
+                _id = registry.nextId++;
+                registry.pools[_id] = this;
+            }
+        }
+
+        ObjectPool(ObjectPool&& pool) requires (!ThreadSafe)
+            : _mutex()
+            , _freeList(pool._freeList)
+            , _chunks(pool._chunks)
+            , _chunkObjects(pool._chunkObjects)
+            , _threadCache(false)
+            , _id(0)
+        {
+            pool._freeList = nullptr;
+            pool._chunks = nullptr;
+        }
+
+        ObjectPool(ObjectPool const&) = delete;
+        ObjectPool& operator = (ObjectPool const&) = delete;
+
+        // 还活着的对象会被析构
+        ~ObjectPool() {
+            if constexpr (ThreadSafe) {
+                registry_t& registry = Registry();
+                std::lock_guard<std::mutex> lock(registry.mutex);
+                registry.pools.erase(_id);
+            }
+            forEach([](T& object) {
+                object.~T();
+            });
+            while(_chunks) {
+                chunk_t* next = _chunks->next;
+            #if LWC_OBJECT_POOL_ASAN
+                ASAN_UNPOISON_MEMORY_REGION(_chunks, sizeof(chunk_t) + DataAlign - 1 + SlotSize * _chunks->count);
+            #endif
+                comm_free(_chunks);
+                _chunks = next;
+            }
+        }
+
+        template<class... Args>
+        T* create(Args&&... args) {
+            void* slot = acquireSlot();
+            if(!slot) {
+                return nullptr;
+            }
+            unpoisonSlot(slot);
+            T* object = new (slot) T(std::forward<Args>(args)...);
+            setLive(slot, 1);
+            return object;
+        }
+
+        void destroy(T* object) {
+            object->~T();
+            setLive(object, 0);
+            poisonSlot(object);
+            releaseSlot(object);
+        }
+
+        /**
+         * @brief 一次进锁拿 count 个槽，每个都用同样的参数构造；返回实际创建的个数（内存不够时会少）
+         */
+        template<class... Args>
+        size_t createN(T** objects, size_t count, Args const&... args) {
+            size_t created = 0;
+            while(created < count) {
+                uint32_t batch = (uint32_t)(count - created < MagazineSize ? count - created : MagazineSize);
+                uint32_t taken = acquireBatch((void**)(objects + created), batch);
+                for(uint32_t i = 0; i < taken; ++i) {
+                    void* slot = objects[created + i];
+                    unpoisonSlot(slot);
+                    objects[created + i] = new (slot) T(args...);
+                    setLive(slot, 1);
+                }
+                created += taken;
+                if(taken < batch) {
+                    break;
+                }
+            }
+            return created;
+        }
+
+        void destroyN(T* const* objects, size_t count) {
+            for(size_t i = 0; i < count; ++i) {
+                objects[i]->~T();
+                setLive(objects[i], 0);
+                poisonSlot(objects[i]);
+            }
+            std::lock_guard<mutex_t> lock(_mutex);
+            for(size_t i = 0; i < count; ++i) {
+                giveSlot(objects[i]);
+            }
+        }
+
+        /**
+         * @brief 遍历活着的对象，期间不能有其它线程 create/destroy
+         */
+        template<class F>
+        void forEach(F&& function) {
+            std::lock_guard<mutex_t> lock(_mutex);
+            for(chunk_t* chunk = _chunks; chunk; chunk = chunk->next) {
+                for(uint32_t i = 0; i < chunk->used; ++i) {
+                    void* slot = chunk->slots + SlotSize * i;
+                    if(isLive(slot)) {
+                        function(*(T*)slot);
+                    }
+                }
+            }
+        }
+
+        ObjectPoolStats stats() {
+            ObjectPoolStats stats = {};
+            std::lock_guard<mutex_t> lock(_mutex);
+            for(chunk_t* chunk = _chunks; chunk; chunk = chunk->next) {
+                ++stats.chunks;
+                stats.capacity += chunk->count;
+                stats.bytesReserved += sizeof(chunk_t) + DataAlign - 1 + SlotSize * chunk->count;
+                for(uint32_t i = 0; i < chunk->used; ++i) {
+                    stats.live += isLive(chunk->slots + SlotSize * i);
+                }
+            }
+            return stats;
+        }
+    };
+
+}
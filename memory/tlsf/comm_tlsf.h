@@ -3,7 +3,13 @@
 #include <cassert>
 #include <unordered_map>
 #include <cmath>
+#include <algorithm>
+#include <type_traits>
+#include <vector>
+#include <cstdio>
 #include "fls.h"
+#include "../object_pool.h"
+#include "../../profile/profiler.h"
 
 namespace comm {
 
@@ -76,15 +82,50 @@ namespace comm {
             }
         };
 
-        struct node_t {
-            node_t*       prevPhy;
-            node_t*       nextPhy;
+        // OffsetT 为 uint32_t 时和原来一样是 40 字节，uint64_t 时 48 字节
+        template<class OffsetT>
+        struct basic_node_t {
+            basic_node_t*   prevPhy;
+            basic_node_t*   nextPhy;
             //
-            node_t*       prev;
-            node_t*       next;
-            uint32_t      offset;
-            uint32_t      size : 31;
-            uint32_t      free : 1;
+            basic_node_t*   prev;
+            basic_node_t*   next;
+            OffsetT         offset;
+            OffsetT         size : sizeof(OffsetT) * 8 - 1;
+            OffsetT         free : 1;
+        };
+
+        struct PoolStats {
+            size_t      usedBytes;                  // 已分配块的大小之和（按块算，包括级别取整多出来的部分）
+            size_t      freeBytes;
+            uint32_t    allocationCount;
+            uint32_t    freeBlockCount;
+            size_t      alignedAllocations;         // 下面三项是累计值：alloc(size, alignment) 的次数
+            size_t      alignmentPaddingReturned;   // 对齐时切下来、还回空闲链表的前导字节
+            size_t      alignmentPaddingLost;       // 前导字节太小切不下来，并到了前一块里
+        };
+
+        struct BlockInfo {
+            uint64_t    offset;
+            uint64_t    size;
+            bool        free;
+        };
+
+        // 空闲链表里一个 (firstLevel, secondLevel) 桶的情况，只列非空的桶
+        struct FreeLevelBucket {
+            uint16_t    firstLevel;
+            uint16_t    secondLevel;
+            uint32_t    count;
+            uint64_t    bytes;
+            uint64_t    minBlock;
+            uint64_t    maxBlock;
+        };
+
+        struct PoolReport {
+            PoolStats                       stats;
+            uint64_t                        largestFreeBlock;
+            double                          fragmentation;      // 1 - 最大空闲块 / 空闲总量，0 表示空闲内存是连续的一整块
+            std::vector<FreeLevelBucket>    freeHistogram;
         };
 
         // struct pool_t {
@@ -111,32 +152,46 @@ namespace comm {
             {}
         };
 
-        class Pool {
+        /**
+         * @brief OffsetT 是偏移和大小的宽度：uint32_t 管 2GB 以内的堆，uint64_t 管更大的虚拟内存、显存堆
+         */
+        template<class OffsetT>
+        class BasicPool {
+            static_assert(std::is_same_v<OffsetT, uint32_t> || std::is_same_v<OffsetT, uint64_t>, "OffsetT must be uint32_t or uint64_t");
         public:
+            using node_t = basic_node_t<OffsetT>;
+            constexpr static OffsetT InvalidOffset = ~(OffsetT)0;
             constexpr static size_t MinimiumAllocationSize = 16;                                // minimium allocation & alignment size
-            constexpr static size_t FLC = sizeof(uint32_t) * 8 - 1;								// first level count max
+            constexpr static size_t FLC = sizeof(OffsetT) * 8 - 1;								// first level count max
             constexpr static size_t SLI = 5;                                                    // second level index bit count
             constexpr static size_t SLC = 1 << SLI;                                             // count of the segments per-first level
             constexpr static size_t FLM = MinimiumAllocationSize<<SLI;                          // first level max
             uint32_t BasePowLevel = tlsf_fls_sizet(FLM);
         private:
-            uint32_t                                    _1stBitmap;
-            Array<uint32_t, 31>                         _2ndBitmap;
-            Array<Array<node_t*, SLC>, 31>              _allocationTable;
-            std::unordered_map<uint32_t, node_t*>       _allocationMap;
+            OffsetT                                     _1stBitmap;
+            Array<uint32_t, FLC>                        _2ndBitmap;
+            Array<Array<node_t*, SLC>, FLC>             _allocationTable;
+            std::unordered_map<OffsetT, node_t*>        _allocationMap;
             node_t*                                     _head;
+            ObjectPool<node_t, false>                   _nodePool;      // Pool 本身不跨线程，节点池不用加锁
+            size_t                                      _alignedAllocations;
+            size_t                                      _alignmentPaddingReturned;
+            size_t                                      _alignmentPaddingLost;
             //
             node_t* createNode() {
-                return new node_t();
+                return _nodePool.create();
             }
             void destroyNode(node_t* node) {
-                delete node;
+                _nodePool.destroy(node);
             }
         public:
-            Pool(uint32_t size)
+            BasicPool(OffsetT size)
                 : _1stBitmap(0)
                 , _2ndBitmap{}
                 , _allocationTable{}
+                , _alignedAllocations(0)
+                , _alignmentPaddingReturned(0)
+                , _alignmentPaddingLost(0)
             {
                 node_t* node = createNode();
                 node->size = size;
@@ -148,13 +203,28 @@ namespace comm {
                 _head = node;
             }
 
-            Pool(Pool&& pool)
+            BasicPool(BasicPool&& pool)
                 : _1stBitmap(pool._1stBitmap)
                 , _2ndBitmap(std::move(pool._2ndBitmap))
                 , _allocationTable(std::move(pool._allocationTable))
                 , _allocationMap(std::move(pool._allocationMap))
                 , _head(pool._head)
+                , _nodePool(std::move(pool._nodePool))
+                , _alignedAllocations(pool._alignedAllocations)
+                , _alignmentPaddingReturned(pool._alignmentPaddingReturned)
+                , _alignmentPaddingLost(pool._alignmentPaddingLost)
             {
+                pool._head = nullptr;
+            }
+
+            // 第一个物理块永远不会被合并掉（合并总是并到前一块上），从它开始能走完所有节点
+            ~BasicPool() {
+                node_t* node = _head;
+                while(node) {
+                    node_t* next = node->nextPhy;
+                    destroyNode(node);
+                    node = next;
+                }
             }
 
             bitmap_level_t queryBitmapLevelForAlloc(size_t size) {
@@ -241,10 +311,10 @@ namespace comm {
 
             //  看这个级别是不是有空闲块
             bool queryFreeStatus( bitmap_level_t level ) {
-                if(!(_1stBitmap & (1<<level.firstLevel)) ) {
+                if(!(_1stBitmap & ((OffsetT)1<<level.firstLevel)) ) {
                     return false;
                 }
-                uint32_t rst = _2ndBitmap[level.firstLevel] & (1<<level.secondLevel);
+                uint32_t rst = _2ndBitmap[level.firstLevel] & (1u<<level.secondLevel);
                 if(rst != 0) {
                     return true;
                 }
@@ -253,7 +323,7 @@ namespace comm {
 
             bitmap_level_t findLevelForSplit( bitmap_level_t baseLevel ) {
                 for( uint16_t firstLevel = baseLevel.firstLevel; firstLevel < FLC; ++firstLevel) {
-                    if(!(_1stBitmap&(1<<firstLevel))) {
+                    if(!(_1stBitmap&((OffsetT)1<<firstLevel))) {
                         baseLevel.secondLevel = 0;
                         continue;
                     }
@@ -277,9 +347,9 @@ namespace comm {
                     nextFreeAlloc->prev = nullptr;
                 } else {
                     // 如果这一级分配了之后就没有空间的内存块了，那么更新 bitmap
-                    _2ndBitmap[level.firstLevel] &= ~(1<<level.secondLevel);
+                    _2ndBitmap[level.firstLevel] &= ~(1u<<level.secondLevel);
                     if( 0 == _2ndBitmap[level.firstLevel]) {
-                        _1stBitmap &= ~(1<<level.firstLevel);
+                        _1stBitmap &= ~((OffsetT)1<<level.firstLevel);
                     }
                 }
                 return originHeader;
@@ -300,9 +370,9 @@ namespace comm {
                     nextFreeAlloc->prev = prevFreeAlloc;
                 }
                 if( nullptr == *levelHeaderPtr) { // 需要更新bitmap
-                    _2ndBitmap[level.firstLevel] &= ~(1<<level.secondLevel);
+                    _2ndBitmap[level.firstLevel] &= ~(1u<<level.secondLevel);
                     if( 0 == _2ndBitmap[level.firstLevel]) {
-                        _1stBitmap &= ~(1<<level.firstLevel);
+                        _1stBitmap &= ~((OffsetT)1<<level.firstLevel);
                     }
                 }
             }
@@ -320,9 +390,9 @@ namespace comm {
                     nextFreeAlloc->prev = prevFreeAlloc;
                 }
                 if( nullptr == *levelHeaderPtr) { // 需要更新bitmap
-                    _2ndBitmap[level.firstLevel] &= ~(1<<level.secondLevel);
+                    _2ndBitmap[level.firstLevel] &= ~(1u<<level.secondLevel);
                     if( 0 == _2ndBitmap[level.firstLevel]) {
-                        _1stBitmap &= ~(1<<level.firstLevel);
+                        _1stBitmap &= ~((OffsetT)1<<level.firstLevel);
                     }
                 }
             }
@@ -363,8 +433,8 @@ namespace comm {
                 allocation->next = originHeader;
                 allocation->prev = nullptr;
                 if(!originHeader) { // update bitmap if need
-                    _2ndBitmap[level.firstLevel] |= 1<<level.secondLevel;
-                    _1stBitmap |= 1<<(level.firstLevel);
+                    _2ndBitmap[level.firstLevel] |= 1u<<level.secondLevel;
+                    _1stBitmap |= (OffsetT)1<<level.firstLevel;
                 } else {
                     originHeader->prev = allocation;
                 }
@@ -417,10 +487,46 @@ namespace comm {
                 return nullptr;
             }
 
-            uint32_t alloc( size_t size ) {
+            // 找一个不小于 size 的空闲块，从空闲链表里摘下来，不切分
+            node_t* takeFreeBlock( size_t size ) {
+                bitmap_level_t level = queryBitmapLevelForAlloc(size);
+                if(level.firstLevel >= FLC) {
+                    return nullptr;
+                }
+                if(queryFreeStatus(level)) {
+                    return queryAllocationWithFreeLevel(level);
+                }
+                bitmap_level_t found = findLevelForSplit({level.firstLevel, (uint16_t)(level.secondLevel + 1)});
+                if(!found.valid()) {
+                    found = findLevelForSplit({(uint16_t)(level.firstLevel + 1), 0});
+                }
+                if(!found.valid()) {
+                    return nullptr;
+                }
+                return queryAllocationWithFreeLevel(found);
+            }
+
+            // 把空闲块 node 从 offset 处切成两块，返回后一块；两块都不在空闲链表里
+            node_t* splitAt( node_t* node, OffsetT offset ) {
+                node_t* back = createNode();
+                back->offset = offset;
+                back->size = node->size - (offset - node->offset);
+                back->free = 1;
+                back->prevPhy = node;
+                back->nextPhy = node->nextPhy;
+                if(back->nextPhy) {
+                    back->nextPhy->prevPhy = back;
+                }
+                node->nextPhy = back;
+                node->size = offset - node->offset;
+                return back;
+            }
+
+            OffsetT alloc( size_t size ) {
+                LWC_PROFILE_ZONE("tlsf::Pool::alloc");
                 auto node = queryFreeAllocation(size);
                 if(!node) {
-                    return ~0;
+                    return InvalidOffset;
                 } else {
                     _allocationMap[node->offset] = node;
                     node->free = 0;
@@ -428,32 +534,230 @@ namespace comm {
                 }
             }
 
-            uint32_t realloc( uint32_t offset, size_t size ) {
-                node_t* node = _allocationMap[offset];
-                assert(node);
-                node_t* nextPhyAlloc = node->nextPhy;
-                if(nextPhyAlloc && nextPhyAlloc->free) {
-                    size_t alignedLevelSize = queryAlignedLevelSize(size);
-                    size_t mergedSize = nextPhyAlloc->size + node->size;
-                    if( (mergedSize >= size) && (mergedSize < alignedLevelSize) ) {
-                        removeFreeAllocationAndUpdateBitmap(nextPhyAlloc);
-                        node->size = mergedSize;
-                        return offset;
+            /**
+             * @brief 按 alignment（2 的幂）对齐分配，给 GPU 缓冲区这类要 256B、64KB 对齐的子分配用
+             *  按 size + alignment 找空闲块，对齐前面空出来的部分切下来还回空闲链表，后面多的也切掉，不会白白浪费。
+             *  空闲块的物理邻居一定是已分配的（释放时都合并过了），切下来的两头直接插回空闲链表，不用再合并。
+             *  realloc 挪位置的时候不保证对齐。
+             */
+            OffsetT alloc( size_t size, size_t alignment ) {
+                if(alignment <= MinimiumAllocationSize) {
+                    return alloc(size);
+                }
+                LWC_PROFILE_ZONE("tlsf::Pool::allocAligned");
+                assert((alignment & (alignment - 1)) == 0);
+                size = (std::max(size, MinimiumAllocationSize) + MinimiumAllocationSize - 1) & ~(MinimiumAllocationSize - 1);
+                node_t* node = takeFreeBlock(size + alignment);
+                if(!node) {
+                    return InvalidOffset;
+                }
+                ++_alignedAllocations;
+                OffsetT aligned = (OffsetT)((node->offset + alignment - 1) & ~(alignment - 1));
+                OffsetT padding = aligned - node->offset;
+                if(padding >= MinimiumAllocationSize) {
+                    node_t* body = splitAt(node, aligned);
+                    insertFreeAllocation(node);
+                    node = body;
+                    _alignmentPaddingReturned += padding;
+                } else if(padding) {
+                    // 偏移都是 MinimiumAllocationSize 的倍数时不会走到这里；前一块一定是已分配的，让它多占一点
+                    assert(node->prevPhy && !node->prevPhy->free);
+                    node->prevPhy->size += padding;
+                    node->offset = aligned;
+                    node->size -= padding;
+                    _alignmentPaddingLost += padding;
+                }
+                if(node->size - size >= MinimiumAllocationSize) {
+                    node_t* tail = splitAt(node, node->offset + (OffsetT)size);
+                    insertFreeAllocation(tail);
+                }
+                _allocationMap[node->offset] = node;
+                node->free = 0;
+                return node->offset;
+            }
+
+            PoolStats stats() const {
+                PoolStats stats = {};
+                for(node_t* node = _head; node; node = node->nextPhy) {
+                    if(node->free) {
+                        stats.freeBytes += node->size;
+                        ++stats.freeBlockCount;
+                    } else {
+                        stats.usedBytes += node->size;
+                        ++stats.allocationCount;
                     }
                 }
-                insertFreeAllocation(node, true); // 回收旧的，分配新的
-                node->free = 1;
-                _allocationMap.erase(offset);
-                return alloc(size);
+                stats.alignedAllocations = _alignedAllocations;
+                stats.alignmentPaddingReturned = _alignmentPaddingReturned;
+                stats.alignmentPaddingLost = _alignmentPaddingLost;
+                return stats;
+            }
+
+            /**
+             * @brief 按物理顺序遍历所有块，visitor(BlockInfo const&)；只读，遍历期间不能分配释放
+             */
+            template<class F>
+            void walk( F&& visitor ) const {
+                for(node_t* node = _head; node; node = node->nextPhy) {
+                    visitor(BlockInfo{ node->offset, node->size, node->free != 0 });
+                }
             }
 
-            bool free( uint32_t offset ) {
+            PoolReport report() const {
+                PoolReport report = {};
+                report.stats = stats();
+                walk([&](BlockInfo const& block) {
+                    if(block.free) {
+                        report.largestFreeBlock = std::max(report.largestFreeBlock, block.size);
+                    }
+                });
+                report.fragmentation = report.stats.freeBytes ? 1.0 - (double)report.largestFreeBlock / (double)report.stats.freeBytes : 0.0;
+                for(uint16_t firstLevel = 0; firstLevel < FLC; ++firstLevel) {
+                    if(!(_1stBitmap & ((OffsetT)1<<firstLevel))) {
+                        continue;
+                    }
+                    for(uint16_t secondLevel = 0; secondLevel < SLC; ++secondLevel) {
+                        node_t* node = _allocationTable[firstLevel][secondLevel];
+                        if(!node) {
+                            continue;
+                        }
+                        FreeLevelBucket bucket = { firstLevel, secondLevel, 0, 0, ~(uint64_t)0, 0 };
+                        for(; node; node = node->next) {
+                            ++bucket.count;
+                            bucket.bytes += node->size;
+                            bucket.minBlock = std::min<uint64_t>(bucket.minBlock, node->size);
+                            bucket.maxBlock = std::max<uint64_t>(bucket.maxBlock, node->size);
+                        }
+                        report.freeHistogram.push_back(bucket);
+                    }
+                }
+                return report;
+            }
+
+            /**
+             * @brief 把汇总、空闲桶和每个物理块写成 JSON，线上抓到因为碎片分配失败时拿回来分析
+             *  blocks 是 [offset, size, free] 的数组，按物理顺序
+             */
+            bool writeHeapDump( char const* path ) const {
+                FILE* file = fopen(path, "wb");
+                if(!file) {
+                    return false;
+                }
+                PoolReport info = report();
+                fprintf(file, "{\"offsetBits\":%u,\"usedBytes\":%llu,\"freeBytes\":%llu,\"allocationCount\":%u,\"freeBlockCount\":%u,"
+                    "\"largestFreeBlock\":%llu,\"fragmentation\":%.6f,\"alignedAllocations\":%llu,\"alignmentPaddingReturned\":%llu,\"alignmentPaddingLost\":%llu,\n",
+                    (unsigned)(sizeof(OffsetT) * 8), (unsigned long long)info.stats.usedBytes, (unsigned long long)info.stats.freeBytes,
+                    info.stats.allocationCount, info.stats.freeBlockCount, (unsigned long long)info.largestFreeBlock, info.fragmentation,
+                    (unsigned long long)info.stats.alignedAllocations, (unsigned long long)info.stats.alignmentPaddingReturned,
+                    (unsigned long long)info.stats.alignmentPaddingLost);
+                fprintf(file, "\"freeHistogram\":[");
+                for(size_t i = 0; i < info.freeHistogram.size(); ++i) {
+                    auto const& bucket = info.freeHistogram[i];
+                    fprintf(file, "%s\n{\"fl\":%u,\"sl\":%u,\"count\":%u,\"bytes\":%llu,\"min\":%llu,\"max\":%llu}", i ? "," : "",
+                        bucket.firstLevel, bucket.secondLevel, bucket.count, (unsigned long long)bucket.bytes,
+                        (unsigned long long)bucket.minBlock, (unsigned long long)bucket.maxBlock);
+                }
+                fprintf(file, "],\n\"blocks\":[");
+                bool first = true;
+                walk([&](BlockInfo const& block) {
+                    fprintf(file, "%s[%llu,%llu,%d]", first ? "" : ",", (unsigned long long)block.offset, (unsigned long long)block.size, block.free ? 1 : 0);
+                    first = false;
+                });
+                fprintf(file, "]}\n");
+                bool succeeded = !ferror(file);
+                fclose(file);
+                return succeeded;
+            }
+
+            // 吞掉紧跟在 node 后面的空闲块
+            void absorbNext( node_t* node ) {
+                node_t* next = node->nextPhy;
+                removeFreeAllocationAndUpdateBitmap(next);
+                node->size += next->size;
+                node->nextPhy = next->nextPhy;
+                if(node->nextPhy) {
+                    node->nextPhy->prevPhy = node;
+                }
+                destroyNode(next);
+            }
+
+            // 已分配的 node 只留 size 字节，多出来的尾巴（够一个最小块的话）切下来还回空闲链表
+            void releaseTail( node_t* node, size_t size ) {
+                if(node->size - size >= MinimiumAllocationSize) {
+                    node_t* tail = splitAt(node, node->offset + (OffsetT)size);
+                    insertFreeAllocation(tail, true);
+                }
+            }
+
+            /**
+             * @brief 尽量原地调整大小：
+             *  缩小时把尾巴切下来还回去；变大时先吞后面的空闲邻居，不够再连前面的空闲邻居一起吞（起始偏移会前移）；
+             *  都不够才另外分配一块再释放旧的。moved 为 true 时调用方要把数据搬到新偏移，
+             *  往前扩的时候新旧区域会重叠，要用 memmove。失败时返回 InvalidOffset，原来的块保持不动。
+             *  对齐分配的块挪位置之后不再保证对齐。
+             */
+            OffsetT realloc( OffsetT offset, size_t size, bool& moved ) {
+                LWC_PROFILE_ZONE("tlsf::Pool::realloc");
+                moved = false;
+                auto iter = _allocationMap.find(offset);
+                assert(iter != _allocationMap.end());
+                node_t* node = iter->second;
+                size = (std::max(size, MinimiumAllocationSize) + MinimiumAllocationSize - 1) & ~(MinimiumAllocationSize - 1);
+                if(size <= node->size) {
+                    releaseTail(node, size);
+                    return offset;
+                }
+                node_t* next = node->nextPhy;
+                node_t* prev = node->prevPhy;
+                size_t nextFree = (next && next->free) ? (size_t)next->size : 0;
+                if(node->size + nextFree >= size) {
+                    absorbNext(node);
+                    releaseTail(node, size);
+                    return offset;
+                }
+                size_t prevFree = (prev && prev->free) ? (size_t)prev->size : 0;
+                if(prevFree && prevFree + node->size + nextFree >= size) {
+                    if(nextFree) {
+                        absorbNext(node);
+                    }
+                    // 前面的空闲块接管整段，node 并进去
+                    removeFreeAllocationAndUpdateBitmap(prev);
+                    _allocationMap.erase(iter);
+                    prev->size += node->size;
+                    prev->nextPhy = node->nextPhy;
+                    if(prev->nextPhy) {
+                        prev->nextPhy->prevPhy = prev;
+                    }
+                    destroyNode(node);
+                    prev->free = 0;
+                    releaseTail(prev, size);
+                    _allocationMap[prev->offset] = prev;
+                    moved = true;
+                    return prev->offset;
+                }
+                // 原地放不下：先分配新的，成功了再释放旧的，失败时旧数据还在
+                OffsetT newOffset = alloc(size);
+                if(newOffset == InvalidOffset) {
+                    return InvalidOffset;
+                }
+                free(offset);
+                moved = true;
+                return newOffset;
+            }
+
+            OffsetT realloc( OffsetT offset, size_t size ) {
+                bool moved;
+                return realloc(offset, size, moved);
+            }
+
+            bool free( OffsetT offset ) {
+                LWC_PROFILE_ZONE("tlsf::Pool::free");
                 node_t* node = _allocationMap[offset];
                 assert(node);
                 if(node) {
-                    insertFreeAllocation(node, true);
-                    node->free = 1;
                     _allocationMap.erase(offset);
+                    node->free = 1;
+                    insertFreeAllocation(node, true);
                     return true;
                 } else {
                     return false;
@@ -462,6 +766,9 @@ namespace comm {
 
         };
 
+        using Pool = BasicPool<uint32_t>;
+        using Pool64 = BasicPool<uint64_t>;
+
     }
 
 }
\ No newline at end of file
@@ -0,0 +1,165 @@
+#include "virtual_arena.h"
+#include <cassert>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace comm {
+
+    namespace {
+        size_t RoundUp(size_t value, size_t granularity) {
+            return (value + granularity - 1) & ~(granularity - 1);
+        }
+    }
+
+    VirtualArena::VirtualArena()
+        : _base(nullptr)
+        , _reserved(0)
+        , _committed(0)
+        , _used(0)
+        , _granularity(DefaultGranularity)
+        , _mapping(nullptr)
+        , _mappingSize(0)
+    {}
+
+#ifdef _WIN32
+    bool VirtualArena::reserve(size_t bytes, bool hugePages) {
+        release();
+        // windows 的大页要 SeLockMemoryPrivilege 而且不能按需提交，这里只把粒度放大
+        _granularity = hugePages ? HugePageSize : DefaultGranularity;
+        bytes = RoundUp(bytes, _granularity);
+        if(!bytes) {
+            return false;
+        }
+        void* ptr = VirtualAlloc(nullptr, bytes, MEM_RESERVE, PAGE_NOACCESS);
+        if(!ptr) {
+            return false;
+        }
+        _mapping = ptr;
+        _mappingSize = bytes;
+        _base = (uint8_t*)ptr;
+        _reserved = bytes;
+        return true;
+    }
+
+    void VirtualArena::release() {
+        if(_mapping) {
+            VirtualFree(_mapping, 0, MEM_RELEASE);
+        }
+        _base = nullptr;
+        _mapping = nullptr;
+        _mappingSize = 0;
+        _reserved = _committed = _used = 0;
+    }
+
+    bool VirtualArena::commit(size_t bytes) {
+        if(bytes <= _committed) {
+            return true;
+        }
+        if(bytes > _reserved) {
+            return false;
+        }
+        size_t target = RoundUp(bytes, _granularity);
+        if(!VirtualAlloc(_base + _committed, target - _committed, MEM_COMMIT, PAGE_READWRITE)) {
+            return false;
+        }
+        _committed = target;
+        return true;
+    }
+
+    void VirtualArena::decommit(size_t bytes) {
+        size_t target = RoundUp(bytes, _granularity);
+        if(target >= _committed) {
+            return;
+        }
+        VirtualFree(_base + target, _committed - target, MEM_DECOMMIT);
+        _committed = target;
+        if(_used > target) {
+            _used = target;
+        }
+    }
+#else
+    bool VirtualArena::reserve(size_t bytes, bool hugePages) {
+        release();
+        size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+        _granularity = hugePages ? HugePageSize : (DefaultGranularity > pageSize ? DefaultGranularity : pageSize);
+        bytes = RoundUp(bytes, _granularity);
+        if(!bytes) {
+            return false;
+        }
+        // 大页要求起点 2MB 对齐，多保留一个大页的地址再从中间挑对齐的起点
+        size_t mappingSize = hugePages ? bytes + HugePageSize : bytes;
+        void* ptr = mmap(nullptr, mappingSize, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if(ptr == MAP_FAILED) {
+            return false;
+        }
+        _mapping = ptr;
+        _mappingSize = mappingSize;
+        _base = (uint8_t*)RoundUp((uintptr_t)ptr, hugePages ? HugePageSize : pageSize);
+        _reserved = bytes;
+    #ifdef MADV_HUGEPAGE
+        if(hugePages) {
+            // 只是提示，内核没开透明大页时失败也无所谓
+            madvise(_base, _reserved, MADV_HUGEPAGE);
+        }
+    #endif
+        return true;
+    }
+
+    void VirtualArena::release() {
+        if(_mapping) {
+            munmap(_mapping, _mappingSize);
+        }
+        _base = nullptr;
+        _mapping = nullptr;
+        _mappingSize = 0;
+        _reserved = _committed = _used = 0;
+    }
+
+    bool VirtualArena::commit(size_t bytes) {
+        if(bytes <= _committed) {
+            return true;
+        }
+        if(bytes > _reserved) {
+            return false;
+        }
+        size_t target = RoundUp(bytes, _granularity);
+        if(mprotect(_base + _committed, target - _committed, PROT_READ | PROT_WRITE) != 0) {
+            return false;
+        }
+        _committed = target;
+        return true;
+    }
+
+    void VirtualArena::decommit(size_t bytes) {
+        size_t target = RoundUp(bytes, _granularity);
+        if(target >= _committed) {
+            return;
+        }
+        // 先丢掉物理页（再访问会是全零的新页），再改回不可访问，越界用到的地方能立刻崩出来
+        madvise(_base + target, _committed - target, MADV_DONTNEED);
+        mprotect(_base + target, _committed - target, PROT_NONE);
+        _committed = target;
+        if(_used > target) {
+            _used = target;
+        }
+    }
+#endif
+
+    void* VirtualArena::alloc(size_t size, size_t alignment) {
+        assert(alignment && (alignment & (alignment - 1)) == 0);
+        size_t begin = RoundUp(_used, alignment);
+        if(begin > _reserved || size > _reserved - begin) {
+            return nullptr;
+        }
+        if(!commit(begin + size)) {
+            return nullptr;
+        }
+        _used = begin + size;
+        return _base + begin;
+    }
+
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+namespace comm {
+
+    /**
+     * @brief 先保留一大段地址空间、用到哪里再提交到哪里的内存区
+     *  保留时只占地址不占物理内存（linux 上 mmap PROT_NONE，windows 上 MEM_RESERVE），
+     *  commit() 按粒度把前面一段改成可读写，decommit() 把后面不用的还给系统（MADV_DONTNEED / MEM_DECOMMIT）。
+     *  起始地址一直不变，放在里面的缓冲区变大时不用搬数据，指针也不会失效。
+     *  hugePages 为 true 时按 2MB 对齐保留并提示内核用透明大页，提交粒度也变成 2MB。
+     *  不是线程安全的。
+     */
+    class VirtualArena {
+    private:
+        uint8_t*    _base;
+        size_t      _reserved;
+        size_t      _committed;
+        size_t      _used;          // alloc() 用掉的字节
+        size_t      _granularity;   // 提交的粒度
+        void*       _mapping;       // 实际 mmap 出来的起点，大页对齐时和 _base 不同
+        size_t      _mappingSize;
+    public:
+        static constexpr size_t HugePageSize = 2 * 1024 * 1024;
+        static constexpr size_t DefaultGranularity = 64 * 1024;
+
+        VirtualArena();
+        VirtualArena(VirtualArena const&) = delete;
+        VirtualArena& operator = (VirtualArena const&) = delete;
+        ~VirtualArena() { release(); }
+
+        bool reserve(size_t bytes, bool hugePages = false);
+        void release();
+
+        /**
+         * @brief 保证 [0, bytes) 可读写，超过保留的大小时返回 false
+         */
+        bool commit(size_t bytes);
+        /**
+         * @brief 只保留 [0, bytes) 的物理内存，后面的还给系统，地址仍然保留着
+         */
+        void decommit(size_t bytes);
+
+        /**
+         * @brief 在已用部分后面按 alignment 切一块，需要时自动 commit；空间不够返回 nullptr
+         */
+        void* alloc(size_t size, size_t alignment = alignof(std::max_align_t));
+        // alloc() 从头开始，已提交的内存留着复用
+        void reset() { _used = 0; }
+
+        uint8_t* data() const { return _base; }
+        size_t reserved() const { return _reserved; }
+        size_t committed() const { return _committed; }
+        size_t used() const { return _used; }
+        bool valid() const { return !!_base; }
+    };
+
+}
@@ -0,0 +1,152 @@
+#include "lock_stats.h"
+#include <algorithm>
+#include <mutex>
+
+namespace comm {
+
+#if LWC_LOCK_STATS
+
+    /**
+     * @brief 活着的 LockStats 串成一个双向链表，锁构造/析构时进出
+     *  用 std::mutex 而不是 AdaptiveMutex，免得统计自己的锁
+     */
+    struct lock_stats_registry_t {
+        std::mutex      mutex;
+        LockStats*      head = nullptr;
+
+        void add(LockStats* stats) {
+            std::lock_guard<std::mutex> lock(mutex);
+            stats->_prev = nullptr;
+            stats->_next = head;
+            if(head) {
+                head->_prev = stats;
+            }
+            head = stats;
+        }
+
+        template<class F>
+        void forEach(F&& function) {
+            std::lock_guard<std::mutex> lock(mutex);
+            for(LockStats* stats = head; stats; stats = stats->_next) {
+                function(*stats);
+            }
+        }
+
+        void remove(LockStats* stats) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if(stats->_prev) {
+                stats->_prev->_next = stats->_next;
+            } else {
+                head = stats->_next;
+            }
+            if(stats->_next) {
+                stats->_next->_prev = stats->_prev;
+            }
+        }
+    };
+
+    // 全局的锁可能在它之后才析构，所以不释放
+    static lock_stats_registry_t& LockStatsRegistry() {
+        static lock_stats_registry_t* registry = new lock_stats_registry_t();
+        return *registry;
+    }
+
+    LockStats::LockStats(char const* name, void const* owner)
+        : _name(name ? name : "")
+        , _owner(owner)
+        , _acquisitions(0)
+        , _contended(0)
+        , _sharedAcquisitions(0)
+        , _sharedContended(0)
+        , _waitTicks(0)
+        , _maxWaitTicks(0)
+        , _holdTicks(0)
+        , _maxHoldTicks(0)
+        , _holdBegin(0)
+        , _prev(nullptr)
+        , _next(nullptr)
+    {
+        LockStatsRegistry().add(this);
+    }
+
+    LockStats::~LockStats() {
+        LockStatsRegistry().remove(this);
+    }
+
+    LockStatsSnapshot LockStats::snapshot(double ticksPerMicro) const {
+        LockStatsSnapshot snapshot;
+        snapshot.name = _name;
+        snapshot.lock = _owner;
+        snapshot.acquisitions = _acquisitions.load(std::memory_order_relaxed);
+        snapshot.contended = _contended.load(std::memory_order_relaxed);
+        snapshot.sharedAcquisitions = _sharedAcquisitions.load(std::memory_order_relaxed);
+        snapshot.sharedContended = _sharedContended.load(std::memory_order_relaxed);
+        snapshot.totalWaitUs = (double)_waitTicks.load(std::memory_order_relaxed) / ticksPerMicro;
+        snapshot.maxWaitUs = (double)_maxWaitTicks.load(std::memory_order_relaxed) / ticksPerMicro;
+        snapshot.totalHoldUs = (double)_holdTicks.load(std::memory_order_relaxed) / ticksPerMicro;
+        snapshot.maxHoldUs = (double)_maxHoldTicks.load(std::memory_order_relaxed) / ticksPerMicro;
+        return snapshot;
+    }
+
+    void LockStats::reset() {
+        _acquisitions.store(0, std::memory_order_relaxed);
+        _contended.store(0, std::memory_order_relaxed);
+        _sharedAcquisitions.store(0, std::memory_order_relaxed);
+        _sharedContended.store(0, std::memory_order_relaxed);
+        _waitTicks.store(0, std::memory_order_relaxed);
+        _maxWaitTicks.store(0, std::memory_order_relaxed);
+        _holdTicks.store(0, std::memory_order_relaxed);
+        _maxHoldTicks.store(0, std::memory_order_relaxed);
+    }
+
+    std::vector<LockStatsSnapshot> CollectLockStats() {
+        double ticksPerMicro = profiler::TicksPerMicrosecond();
+        std::vector<LockStatsSnapshot> snapshots;
+        LockStatsRegistry().forEach([&](LockStats const& stats) {
+            snapshots.push_back(stats.snapshot(ticksPerMicro));
+        });
+        std::sort(snapshots.begin(), snapshots.end(), [](LockStatsSnapshot const& a, LockStatsSnapshot const& b) {
+            return a.totalWaitUs > b.totalWaitUs;
+        });
+        return snapshots;
+    }
+
+    void ResetLockStats() {
+        LockStatsRegistry().forEach([](LockStats& stats) {
+            stats.reset();
+        });
+    }
+
+#else
+
+    std::vector<LockStatsSnapshot> CollectLockStats() {
+        return {};
+    }
+
+    void ResetLockStats() {
+    }
+
+#endif
+
+    void ReportLockStats(FILE* file, size_t top) {
+        auto snapshots = CollectLockStats();
+        if(snapshots.size() > top) {
+            snapshots.resize(top);
+        }
+        fprintf(file, "%-32s %12s %10s %12s %10s %12s %10s %12s %10s\n",
+            "lock", "acquire", "contended", "shared", "contended", "wait(us)", "max", "hold(us)", "max");
+        for(auto const& stats : snapshots) {
+            char name[64];
+            if(stats.name.empty()) {
+                snprintf(name, sizeof(name), "%p", stats.lock);
+            } else {
+                snprintf(name, sizeof(name), "%s@%p", stats.name.c_str(), stats.lock);
+            }
+            fprintf(file, "%-32s %12llu %10llu %12llu %10llu %12.1f %10.1f %12.1f %10.1f\n", name,
+                (unsigned long long)stats.acquisitions, (unsigned long long)stats.contended,
+                (unsigned long long)stats.sharedAcquisitions, (unsigned long long)stats.sharedContended,
+                stats.totalWaitUs, stats.maxWaitUs, stats.totalHoldUs, stats.maxHoldUs);
+        }
+    }
+
+}
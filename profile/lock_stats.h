@@ -0,0 +1,134 @@
+#pragma once
+
+/**
+ * @file lock_stats.h
+ * @brief 锁竞争统计：获取次数、需要等待的次数、等待时间（总计/最大）、写锁持有时间（总计/最大）
+ *  CMakeLists.txt 里打开 ENABLE_LOCK_STATS（定义 LWC_LOCK_STATS）时，SharedMutex、AdaptiveMutex 每个实例带一份 LockStats，
+ *  并登记到全局列表里，CollectLockStats / ReportLockStats 查询；
+ *  没打开时 LockStats 是空类，所有记录函数都是空的内联函数，锁的大小和快速路径都和原来一样。
+ *  读锁只统计次数和等待时间，持有时间要给每个读者单独记开始时间，不做。
+ *
+ *  comm::SharedMutex mutex("asset table");
+ *  ...
+ *  comm::ReportLockStats(stdout);
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#if LWC_LOCK_STATS
+#include <atomic>
+#include "profiler.h"
+#endif
+
+namespace comm {
+
+    struct LockStatsSnapshot {
+        std::string     name;
+        void const*     lock;
+        uint64_t        acquisitions;           // 写锁（包括 AdaptiveMutex 的 lock）
+        uint64_t        contended;              // 其中没有走快速路径、需要等的
+        uint64_t        sharedAcquisitions;     // 读锁、可升级读锁
+        uint64_t        sharedContended;
+        double          totalWaitUs;
+        double          maxWaitUs;
+        double          totalHoldUs;            // 只算写锁
+        double          maxHoldUs;
+    };
+
+#if LWC_LOCK_STATS
+
+    class LockStats {
+    private:
+        std::string             _name;
+        void const*             _owner;
+        std::atomic<uint64_t>   _acquisitions;
+        std::atomic<uint64_t>   _contended;
+        std::atomic<uint64_t>   _sharedAcquisitions;
+        std::atomic<uint64_t>   _sharedContended;
+        std::atomic<uint64_t>   _waitTicks;
+        std::atomic<uint64_t>   _maxWaitTicks;
+        std::atomic<uint64_t>   _holdTicks;
+        std::atomic<uint64_t>   _maxHoldTicks;
+        uint64_t                _holdBegin;     // 只有持有写锁的线程读写
+        LockStats*              _prev;          // 全局列表，在 lock_stats.cpp 的锁下修改
+        LockStats*              _next;
+        friend struct lock_stats_registry_t;
+    private:
+        static void updateMax(std::atomic<uint64_t>& max, uint64_t value) {
+            uint64_t current = max.load(std::memory_order_relaxed);
+            while(value > current && !max.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+            }
+        }
+    public:
+        LockStats(char const* name, void const* owner);
+        LockStats(LockStats const&) = delete;
+        LockStats& operator = (LockStats const&) = delete;
+        ~LockStats();
+
+        // 快速路径失败、准备等待之前调用，返回值交给 acquiredAfterWait
+        uint64_t waitBegin() const {
+            return profiler::Ticks();
+        }
+
+        void acquired(bool shared) {
+            if(shared) {
+                _sharedAcquisitions.fetch_add(1, std::memory_order_relaxed);
+            } else {
+                _acquisitions.fetch_add(1, std::memory_order_relaxed);
+                _holdBegin = profiler::Ticks();
+            }
+        }
+
+        void acquiredAfterWait(uint64_t begin, bool shared) {
+            uint64_t now = profiler::Ticks();
+            uint64_t wait = now - begin;
+            _waitTicks.fetch_add(wait, std::memory_order_relaxed);
+            updateMax(_maxWaitTicks, wait);
+            if(shared) {
+                _sharedAcquisitions.fetch_add(1, std::memory_order_relaxed);
+                _sharedContended.fetch_add(1, std::memory_order_relaxed);
+            } else {
+                _acquisitions.fetch_add(1, std::memory_order_relaxed);
+                _contended.fetch_add(1, std::memory_order_relaxed);
+                _holdBegin = now;
+            }
+        }
+
+        // 写锁释放（或者降级成读锁）时调用
+        void released() {
+            uint64_t hold = profiler::Ticks() - _holdBegin;
+            _holdTicks.fetch_add(hold, std::memory_order_relaxed);
+            updateMax(_maxHoldTicks, hold);
+        }
+
+        LockStatsSnapshot snapshot(double ticksPerMicro) const;
+        void reset();
+    };
+
+#else
+
+    class LockStats {
+    public:
+        LockStats(char const*, void const*) {}
+        uint64_t waitBegin() const {
+            return 0;
+        }
+        void acquired(bool) {}
+        void acquiredAfterWait(uint64_t, bool) {}
+        void released() {}
+    };
+
+#endif
+
+    /**
+     * @brief 当前所有还活着的锁的统计，按总等待时间从大到小排；没开 LWC_LOCK_STATS 时返回空
+     */
+    std::vector<LockStatsSnapshot> CollectLockStats();
+    // 清零所有锁的统计，开始新一段观察
+    void ResetLockStats();
+    // 打印总等待时间最多的 top 个锁
+    void ReportLockStats(FILE* file, size_t top = 20);
+
+}
@@ -0,0 +1,234 @@
+#include "profiler.h"
+#include "../memory/memory.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace comm {
+
+    namespace profiler {
+
+        constexpr uint32_t ChunkEventCount = 8192;      // 每块 256KB
+        constexpr uint32_t ThreadChunkLimit = 64;       // 每个线程最多 16MB，再多就丢
+
+        enum class event_type_t : uint32_t {
+            zone,
+            counter,
+        };
+
+        struct event_t {
+            uint64_t        begin;
+            uint64_t        end;        // 计数器事件存的是值
+            void const*     data;       // zone 是 ZoneSite*，计数器是名字
+            event_type_t    type;
+        };
+
+        struct chunk_t {
+            event_t                 events[ChunkEventCount];
+            std::atomic<uint32_t>   count;      // 本线程写完一个事件再 release 发布，导出只读到 count 为止
+            std::atomic<chunk_t*>   next;
+        };
+
+        /**
+         * @brief 每个线程一份，线程退出之后也不释放，导出时还能看到已经退出的线程
+         */
+        struct thread_buffer_t {
+            uint32_t                tid;
+            std::string             name;       // 读写都在 registry_t::mutex 下
+            chunk_t*                head;
+            chunk_t*                tail;       // 只有所属线程访问
+            uint32_t                chunkCount;
+            std::atomic<uint64_t>   dropped;
+        };
+
+        struct registry_t {
+            std::mutex                              mutex;
+            std::vector<thread_buffer_t*>           buffers;
+            uint64_t                                baseTicks;
+            std::chrono::steady_clock::time_point   baseTime;
+
+            registry_t()
+                : baseTicks(Ticks())
+                , baseTime(std::chrono::steady_clock::now())
+            {}
+        };
+
+        // 故意不析构：进程退出时可能还有线程在打点
+        static registry_t& Registry() {
+            static registry_t* registry = new (comm_alloc(sizeof(registry_t))) registry_t();
+            return *registry;
+        }
+
+        // 尽早记下时间基准，免得第一个 zone 的开始时间比基准还早
+        [[maybe_unused]] static registry_t& RegistryAtStartup = Registry();
+
+        static thread_local thread_buffer_t* LocalBuffer = nullptr;
+
+        static chunk_t* CreateChunk() {
+            chunk_t* chunk = (chunk_t*)comm_alloc(sizeof(chunk_t));
+            new (&chunk->count) std::atomic<uint32_t>(0);
+            new (&chunk->next) std::atomic<chunk_t*>(nullptr);
+            return chunk;
+        }
+
+        static thread_buffer_t* LocalThreadBuffer() {
+            thread_buffer_t* buffer = LocalBuffer;
+            if(!buffer) {
+                buffer = new (comm_alloc(sizeof(thread_buffer_t))) thread_buffer_t();
+                buffer->head = buffer->tail = CreateChunk();
+                buffer->chunkCount = 1;
+                registry_t& registry = Registry();
+                std::lock_guard<std::mutex> lock(registry.mutex);
+                buffer->tid = (uint32_t)registry.buffers.size() + 1;
+                registry.buffers.push_back(buffer);
+                LocalBuffer = buffer;
+            }
+            return buffer;
+        }
+
+        static void Append(event_t const& event) {
+            thread_buffer_t* buffer = LocalThreadBuffer();
+            chunk_t* chunk = buffer->tail;
+            uint32_t count = chunk->count.load(std::memory_order_relaxed);
+            if(count == ChunkEventCount) {
+                if(buffer->chunkCount == ThreadChunkLimit) {
+                    buffer->dropped.fetch_add(1, std::memory_order_relaxed);
+                    return;
+                }
+                chunk_t* next = CreateChunk();
+                chunk->next.store(next, std::memory_order_release);
+                buffer->tail = chunk = next;
+                ++buffer->chunkCount;
+                count = 0;
+            }
+            chunk->events[count] = event;
+            chunk->count.store(count + 1, std::memory_order_release);
+        }
+
+        void RecordZone(ZoneSite const* site, uint64_t begin, uint64_t end) {
+            Append({ begin, end, site, event_type_t::zone });
+        }
+
+        void RecordCounter(char const* name, int64_t value) {
+            Append({ Ticks(), (uint64_t)value, name, event_type_t::counter });
+        }
+
+        void SetThreadName(char const* name) {
+            thread_buffer_t* buffer = LocalThreadBuffer();
+            registry_t& registry = Registry();
+            std::lock_guard<std::mutex> lock(registry.mutex);
+            buffer->name = name;
+        }
+
+        double TicksPerMicrosecond() {
+            registry_t& registry = Registry();
+            // 用从启动到现在的整段时间校准 tick 的频率，太短的话等一会儿，避免误差太大
+            auto minimum = std::chrono::milliseconds(10);
+            while(std::chrono::steady_clock::now() - registry.baseTime < minimum) {
+                std::this_thread::yield();
+            }
+            uint64_t ticks = Ticks();
+            double elapsed = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - registry.baseTime).count();
+            return (double)(ticks - registry.baseTicks) / elapsed;
+        }
+
+        static void WriteJsonString(FILE* file, char const* text) {
+            fputc('"', file);
+            for(; *text; ++text) {
+                char c = *text;
+                if(c == '"' || c == '\\') {
+                    fputc('\\', file);
+                    fputc(c, file);
+                } else if((unsigned char)c < 0x20) {
+                    fprintf(file, "\\u%04x", (unsigned)c);
+                } else {
+                    fputc(c, file);
+                }
+            }
+            fputc('"', file);
+        }
+
+        bool ExportChromeTrace(char const* path) {
+            FILE* file = fopen(path, "wb");
+            if(!file) {
+                return false;
+            }
+            registry_t& registry = Registry();
+            double ticksPerMicro = TicksPerMicrosecond();
+            auto toMicro = [&](uint64_t value) {
+                int64_t delta = (int64_t)(value - registry.baseTicks);
+                return delta > 0 ? (double)delta / ticksPerMicro : 0.0;
+            };
+            std::lock_guard<std::mutex> lock(registry.mutex);
+            fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+            bool first = true;
+            for(thread_buffer_t* buffer : registry.buffers) {
+                fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":", first ? "" : ",\n", buffer->tid);
+                first = false;
+                if(buffer->name.empty()) {
+                    fprintf(file, "\"thread %u\"", buffer->tid);
+                } else {
+                    WriteJsonString(file, buffer->name.c_str());
+                }
+                fprintf(file, "}}");
+                for(chunk_t* chunk = buffer->head; chunk; chunk = chunk->next.load(std::memory_order_acquire)) {
+                    uint32_t count = chunk->count.load(std::memory_order_acquire);
+                    for(uint32_t i = 0; i < count; ++i) {
+                        event_t const& event = chunk->events[i];
+                        if(event.type == event_type_t::zone) {
+                            ZoneSite const* site = (ZoneSite const*)event.data;
+                            fprintf(file, ",\n{\"name\":");
+                            WriteJsonString(file, site->name);
+                            fprintf(file, ",\"cat\":\"lwc\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%u}",
+                                toMicro(event.begin), (double)(event.end - event.begin) / ticksPerMicro, buffer->tid);
+                        } else {
+                            fprintf(file, ",\n{\"name\":");
+                            WriteJsonString(file, (char const*)event.data);
+                            fprintf(file, ",\"ph\":\"C\",\"ts\":%.3f,\"pid\":1,\"tid\":%u,\"args\":{\"value\":%lld}}",
+                                toMicro(event.begin), buffer->tid, (long long)(int64_t)event.end);
+                        }
+                    }
+                }
+            }
+            fprintf(file, "\n]}\n");
+            bool succeeded = !ferror(file);
+            fclose(file);
+            return succeeded;
+        }
+
+        void Reset() {
+            registry_t& registry = Registry();
+            std::lock_guard<std::mutex> lock(registry.mutex);
+            for(thread_buffer_t* buffer : registry.buffers) {
+                chunk_t* chunk = buffer->head->next.load(std::memory_order_relaxed);
+                while(chunk) {
+                    chunk_t* next = chunk->next.load(std::memory_order_relaxed);
+                    comm_free(chunk);
+                    chunk = next;
+                }
+                buffer->head->next.store(nullptr, std::memory_order_relaxed);
+                buffer->head->count.store(0, std::memory_order_relaxed);
+                buffer->tail = buffer->head;
+                buffer->chunkCount = 1;
+                buffer->dropped.store(0, std::memory_order_relaxed);
+            }
+        }
+
+        uint64_t DroppedEvents() {
+            registry_t& registry = Registry();
+            std::lock_guard<std::mutex> lock(registry.mutex);
+            uint64_t dropped = 0;
+            for(thread_buffer_t* buffer : registry.buffers) {
+                dropped += buffer->dropped.load(std::memory_order_relaxed);
+            }
+            return dropped;
+        }
+
+    }
+
+}
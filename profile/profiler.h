@@ -0,0 +1,97 @@
+#pragma once
+
+/**
+ * @file profiler.h
+ * @brief 热点路径打点：作用域 zone、计数器、线程名，导出成 Chrome trace / Perfetto 能打开的 JSON
+ *  每个线程写自己的缓冲区（分块追加，只有本线程写，导出时别的线程只读已经发布的部分），打点不加锁；
+ *  时间戳直接读 TSC（x86 rdtsc，arm64 读 cntvct），导出时再和 steady_clock 对一次换算成微秒。
+ *  CMakeLists.txt 里 ENABLE_PROFILER 没打开时不定义 LWC_PROFILER，所有 LWC_PROFILE_* 宏都展开成空，没有任何开销。
+ *
+ *  void load() {
+ *      LWC_PROFILE_ZONE("load");
+ *      LWC_PROFILE_COUNTER("pending", pending);
+ *  }
+ *  comm::profiler::ExportChromeTrace("trace.json");
+ */
+
+#include <cstdint>
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#elif !defined(__x86_64__) && !defined(__i386__) && !defined(__aarch64__)
+#include <chrono>
+#endif
+
+namespace comm {
+
+    namespace profiler {
+
+        struct ZoneSite {
+            char const*     name;
+            char const*     file;
+            uint32_t        line;
+        };
+
+        inline uint64_t Ticks() {
+        #if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+            return __rdtsc();
+        #elif defined(__x86_64__) || defined(__i386__)
+            return __builtin_ia32_rdtsc();
+        #elif defined(__aarch64__)
+            uint64_t ticks;
+            asm volatile("mrs %0, cntvct_el0" : "=r"(ticks));
+            return ticks;
+        #else
+            return (uint64_t)std::chrono::steady_clock::now().time_since_epoch().count();
+        #endif
+        }
+
+        // Ticks() 每微秒走多少，程序刚启动时调用会先等够 10ms 再校准
+        double TicksPerMicrosecond();
+
+        void RecordZone(ZoneSite const* site, uint64_t begin, uint64_t end);
+        // name 必须是常量字符串（或者活得比导出更久），只记录指针
+        void RecordCounter(char const* name, int64_t value);
+        void SetThreadName(char const* name);
+
+        /**
+         * @brief 把所有线程到目前为止记录的事件写成 Chrome trace JSON，可以和打点同时进行
+         */
+        bool ExportChromeTrace(char const* path);
+        // 丢掉已经记录的事件；调用时不能有其它线程正在打点
+        void Reset();
+        // 单个线程的缓冲区写满之后丢掉的事件数
+        uint64_t DroppedEvents();
+
+        class ScopedZone {
+        private:
+            ZoneSite const*     _site;
+            uint64_t            _begin;
+        public:
+            explicit ScopedZone(ZoneSite const* site)
+                : _site(site)
+                , _begin(Ticks())
+            {}
+            ScopedZone(ScopedZone const&) = delete;
+            ScopedZone& operator = (ScopedZone const&) = delete;
+            ~ScopedZone() {
+                RecordZone(_site, _begin, Ticks());
+            }
+        };
+
+    }
+
+}
+
+#if LWC_PROFILER
+    #define LWC_PROFILE_CONCAT_(a, b) a##b
+    #define LWC_PROFILE_CONCAT(a, b) LWC_PROFILE_CONCAT_(a, b)
+    #define LWC_PROFILE_ZONE(name) \
+        static constexpr ::comm::profiler::ZoneSite LWC_PROFILE_CONCAT(_lwcZoneSite, __LINE__) { name, __FILE__, __LINE__ }; \
+        ::comm::profiler::ScopedZone LWC_PROFILE_CONCAT(_lwcZone, __LINE__)(&LWC_PROFILE_CONCAT(_lwcZoneSite, __LINE__))
+    #define LWC_PROFILE_COUNTER(name, value) ::comm::profiler::RecordCounter(name, (int64_t)(value))
+    #define LWC_PROFILE_THREAD_NAME(name) ::comm::profiler::SetThreadName(name)
+#else
+    #define LWC_PROFILE_ZONE(name) ((void)0)
+    #define LWC_PROFILE_COUNTER(name, value) ((void)0)
+    #define LWC_PROFILE_THREAD_NAME(name) ((void)0)
+#endif
@@ -1,5 +1,6 @@
 #include "name.h"
 #include "../memory/memory.h"
+#include "../profile/profiler.h"
 
 namespace comm {
 
@@ -22,11 +23,12 @@ namespace comm {
     //
     NamePool::NamePool()
         : _nameSet()
-        , _mutex()
+        , _mutex("NamePool")
         , _totalBytes(0)
     {}
 
     Name NamePool::getName( char const* str, uint16_t length ) {
+        LWC_PROFILE_ZONE("NamePool::getName");
         static Name::prototype_t NullName = {};
         if(!str) {
             return Name(&NullName);
@@ -38,14 +40,17 @@ namespace comm {
          * @brief 如果先看set里有没有，则需要查找两次，如果提前准备好内存，则只需要插入一次
          * 不过也有其缺点，如果数据已经存在就会有一次内存回收的操作。
          */
-        size_t bytes = sizeof(sizeof(Name::prototype_t) + length);
+        size_t bytes = sizeof(Name::prototype_t) + length;
         Name::prototype_t* prototype_t = (Name::prototype_t*)(uint8_t*)comm_alloc(bytes);
-        strcpy(prototype_t->str, str);
+        memcpy(prototype_t->str, str, length);
+        prototype_t->str[length] = 0;
         prototype_t->length = length;
 
-        std::unique_lock<std::mutex> lock(_mutex);
+        std::unique_lock<AdaptiveMutex> lock(_mutex);
         auto rst = _nameSet.insert(prototype_t);
-        this->_totalBytes += bytes;
+        if(rst.second) {
+            this->_totalBytes += bytes;
+        }
         lock.unlock();
 
         if(!rst.second) {
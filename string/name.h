@@ -3,6 +3,7 @@
 #include <cstring>
 #include <set>
 #include <mutex>
+#include <threading/adaptive_mutex.hpp>
 
 namespace comm {
 
@@ -30,8 +31,8 @@ namespace comm {
     };
 
     /**
-     * @brief TODO: NamePool 不能用读写锁，所以直接用互斥量保证线程安全吧
-     *
+     * @brief NamePool 的插入是 查找+插入 一步完成的，用不上读写锁；
+     *  临界区只有一次 set 插入，用先自旋再睡眠的 AdaptiveMutex
      */
 
     class NamePool {
@@ -49,7 +50,7 @@ namespace comm {
             }
         };
         std::set<Name::prototype_t*, prototype_less>    _nameSet;
-        std::mutex                                      _mutex;
+        AdaptiveMutex                                   _mutex;
         size_t                                          _totalBytes;
     public:
         NamePool();
@@ -0,0 +1,163 @@
+#include <cassert>
+#include <cstdint>
+#include <atomic>
+#include <future>
+#include <set>
+#include <thread>
+#include <vector>
+#include <memory/object_pool.h>
+
+struct item_t {
+    static inline std::atomic<int> alive { 0 };
+    uint64_t    value;
+    uint64_t    padding[3];
+    explicit item_t(uint64_t v)
+        : value(v)
+        , padding{}
+    {
+        ++alive;
+    }
+    ~item_t() {
+        --alive;
+    }
+};
+
+template<bool ThreadSafe>
+void testBatches() {
+    comm::ObjectPool<item_t, ThreadSafe> pool(16);
+    // 不是弹匣整数倍的批量，跨好几个块
+    std::vector<item_t*> items(45);
+    assert(pool.createN(items.data(), items.size(), 7) == items.size());
+    assert(item_t::alive == 45);
+    std::set<item_t*> unique(items.begin(), items.end());
+    assert(unique.size() == items.size());
+    for(auto item : items) {
+        assert(item->value == 7);
+    }
+    auto stats = pool.stats();
+    assert(stats.live == 45 && stats.chunks == 3 && stats.capacity == 48);
+    // 只销毁一部分，forEach 只看到剩下的
+    pool.destroyN(items.data() + 10, 20);
+    assert(item_t::alive == 25);
+    std::set<item_t*> visited;
+    pool.forEach([&](item_t& item) {
+        assert(item.value == 7);
+        visited.insert(&item);
+    });
+    assert(visited.size() == 25);
+    for(size_t i = 0; i < items.size(); ++i) {
+        assert(!!visited.count(items[i]) == (i < 10 || i >= 30));
+    }
+    stats = pool.stats();
+    assert(stats.live == 25 && stats.chunks == 3);
+    // 空出来的槽先被复用，不会再要新块
+    std::vector<item_t*> again(20);
+    assert(pool.createN(again.data(), again.size(), 9) == again.size());
+    stats = pool.stats();
+    assert(stats.live == 45 && stats.chunks == 3);
+    item_t* single = pool.create(11);
+    assert(single && single->value == 11);
+    stats = pool.stats();
+    assert(stats.live == 46 && stats.chunks == 3);
+    pool.destroy(single);
+    assert(pool.createN(again.data(), 0, 1) == 0);
+    pool.destroyN(again.data(), again.size());
+    assert(pool.stats().live == 25);
+    // 池子析构时还活着的对象也会析构
+}
+
+// 两个线程交叉着建和销毁，对象在一个线程建、另一个线程销毁，槽进了销毁线程的弹匣
+void testMagazines() {
+    comm::ObjectPool<item_t> pool(64, true);
+    constexpr uint32_t Rounds = 2000;
+    constexpr uint32_t Batch = 50;
+    std::vector<item_t*> handoff[2];
+    std::atomic<uint32_t> turn { 0 };
+    auto worker = [&](uint32_t self) {
+        for(uint32_t round = 0; round < Rounds; ++round) {
+            while(turn.load(std::memory_order_acquire) % 2 != self) {
+                std::this_thread::yield();
+            }
+            for(auto item : handoff[self]) {
+                assert(item->value % 2 != self);
+                pool.destroy(item);
+            }
+            handoff[self].clear();
+            for(uint32_t i = 0; i < Batch; ++i) {
+                item_t* item = pool.create(round * Batch * 2 + i * 2 + self);
+                assert(item);
+                handoff[1 - self].push_back(item);
+            }
+            turn.fetch_add(1, std::memory_order_release);
+        }
+    };
+    std::thread first(worker, 0);
+    std::thread second(worker, 1);
+    first.join();
+    second.join();
+    // 两个线程都退出了，弹匣里的槽还回了池子
+    assert(pool.stats().live == Batch);
+    for(auto item : handoff[0]) {
+        pool.destroy(item);
+    }
+    assert(pool.stats().live == 0 && item_t::alive == 0);
+    // 容量只取决于同时活着的对象和弹匣，不会一直涨
+    assert(pool.stats().capacity <= 64 * 8);
+}
+
+// 线程的弹匣里留着一个已经析构的池的槽，线程再用别的池、然后退出，旧槽只能丢掉，不能碰
+void testDestroyedPool() {
+    auto pool = new comm::ObjectPool<item_t>(0, true);
+    std::promise<void> filled;
+    std::promise<void> destroyed;
+    std::thread thread([&] {
+        std::vector<item_t*> items;
+        for(uint32_t i = 0; i < 20; ++i) {
+            items.push_back(pool->create(i));
+        }
+        for(auto item : items) {
+            pool->destroy(item);
+        }
+        filled.set_value();
+        destroyed.get_future().wait();
+        // 四个新池子里至少有一个和旧池子落在同一个弹匣上，换主人时丢掉旧槽
+        std::vector<comm::ObjectPool<item_t>*> others;
+        for(uint32_t i = 0; i < 4; ++i) {
+            others.push_back(new comm::ObjectPool<item_t>(0, true));
+            item_t* item = others.back()->create(i);
+            assert(item && item->value == i);
+            others.back()->destroy(item);
+        }
+        for(auto other : others) {
+            delete other;
+        }
+    });
+    filled.get_future().wait();
+    assert(pool->stats().live == 0);
+    delete pool;
+    destroyed.set_value();
+    thread.join();
+    // 只在弹匣里留着旧槽就退出的线程
+    pool = new comm::ObjectPool<item_t>(0, true);
+    std::promise<void> filledAgain;
+    std::promise<void> destroyedAgain;
+    thread = std::thread([&] {
+        pool->destroy(pool->create(1));
+        filledAgain.set_value();
+        destroyedAgain.get_future().wait();
+    });
+    filledAgain.get_future().wait();
+    delete pool;
+    destroyedAgain.set_value();
+    thread.join();
+    assert(item_t::alive == 0);
+}
+
+int main() {
+    testBatches<true>();
+    testBatches<false>();
+    assert(item_t::alive == 0);
+    testMagazines();
+    testDestroyedPool();
+    return 0;
+}
@@ -0,0 +1,60 @@
+#include <cassert>
+#include <string>
+#include <io/path.h>
+
+using namespace comm;
+
+static void check(const char* path, const char* expect, bool relative = false) {
+    std::string str(path);
+    uint64_t hash = 0;
+    size_t length = relative
+        ? NormalizeRelativePath(str.data(), str.length(), str.data(), str.length(), &hash)
+        : NormalizePath(str.data(), str.length(), str.data(), str.length(), &hash);
+    assert(length != PathInvalid);
+    str.resize(length);
+    assert(str == expect);
+    assert(hash == PathHash(str.data(), str.length()));
+}
+
+int main() {
+    check("a/b/c", "a/b/c");
+    check("/a//b\\c/", "/a/b/c");
+    check("./a/./b", "a/b");
+    check("a/b/../c", "a/c");
+    check("a/../../c", "../c");
+    check("/../a", "/a");
+    check("C:\\x\\..\\y", "C:/y");
+    check("../../a/..", "../..");
+    check("", "");
+    check("/a/b", "a/b", true);
+    check("\\\\a\\..\\b", "b", true);
+    // 超过记录深度的 ".."
+    std::string deep;
+    for(int i = 0; i < 100; ++i) {
+        deep += "d" + std::to_string(i) + "/";
+    }
+    deep += "x";
+    for(int i = 0; i < 70; ++i) {
+        deep += "/..";
+    }
+    std::string expect;
+    for(int i = 0; i < 31; ++i) {
+        expect += (i ? "/d" : "d") + std::to_string(i);
+    }
+    check(deep.c_str(), expect.c_str());
+    // 容量不够
+    char small[4];
+    assert(NormalizePath("abcdef", 6, small, sizeof(small)) == PathInvalid);
+    // 大小写策略只影响哈希
+    assert(PathHash("A/B", 3, PathCase::insensitive) == PathHash("a/b", 3, PathCase::insensitive));
+    assert(PathHash("A/B", 3) != PathHash("a/b", 3));
+    // 拼接
+    PathBuffer buffer;
+    buffer.join("/root/dir", "./x/../y.txt");
+    assert(buffer.view() == "/root/dir/y.txt");
+    assert(buffer.hash() == RelativePathHash("y.txt"));
+    std::string longPath(2000, 'a');
+    buffer.join("/r", longPath);
+    assert(buffer.length() == 2003);
+    return 0;
+}
@@ -0,0 +1,151 @@
+#include <cassert>
+#include <cstring>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <io/pkg_builder.h>
+#include <io/pkg_archive.h>
+#include <io/lz_block.h>
+#include <io/chunked_stream.h>
+#include <io/pkg_format.h>
+#include <io/path.h>
+#include <io/memory_stream.h>
+
+int main() {
+    // lz block 往返
+    std::vector<uint8_t> source;
+    for(uint32_t i = 0; i < 100000; ++i) {
+        source.push_back((uint8_t)((i % 97) < 50 ? i % 7 : (i * 2654435761u) >> 24));
+    }
+    std::vector<uint8_t> compressed(comm::LZBlockBound(source.size()));
+    int64_t compressedSize = comm::LZBlockCompress(source.data(), source.size(), compressed.data(), compressed.size());
+    assert(compressedSize > 0 && (size_t)compressedSize < source.size());
+    std::vector<uint8_t> decompressed(source.size());
+    assert(comm::LZBlockDecompress(compressed.data(), (size_t)compressedSize, decompressed.data(), decompressed.size()));
+    assert(decompressed == source);
+    assert(!comm::LZBlockDecompress(compressed.data(), (size_t)compressedSize / 2, decompressed.data(), decompressed.size()));
+    // 分块压缩流，随机 seek
+    std::vector<uint8_t> huge;
+    for(uint32_t i = 0; i < 3 * 1024 * 1024 + 123; ++i) {
+        huge.push_back((uint8_t)((i / 13) % 251));
+    }
+    std::vector<uint8_t> chunked;
+    assert(comm::ChunkedCompress(huge.data(), huge.size(), chunked, 64 * 1024));
+    assert(chunked.size() < huge.size());
+    comm::IStream* chunkedStream = comm::CreateChunkedIStream(chunked.data(), chunked.size());
+    assert(chunkedStream && chunkedStream->size() == (int64_t)huge.size());
+    std::vector<uint8_t> readback(huge.size());
+    assert(chunkedStream->read(readback.data(), (int64_t)readback.size()) == (int64_t)huge.size());
+    assert(readback == huge);
+    for(uint32_t i = 0; i < 64; ++i) {
+        int offset = (int)((i * 2654435761u) % huge.size());
+        uint8_t bytes[300];
+        assert(chunkedStream->seek(comm::SeekOption::begin, offset) == 0);
+        int64_t n = chunkedStream->read(bytes, sizeof(bytes));
+        assert(n == std::min<int64_t>(sizeof(bytes), (int64_t)huge.size() - offset));
+        assert(!memcmp(bytes, huge.data() + offset, (size_t)n));
+    }
+    chunkedStream->close();
+    // 头里的 chunk 数大到偏移表放不下的流直接打开失败，不去分配偏移表
+    std::vector<uint8_t> corrupt(chunked.begin(), chunked.begin() + 4096);
+    comm::chunked_header_t chunkedHeader;
+    memcpy(&chunkedHeader, corrupt.data(), sizeof(chunkedHeader));
+    chunkedHeader.chunkSize = 1;
+    chunkedHeader.chunkCount = comm::ChunkedMaxChunkCount;
+    chunkedHeader.rawSize = comm::ChunkedMaxChunkCount;
+    memcpy(corrupt.data(), &chunkedHeader, sizeof(chunkedHeader));
+    assert(!comm::CreateChunkedIStream(corrupt.data(), corrupt.size()));
+    assert(!comm::CreateChunkedIStream(comm::CreateMemoryIStream(corrupt.data(), (int64_t)corrupt.size()), true));
+    chunkedHeader.chunkCount = ~0u;
+    chunkedHeader.rawSize = ~0u;
+    memcpy(corrupt.data(), &chunkedHeader, sizeof(chunkedHeader));
+    assert(!comm::CreateChunkedIStream(corrupt.data(), corrupt.size()));
+    // 打包 & 读取
+    const char* text = "hello pkg";
+    comm::PkgBuilder builder;
+    assert(builder.addData("textures/big.bin", source.data(), source.size()));
+    assert(builder.addData("textures/huge.bin", huge.data(), huge.size()));
+    assert(builder.addData("config\\app.txt", text, strlen(text)));
+    assert(builder.addData("empty.txt", text, 0));
+    assert(!builder.addData("./config/app.txt", text, strlen(text)));
+    assert(builder.write("pkg_archive_test.pkg"));
+
+    comm::IArchive* archive = comm::CreatePkgArchive("pkg_archive_test.pkg");
+    assert(archive && archive->readonly());
+    assert(archive->testExist("config/app.txt"));
+    assert(archive->testExist("/textures\\big.bin"));
+    assert(!archive->testExist("config/missing.txt"));
+    assert(!archive->openOStream("config/app.txt", comm::WriteFlag::binary));
+
+    comm::IStream* stream = archive->openIStream("config/app.txt", comm::ReadFlag::binary);
+    assert(stream && stream->size() == (int64_t)strlen(text));
+    char buffer[32] = {};
+    assert(stream->read(buffer, sizeof(buffer)) == (int64_t)strlen(text));
+    assert(!strcmp(buffer, text));
+    stream->close();
+
+    stream = archive->openIStream("textures/big.bin", comm::ReadFlag::binary);
+    assert(stream && stream->size() == (int64_t)source.size());
+    std::vector<uint8_t> content(source.size());
+    assert(stream->read(content.data(), (int64_t)content.size()) == (int64_t)source.size());
+    assert(content == source);
+    stream->close();
+
+    stream = archive->openIStream("textures/huge.bin", comm::ReadFlag::binary);
+    assert(stream && stream->size() == (int64_t)huge.size());
+    assert(stream->seek(comm::SeekOption::begin, 2 * 1024 * 1024) == 0);
+    assert(stream->read(readback.data(), 1024) == 1024);
+    assert(!memcmp(readback.data(), huge.data() + 2 * 1024 * 1024, 1024));
+    stream->close();
+
+    stream = archive->openIStream("empty.txt", comm::ReadFlag::binary);
+    assert(stream && stream->size() == 0);
+    stream->close();
+
+    auto entities = archive->listFiles("");
+    assert(entities.size() == 3);
+    entities = archive->listFiles("textures");
+    assert(entities.size() == 2);
+    entities = archive->listFilesRecursive("");
+    assert(entities.size() == 6);
+    // 哈希撞上但路径不同的查询找不到条目
+    auto pkg = dynamic_cast<comm::PkgArchive*>(archive);
+    assert(pkg);
+    uint64_t appHash = comm::PathHash("config/app.txt", strlen("config/app.txt"));
+    assert(pkg->findEntry(appHash, "config/app.txt"));
+    assert(!pkg->findEntry(appHash, "config/other.txt"));
+    archive->destroy();
+    // 原始大小超过压缩数据能展开的上限的 lz 条目要拒绝打开
+    FILE* file = fopen("pkg_archive_test.pkg", "r+b");
+    assert(file);
+    comm::pkg_header_t header;
+    assert(fread(&header, sizeof(header), 1, file) == 1);
+    std::vector<comm::pkg_entry_t> entries(header.entryCount);
+    fseek(file, (long)header.tocOffset, SEEK_SET);
+    assert(fread(entries.data(), sizeof(comm::pkg_entry_t), entries.size(), file) == entries.size());
+    auto lzEntry = std::find_if(entries.begin(), entries.end(), [](comm::pkg_entry_t const& entry) {
+        return entry.compression == (uint8_t)comm::PkgCompression::lzblock;
+    });
+    assert(lzEntry != entries.end());
+    comm::pkg_entry_t badEntry = *lzEntry;
+    badEntry.size = badEntry.storedSize * 255 + 1;
+    long entryPosition = (long)(header.tocOffset + (lzEntry - entries.begin()) * sizeof(comm::pkg_entry_t));
+    fseek(file, entryPosition, SEEK_SET);
+    assert(fwrite(&badEntry, sizeof(badEntry), 1, file) == 1);
+    fflush(file);
+    assert(!comm::CreatePkgArchive("pkg_archive_test.pkg"));
+    fseek(file, entryPosition, SEEK_SET);
+    assert(fwrite(&*lzEntry, sizeof(badEntry), 1, file) == 1);
+    fflush(file);
+    archive = comm::CreatePkgArchive("pkg_archive_test.pkg");
+    assert(archive);
+    archive->destroy();
+    // bucket 里的条目索引超出 entryCount 的包要拒绝打开
+    uint32_t badIndex = header.entryCount + 5;
+    fseek(file, (long)(header.tocOffset + header.entryCount * sizeof(comm::pkg_entry_t)), SEEK_SET);
+    assert(fwrite(&badIndex, sizeof(badIndex), 1, file) == 1);
+    fclose(file);
+    assert(!comm::CreatePkgArchive("pkg_archive_test.pkg"));
+    remove("pkg_archive_test.pkg");
+    return 0;
+}
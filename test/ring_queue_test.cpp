@@ -0,0 +1,180 @@
+#include <cassert>
+#include <cstdint>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <span>
+#include <thread>
+#include <vector>
+#include <threading/ring_queue.hpp>
+
+// 元素 = 生产者编号 << 32 | 该生产者内的序号，Stop 让消费者退出
+constexpr uint64_t Stop = ~0ULL;
+constexpr size_t BatchSize = 7;
+
+uint64_t MakeItem(uint32_t producer, uint32_t sequence) {
+    return ((uint64_t)producer << 32) | sequence;
+}
+
+// 单生产者单消费者：小容量反复满和空，单个和批量混着推、混着取，取出来的顺序和推进去的完全一样
+void testSPSC() {
+    constexpr uint32_t Count = 200000;
+    comm::SPSCQueue<uint64_t> queue(8);
+    assert(queue.capacity() == 8);
+    std::thread producer([&]() {
+        uint64_t items[BatchSize];
+        uint32_t next = 0;
+        while(next < Count) {
+            if(next % 3 == 0) {
+                queue.push(MakeItem(0, next++));
+            } else {
+                size_t count = std::min<size_t>(BatchSize, Count - next);
+                for(size_t i = 0; i < count; ++i) {
+                    items[i] = MakeItem(0, next++);
+                }
+                queue.pushBatch(std::span<uint64_t>(items, count));
+            }
+        }
+    });
+    uint64_t items[BatchSize];
+    uint32_t expect = 0;
+    while(expect < Count) {
+        if(expect % 2 == 0) {
+            uint64_t item;
+            queue.pop(item);
+            assert(item == MakeItem(0, expect));
+            ++expect;
+        } else {
+            size_t count = queue.popBatch(std::span<uint64_t>(items, BatchSize));
+            assert(count >= 1 && count <= BatchSize);
+            for(size_t i = 0; i < count; ++i) {
+                assert(items[i] == MakeItem(0, expect));
+                ++expect;
+            }
+        }
+    }
+    producer.join();
+    uint64_t item;
+    assert(!queue.tryPop(item) && queue.size() == 0);
+}
+
+/**
+ * @brief 多生产者多消费者：每个元素正好收到一次，每个消费者看到的同一个生产者的元素是递增的
+ *  先让消费者晚点开始，生产者把队列塞满后睡在 notFull 上；最后生产者都结束了，消费者睡在 notEmpty 上等 Stop
+ */
+void testMPMC(uint32_t producers, uint32_t consumers, uint32_t perProducer, size_t capacity) {
+    comm::MPMCQueue<uint64_t> queue(capacity);
+    std::atomic<bool> consumersGo(false);
+    std::vector<std::vector<uint32_t>> received(producers, std::vector<uint32_t>(perProducer, 0));
+    std::vector<std::vector<uint64_t>> logs(consumers);
+    std::vector<std::thread> threads;
+    for(uint32_t p = 0; p < producers; ++p) {
+        threads.emplace_back([&, p]() {
+            uint64_t items[BatchSize];
+            uint32_t next = 0;
+            while(next < perProducer) {
+                // 偶数号生产者只推单个，奇数号单个和批量交替
+                if(p % 2 == 0 || next % 2 == 0) {
+                    queue.push(MakeItem(p, next++));
+                } else {
+                    size_t count = std::min<size_t>(BatchSize, perProducer - next);
+                    for(size_t i = 0; i < count; ++i) {
+                        items[i] = MakeItem(p, next++);
+                    }
+                    queue.pushBatch(std::span<uint64_t>(items, count));
+                }
+            }
+        });
+    }
+    for(uint32_t c = 0; c < consumers; ++c) {
+        threads.emplace_back([&, c]() {
+            while(!consumersGo.load(std::memory_order_acquire)) {
+                std::this_thread::yield();
+            }
+            auto& log = logs[c];
+            uint64_t items[BatchSize];
+            uint32_t round = 0;
+            while(true) {
+                size_t count;
+                if((c + round++) % 2 == 0) {
+                    queue.pop(items[0]);
+                    count = 1;
+                } else {
+                    count = queue.popBatch(std::span<uint64_t>(items, BatchSize));
+                    assert(count >= 1 && count <= BatchSize);
+                }
+                size_t stops = 0;
+                for(size_t i = 0; i < count; ++i) {
+                    if(items[i] == Stop) {
+                        ++stops;
+                    } else {
+                        assert(!stops);     // Stop 只在所有数据之后才推
+                        log.push_back(items[i]);
+                    }
+                }
+                if(stops) {
+                    // 一批拿到了好几个 Stop，多的还回去给别的消费者
+                    for(size_t i = 1; i < stops; ++i) {
+                        queue.push(Stop);
+                    }
+                    return;
+                }
+            }
+        });
+    }
+    // 生产者推满队列之后阻塞在 push 上
+    if((uint64_t)producers * perProducer > queue.capacity()) {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        while(queue.size() != queue.capacity() && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        assert(queue.size() == queue.capacity());
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    consumersGo.store(true, std::memory_order_release);
+    for(uint32_t p = 0; p < producers; ++p) {
+        threads[p].join();
+    }
+    // 消费者取空之后阻塞在 pop 上，再叫醒它们退出
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    for(uint32_t c = 0; c < consumers; ++c) {
+        queue.push(Stop);
+    }
+    for(uint32_t c = 0; c < consumers; ++c) {
+        threads[producers + c].join();
+    }
+    uint64_t item;
+    assert(!queue.tryPop(item) && queue.size() == 0);
+    for(auto const& log : logs) {
+        std::vector<int64_t> last(producers, -1);
+        for(uint64_t value : log) {
+            uint32_t producer = (uint32_t)(value >> 32);
+            uint32_t sequence = (uint32_t)value;
+            assert(producer < producers && sequence < perProducer);
+            assert((int64_t)sequence > last[producer]);
+            last[producer] = sequence;
+            ++received[producer][sequence];
+        }
+        // 只有一个消费者时每个生产者的元素一个不落、按顺序到
+        if(consumers == 1) {
+            for(uint32_t p = 0; p < producers; ++p) {
+                assert(last[p] == (int64_t)perProducer - 1);
+            }
+        }
+    }
+    for(auto const& counts : received) {
+        for(uint32_t count : counts) {
+            assert(count == 1);
+        }
+    }
+}
+
+int main() {
+    testSPSC();
+    testMPMC(1, 1, 100000, 8);
+    testMPMC(6, 1, 20000, 16);
+    testMPMC(1, 6, 100000, 16);
+    testMPMC(4, 4, 50000, 4);
+    testMPMC(8, 8, 20000, 64);
+    return 0;
+}
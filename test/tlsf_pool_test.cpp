@@ -0,0 +1,190 @@
+#include <cassert>
+#include <cstdint>
+#include <iterator>
+#include <type_traits>
+#include <unordered_map>
+#include <memory/tlsf/comm_tlsf.h>
+
+// 物理块首尾相接铺满整个堆，没有相邻的空闲块，已分配的块正好是还活着的那些
+template<class PoolT>
+void checkPool(PoolT& pool, uint64_t poolSize, std::unordered_map<uint64_t, uint64_t> const& live) {
+    uint64_t expect = 0;
+    bool prevFree = false;
+    size_t allocated = 0;
+    pool.walk([&](comm::tlsf::BlockInfo const& block) {
+        assert(block.offset == expect);
+        assert(block.size > 0);
+        assert(!(prevFree && block.free));
+        if(!block.free) {
+            auto iter = live.find(block.offset);
+            assert(iter != live.end());
+            assert(block.size >= iter->second);
+            ++allocated;
+        }
+        expect += block.size;
+        prevFree = block.free;
+    });
+    assert(expect == poolSize);
+    assert(allocated == live.size());
+}
+
+template<class PoolT>
+void testPool(uint64_t poolSize) {
+    using OffsetT = std::remove_const_t<decltype(PoolT::InvalidOffset)>;
+    PoolT pool((OffsetT)poolSize);
+    std::unordered_map<uint64_t, uint64_t> live;
+    // 缩小原地，后面空闲时原地变大
+    OffsetT a = pool.alloc(256);
+    OffsetT b = pool.alloc(256);
+    OffsetT c = pool.alloc(256);
+    assert(a != PoolT::InvalidOffset && b != PoolT::InvalidOffset && c != PoolT::InvalidOffset);
+    bool moved = true;
+    assert(pool.realloc(b, 128, moved) == b && !moved);
+    live = { { a, 256 }, { b, 128 }, { c, 256 } };
+    checkPool(pool, poolSize, live);
+    pool.free(c);
+    live.erase(c);
+    assert(pool.realloc(b, 1024, moved) == b && !moved);
+    live[b] = 1024;
+    checkPool(pool, poolSize, live);
+    // 后面被占住、前面空闲时往前扩，起始偏移前移
+    c = pool.alloc(256);
+    live[c] = 256;
+    assert(c == b + 1024);
+    pool.free(a);
+    live.erase(a);
+    OffsetT grown = pool.realloc(b, 1200, moved);
+    assert(grown == a && moved);
+    live.erase(b);
+    live[grown] = 1200;
+    checkPool(pool, poolSize, live);
+    // 放不下时失败，原来的块不动
+    assert(pool.realloc(grown, (size_t)poolSize * 2, moved) == PoolT::InvalidOffset && !moved);
+    checkPool(pool, poolSize, live);
+    // 对齐分配
+    for(size_t alignment : { 32, 256, 4096, 65536 }) {
+        OffsetT offset = pool.alloc(100, alignment);
+        assert(offset != PoolT::InvalidOffset && offset % alignment == 0);
+        live[offset] = 100;
+    }
+    checkPool(pool, poolSize, live);
+    // 随机的分配 / 对齐分配 / realloc / 释放
+    uint64_t seed = 0x2545f4914f6cdd1dULL;
+    auto random = [&seed]() {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        return seed;
+    };
+    for(uint32_t i = 0; i < 20000; ++i) {
+        uint64_t op = random() % 4;
+        size_t size = (size_t)(random() % 8192) + 1;
+        if(op == 0 || live.empty()) {
+            OffsetT offset = pool.alloc(size);
+            if(offset != PoolT::InvalidOffset) {
+                live[offset] = size;
+            }
+        } else if(op == 1) {
+            size_t alignment = (size_t)16 << (random() % 10);
+            OffsetT offset = pool.alloc(size, alignment);
+            if(offset != PoolT::InvalidOffset) {
+                assert(offset % alignment == 0);
+                live[offset] = size;
+            }
+        } else {
+            auto iter = live.begin();
+            std::advance(iter, (size_t)(random() % live.size()));
+            uint64_t offset = iter->first;
+            if(op == 2) {
+                OffsetT result = pool.realloc((OffsetT)offset, size, moved);
+                if(result == PoolT::InvalidOffset) {
+                    assert(!moved);
+                } else {
+                    assert(moved == (result != offset));
+                    live.erase(iter);
+                    live[result] = size;
+                }
+            } else {
+                assert(pool.free((OffsetT)offset));
+                live.erase(iter);
+            }
+        }
+        if(i % 64 == 0) {
+            checkPool(pool, poolSize, live);
+        }
+    }
+    checkPool(pool, poolSize, live);
+    for(auto& item : live) {
+        pool.free((OffsetT)item.first);
+    }
+    live.clear();
+    checkPool(pool, poolSize, live);
+    auto stats = pool.stats();
+    assert(stats.allocationCount == 0 && stats.freeBlockCount == 1 && stats.freeBytes == poolSize);
+}
+
+// user-040 修过的几个问题：释放时并进前一块的节点被继续访问、原地变大后吞掉的块还留在物理链表里、析构时节点泄漏
+template<class PoolT>
+void testRegressions(uint64_t poolSize) {
+    using OffsetT = std::remove_const_t<decltype(PoolT::InvalidOffset)>;
+    bool moved = false;
+    {
+        // 前一块空闲时 free，节点在合并时被销毁
+        PoolT pool((OffsetT)poolSize);
+        OffsetT a = pool.alloc(512);
+        OffsetT b = pool.alloc(512);
+        OffsetT c = pool.alloc(512);
+        pool.free(a);
+        assert(pool.free(b));
+        checkPool(pool, poolSize, { { c, 512 } });
+        // 前一块空闲、后一块被占时 realloc 搬家，旧块释放时同样会并进前一块
+        a = pool.alloc(512);
+        b = pool.alloc(512);
+        assert(b == a + 512 && c == b + 512);
+        pool.free(a);
+        OffsetT d = pool.realloc(b, 64 * 1024, moved);
+        assert(d != PoolT::InvalidOffset && moved);
+        checkPool(pool, poolSize, { { c, 512 }, { d, 64 * 1024 } });
+        pool.free(c);
+        pool.free(d);
+        checkPool(pool, poolSize, {});
+    }
+    {
+        // 原地变大吞掉后面的空闲块，物理链表里不能再有它
+        PoolT pool((OffsetT)poolSize);
+        OffsetT a = pool.alloc(256);
+        OffsetT b = pool.alloc(256);
+        OffsetT c = pool.alloc(256);
+        pool.free(b);
+        assert(pool.realloc(a, 384, moved) == a && !moved);
+        checkPool(pool, poolSize, { { a, 384 }, { c, 256 } });
+        pool.free(a);
+        pool.free(c);
+        checkPool(pool, poolSize, {});
+    }
+    {
+        // 带着没释放的块析构、被 move 走的池子析构，节点都要还回去（ASan 下检查泄漏和重复释放）
+        PoolT pool((OffsetT)poolSize);
+        for(uint32_t i = 0; i < 64; ++i) {
+            pool.alloc(1024 + i * 16);
+        }
+        PoolT other(std::move(pool));
+        assert(other.alloc(4096) != PoolT::InvalidOffset);
+    }
+}
+
+int main() {
+    testRegressions<comm::tlsf::Pool>(16 << 20);
+    testRegressions<comm::tlsf::Pool64>(16 << 20);
+    testPool<comm::tlsf::Pool>(16 << 20);
+    testPool<comm::tlsf::Pool64>(16 << 20);
+    // Pool64 管 4GB 以上的堆（只是偏移，不真的分配内存）
+    uint64_t hugeSize = 8ULL << 30;
+    comm::tlsf::Pool64 huge(hugeSize);
+    uint64_t first = huge.alloc(5ULL << 30);
+    uint64_t second = huge.alloc(1ULL << 30, 1ULL << 20);
+    assert(first != comm::tlsf::Pool64::InvalidOffset && second != comm::tlsf::Pool64::InvalidOffset);
+    assert(second >= (5ULL << 30) && second % (1ULL << 20) == 0);
+    checkPool(huge, hugeSize, { { first, 5ULL << 30 }, { second, 1ULL << 30 } });
+    return 0;
+}
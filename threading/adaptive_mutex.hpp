@@ -0,0 +1,140 @@
+#pragma once
+
+/**
+ * @file adaptive_mutex.hpp
+ * @brief 先自旋再睡眠的互斥量，给很短的临界区用（名字池插入、ID 分配...）
+ *  linux 上直接用 futex 睡眠/唤醒，其它平台用 C++20 的 atomic::wait/notify。
+ *  自旋的次数按最近几次 “自旋多久才拿到锁” 自适应调整：经常自旋成功就多转一会，总是白转就少转。
+ *  满足 Lockable，可以配合 std::unique_lock / std::lock_guard 使用。
+ */
+
+#include <atomic>
+#include <cstdint>
+#include <algorithm>
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#include "../profile/lock_stats.h"
+
+namespace comm {
+
+    // 自旋等待里的 pause，降低功耗、给超线程的另一半让出执行单元
+    inline void CpuRelax() {
+    #if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+        _mm_pause();
+    #elif defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+    #elif defined(__aarch64__) || defined(__arm__)
+        __asm__ __volatile__("yield");
+    #endif
+    }
+
+    /**
+     * @brief 在 32 位原子量上睡眠 / 唤醒
+     */
+    inline void FutexWait(std::atomic<uint32_t>& word, uint32_t expected) {
+    #if defined(__linux__)
+        syscall(SYS_futex, (uint32_t*)&word, FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+    #else
+        word.wait(expected, std::memory_order_relaxed);
+    #endif
+    }
+
+    inline void FutexWakeOne(std::atomic<uint32_t>& word) {
+    #if defined(__linux__)
+        syscall(SYS_futex, (uint32_t*)&word, FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+    #else
+        word.notify_one();
+    #endif
+    }
+
+    inline void FutexWakeAll(std::atomic<uint32_t>& word) {
+    #if defined(__linux__)
+        syscall(SYS_futex, (uint32_t*)&word, FUTEX_WAKE_PRIVATE, INT32_MAX, nullptr, nullptr, 0);
+    #else
+        word.notify_all();
+    #endif
+    }
+
+    class AdaptiveMutex {
+    private:
+        constexpr static uint32_t   Unlocked = 0;
+        constexpr static uint32_t   Locked = 1;
+        constexpr static uint32_t   Contended = 2;      // 有线程睡在上面，解锁时要唤醒
+        constexpr static int32_t    MinSpin = 16;
+        constexpr static int32_t    MaxSpin = 1024;
+    private:
+        std::atomic<uint32_t>       _state;
+        std::atomic<int32_t>        _spinLimit;
+        [[no_unique_address]]
+        LockStats                   _stats;         // 没开 LWC_LOCK_STATS 时是空的
+    private:
+        void lockSlow() {
+            int32_t limit = _spinLimit.load(std::memory_order_relaxed);
+            int32_t spins = 0;
+            for(; spins < limit; ++spins) {
+                CpuRelax();
+                uint32_t state = _state.load(std::memory_order_relaxed);
+                if(state == Unlocked && _state.compare_exchange_weak(state, Locked, std::memory_order_acquire)) {
+                    // 自旋拿到了，下次允许转到这次的两倍左右
+                    _spinLimit.store(std::max(MinSpin, limit + (std::min(spins * 2, MaxSpin) - limit) / 8), std::memory_order_relaxed);
+                    return;
+                }
+                if(state == Contended) {
+                    break;  // 已经有人在睡了，再转也排不到前面
+                }
+            }
+            _spinLimit.store(std::max(MinSpin, limit - limit / 8), std::memory_order_relaxed);
+            // 睡眠之前把状态标成 Contended，拿到锁的时候也保持 Contended，因为不知道后面还有没有人在睡
+            while(_state.exchange(Contended, std::memory_order_acquire) != Unlocked) {
+                FutexWait(_state, Contended);
+            }
+        }
+    public:
+        AdaptiveMutex()
+            : AdaptiveMutex(nullptr)
+        {}
+
+        // name 只在打开 LWC_LOCK_STATS 时用来标识统计数据
+        explicit AdaptiveMutex(char const* name)
+            : _state(Unlocked)
+            , _spinLimit(128)
+            , _stats(name, this)
+        {}
+        AdaptiveMutex(AdaptiveMutex const&) = delete;
+        AdaptiveMutex& operator = (AdaptiveMutex const&) = delete;
+
+        void lock() {
+            uint32_t state = Unlocked;
+            if(_state.compare_exchange_strong(state, Locked, std::memory_order_acquire)) {
+                _stats.acquired(false);
+                return;
+            }
+            uint64_t begin = _stats.waitBegin();
+            lockSlow();
+            _stats.acquiredAfterWait(begin, false);
+        }
+
+        bool try_lock() {
+            uint32_t state = Unlocked;
+            if(!_state.compare_exchange_strong(state, Locked, std::memory_order_acquire)) {
+                return false;
+            }
+            _stats.acquired(false);
+            return true;
+        }
+
+        void unlock() {
+            _stats.released();
+            if(_state.exchange(Unlocked, std::memory_order_release) == Contended) {
+                FutexWakeOne(_state);
+            }
+        }
+    };
+
+}
@@ -0,0 +1,207 @@
+#include "job_system.h"
+#include "../memory/memory.h"
+
+namespace comm {
+
+    static thread_local int32_t CurrentWorkerIndex = -1;
+
+    Job* JobCounter::signal() {
+        _signaling.fetch_add(1, std::memory_order_seq_cst);
+        Job* continuations = nullptr;
+        if(_count.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            {
+                std::lock_guard<AdaptiveMutex> lock(_mutex);
+                continuations = _continuations;
+                _continuations = nullptr;
+            }
+            if(_waiters.load(std::memory_order_seq_cst)) {
+                FutexWakeAll(_count);
+            }
+        }
+        // 这之后就不能再碰计数器了
+        _signaling.fetch_sub(1, std::memory_order_release);
+        return continuations;
+    }
+
+    Job* JobSystem::AllocateJob() {
+        return (Job*)comm_alloc(sizeof(Job));
+    }
+
+    void JobSystem::FreeJob(Job* job) {
+        comm_free(job);
+    }
+
+    int32_t JobSystem::CurrentWorker() {
+        return CurrentWorkerIndex;
+    }
+
+    JobSystem::JobSystem(uint32_t workerCount)
+        : _workers()
+        , _injection()
+        , _injectionMutex()
+        , _injectionSize(0)
+        , _epoch(0)
+        , _sleepers(0)
+        , _exit(false)
+    {
+        if(!workerCount) {
+            workerCount = std::max<uint32_t>(std::thread::hardware_concurrency(), 2) - 1;
+        }
+        // 线程启动前把队列都建好，偷任务的时候不用考虑 _workers 变化
+        for(uint32_t i = 0; i < workerCount; ++i) {
+            _workers.push_back(new worker_t());
+        }
+        for(uint32_t i = 0; i < workerCount; ++i) {
+            _workers[i]->thread = std::thread(&JobSystem::workerMain, this, i);
+        }
+    }
+
+    void JobSystem::wake() {
+        _epoch.fetch_add(1, std::memory_order_seq_cst);
+        if(_sleepers.load(std::memory_order_seq_cst)) {
+            FutexWakeOne(_epoch);
+        }
+    }
+
+    void JobSystem::schedule(Job* job) {
+        int32_t self = CurrentWorkerIndex;
+        if(self >= 0) {
+            _workers[self]->deque.push(job);
+        } else {
+            std::lock_guard<AdaptiveMutex> lock(_injectionMutex);
+            _injection.push_back(job);
+            _injectionSize.fetch_add(1, std::memory_order_relaxed);
+        }
+        wake();
+    }
+
+    Job* JobSystem::findJob(int32_t self) {
+        Job* job = nullptr;
+        if(self >= 0 && _workers[self]->deque.pop(job)) {
+            return job;
+        }
+        if(_injectionSize.load(std::memory_order_relaxed)) {
+            std::lock_guard<AdaptiveMutex> lock(_injectionMutex);
+            if(!_injection.empty()) {
+                job = _injection.front();
+                _injection.pop_front();
+                _injectionSize.fetch_sub(1, std::memory_order_relaxed);
+                return job;
+            }
+        }
+        // 从随机的位置开始偷，避免大家都挤在 0 号上
+        uint32_t count = (uint32_t)_workers.size();
+        thread_local uint32_t seed = (uint32_t)(uintptr_t)&seed;
+        seed = seed * 1664525u + 1013904223u;
+        uint32_t start = (seed >> 16) % count;
+        for(uint32_t i = 0; i < count; ++i) {
+            uint32_t victim = (start + i) % count;
+            if((int32_t)victim != self && _workers[victim]->deque.steal(job)) {
+                return job;
+            }
+        }
+        return nullptr;
+    }
+
+    void JobSystem::release(JobCounter* counter) {
+        Job* continuations = counter->signal();
+        while(continuations) {
+            Job* next = continuations->next;
+            schedule(continuations);
+            continuations = next;
+        }
+    }
+
+    void JobSystem::execute(Job* job) {
+        job->invoke(job);
+        JobCounter* counter = job->counter;
+        FreeJob(job);
+        if(counter) {
+            release(counter);
+        }
+    }
+
+    void JobSystem::workerMain(uint32_t index) {
+        CurrentWorkerIndex = (int32_t)index;
+        while(!_exit.load(std::memory_order_relaxed)) {
+            if(Job* job = findJob((int32_t)index)) {
+                execute(job);
+                continue;
+            }
+            // 先记下 epoch 再找一遍，找不到才睡；这期间有新任务的话 epoch 变了，FutexWait 会马上返回
+            uint32_t epoch = _epoch.load(std::memory_order_seq_cst);
+            if(Job* job = findJob((int32_t)index)) {
+                execute(job);
+                continue;
+            }
+            if(_exit.load(std::memory_order_relaxed)) {
+                break;
+            }
+            _sleepers.fetch_add(1, std::memory_order_seq_cst);
+            FutexWait(_epoch, epoch);
+            _sleepers.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+
+    void JobSystem::wait(JobCounter& counter) {
+        int32_t self = CurrentWorkerIndex;
+        uint32_t idle = 0;
+        while(!counter.done()) {
+            if(Job* job = findJob(self)) {
+                execute(job);
+                idle = 0;
+                continue;
+            }
+            if(++idle < 64) {
+                CpuRelax();
+                continue;
+            }
+            if(self >= 0 || idle < 128) {
+                std::this_thread::yield();
+                continue;
+            }
+            // 主线程一直没活干就睡在计数器上，归零时被叫醒
+            counter._waiters.fetch_add(1, std::memory_order_seq_cst);
+            uint32_t count = counter._count.load(std::memory_order_seq_cst);
+            if(count) {
+                FutexWait(counter._count, count);
+            }
+            counter._waiters.fetch_sub(1, std::memory_order_relaxed);
+            idle = 0;
+        }
+        while(counter._signaling.load(std::memory_order_acquire)) {
+            CpuRelax();
+        }
+    }
+
+    bool JobSystem::helpOne() {
+        if(Job* job = findJob(CurrentWorkerIndex)) {
+            execute(job);
+            return true;
+        }
+        return false;
+    }
+
+    JobSystem* JobSystem::Instance() {
+        // 故意不释放，进程退出时工作线程可能还在跑
+        static JobSystem* system = new JobSystem();
+        return system;
+    }
+
+    JobSystem::~JobSystem() {
+        _exit.store(true, std::memory_order_seq_cst);
+        _epoch.fetch_add(1, std::memory_order_seq_cst);
+        FutexWakeAll(_epoch);
+        for(auto worker : _workers) {
+            worker->thread.join();
+        }
+        // 没来得及执行的任务直接执行掉，保证闭包被析构、计数器归零
+        while(Job* job = findJob(-1)) {
+            execute(job);
+        }
+        for(auto worker : _workers) {
+            delete worker;
+        }
+    }
+
+}
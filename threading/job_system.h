@@ -0,0 +1,223 @@
+#pragma once
+#include "work_stealing_deque.hpp"
+#include "adaptive_mutex.hpp"
+#include <atomic>
+#include <deque>
+#include <thread>
+#include <coroutine>
+#include <vector>
+#include <new>
+#include <utility>
+#include <type_traits>
+#include <algorithm>
+#include <cstring>
+
+namespace comm {
+
+    class JobSystem;
+
+    /**
+     * @brief 一个待执行的任务，闭包放得下就直接放在 storage 里，放不下才另外分配
+     */
+    struct Job {
+        constexpr static size_t StorageSize = 48;
+        using invoke_t = void(*)(Job* job);
+
+        invoke_t                        invoke;     // 执行并析构闭包
+        class JobCounter*               counter;    // 执行完之后减一，可以为空
+        Job*                            next;       // 挂在 JobCounter 的后继链上
+        alignas(16) unsigned char       storage[StorageSize];
+    };
+
+    /**
+     * @brief 任务计数，用来表达依赖和等待
+     *  submit 时加一，任务执行完减一；减到 0 时唤醒 wait 的线程，并且把 submitAfter 挂在它上面的任务放出来。
+     *  放在栈上的计数器要等 JobSystem::wait 返回之后才能销毁，只看 done() 不够（signal 可能还没退出）
+     */
+    class JobCounter {
+        friend class JobSystem;
+    private:
+        std::atomic<uint32_t>       _count;
+        std::atomic<uint32_t>       _waiters;
+        std::atomic<uint32_t>       _signaling;     // 正在 signal 的线程数，归零之前计数器不能销毁
+        AdaptiveMutex               _mutex;
+        Job*                        _continuations;
+    private:
+        void add(uint32_t count) {
+            _count.fetch_add(count, std::memory_order_relaxed);
+        }
+        // 返回减到 0 时放出来的后继任务
+        Job* signal();
+    public:
+        JobCounter()
+            : _count(0)
+            , _waiters(0)
+            , _signaling(0)
+            , _mutex()
+            , _continuations(nullptr)
+        {}
+        JobCounter(JobCounter const&) = delete;
+        JobCounter& operator = (JobCounter const&) = delete;
+        bool done() const {
+            return _count.load(std::memory_order_acquire) == 0;
+        }
+        uint32_t pending() const {
+            return _count.load(std::memory_order_relaxed);
+        }
+    };
+
+    /**
+     * @brief 工作窃取的任务调度器
+     *  每个工作线程有自己的 Chase-Lev 队列，工作线程里提交的任务进自己的队列（后进先出），
+     *  其它线程提交的任务进全局的注入队列，空闲的工作线程先看自己的、再看注入队列、最后去别人那偷。
+     *  wait 的时候调用线程不会干等，而是帮着执行任务，直到计数归零（help while waiting）。
+     */
+    class JobSystem {
+    private:
+        struct worker_t {
+            WorkStealingDeque<Job*>     deque;
+            std::thread                 thread;
+        };
+        std::vector<worker_t*>      _workers;
+        std::deque<Job*>            _injection;
+        AdaptiveMutex               _injectionMutex;
+        std::atomic<uint32_t>       _injectionSize;
+        std::atomic<uint32_t>       _epoch;         // 每次有新任务加一，空闲线程在它上面睡
+        std::atomic<uint32_t>       _sleepers;
+        std::atomic<bool>           _exit;
+    private:
+        // workerCount 为 0 时用 硬件线程数 - 1（至少 1 个）
+        JobSystem(uint32_t workerCount = 0);
+        void workerMain(uint32_t index);
+        Job* findJob(int32_t self);
+        void execute(Job* job);
+        void schedule(Job* job);
+        void wake();
+        void release(JobCounter* counter);
+
+        template<class F>
+        static Job* MakeJob(F&& fn, JobCounter* counter) {
+            using closure_t = std::decay_t<F>;
+            Job* job = AllocateJob();
+            job->counter = counter;
+            job->next = nullptr;
+            if constexpr (sizeof(closure_t) <= Job::StorageSize && alignof(closure_t) <= 16) {
+                new (job->storage) closure_t(std::forward<F>(fn));
+                job->invoke = [](Job* job) {
+                    closure_t* closure = std::launder(reinterpret_cast<closure_t*>(job->storage));
+                    (*closure)();
+                    closure->~closure_t();
+                };
+            } else {
+                auto closure = new closure_t(std::forward<F>(fn));
+                memcpy(job->storage, &closure, sizeof(closure));
+                job->invoke = [](Job* job) {
+                    closure_t* closure;
+                    memcpy(&closure, job->storage, sizeof(closure));
+                    (*closure)();
+                    delete closure;
+                };
+            }
+            return job;
+        }
+        static Job* AllocateJob();
+        static void FreeJob(Job* job);
+
+        template<class F>
+        void splitRange(size_t begin, size_t end, size_t grain, F const& fn, JobCounter& counter) {
+            // 每次把右半边丢出去给别人偷，自己接着切左半边，最后执行剩下的一小段
+            while(end - begin > grain) {
+                size_t middle = begin + (end - begin) / 2;
+                submit([this, middle, end, grain, &fn, &counter]() {
+                    splitRange(middle, end, grain, fn, counter);
+                }, &counter);
+                end = middle;
+            }
+            fn(begin, end);
+        }
+    public:
+        // 第一次调用时创建，任意线程都可能最先调到（预读、Spawn、异步读完成），用函数内的静态变量保证只有一个实例
+        static JobSystem* Instance();
+        uint32_t workerCount() const {
+            return (uint32_t)_workers.size();
+        }
+        // 当前线程是第几个工作线程，不是工作线程返回 -1
+        static int32_t CurrentWorker();
+
+        template<class F>
+        void submit(F&& fn, JobCounter* counter = nullptr) {
+            if(counter) {
+                counter->add(1);
+            }
+            schedule(MakeJob(std::forward<F>(fn), counter));
+        }
+
+        // dependency 归零之后才执行 fn
+        template<class F>
+        void submitAfter(JobCounter& dependency, F&& fn, JobCounter* counter = nullptr) {
+            if(counter) {
+                counter->add(1);
+            }
+            Job* job = MakeJob(std::forward<F>(fn), counter);
+            {
+                std::lock_guard<AdaptiveMutex> lock(dependency._mutex);
+                if(!dependency.done()) {
+                    job->next = dependency._continuations;
+                    dependency._continuations = job;
+                    return;
+                }
+            }
+            schedule(job);
+        }
+
+        /**
+         * @brief 手动给计数器加减，让 I/O 回调、协程之类不是 Job 的异步操作也能被 wait / submitAfter 依赖
+         *  每个 addPending 对应一次 complete
+         */
+        void addPending(JobCounter& counter, uint32_t count = 1) {
+            counter.add(count);
+        }
+        void complete(JobCounter& counter) {
+            release(&counter);
+        }
+
+        // 在工作线程上恢复一个挂起的协程
+        void resume(std::coroutine_handle<> handle) {
+            submit([handle]() {
+                handle.resume();
+            });
+        }
+
+        /**
+         * @brief 等 counter 归零，等待期间帮着执行任务
+         *  工作线程里（任务里嵌套等待）只会自旋让出，不会睡眠，避免所有工作线程都睡在等待上
+         */
+        void wait(JobCounter& counter);
+
+        /**
+         * @brief 拿一个任务在当前线程执行，没有可执行的任务返回 false
+         *  给自己用条件变量等任务结果的代码用：返回 false 说明等的任务已经在别的线程上跑了，可以放心睡
+         */
+        bool helpOne();
+
+        /**
+         * @brief 把 [begin, end) 切成不小于 grain 的段并行执行 fn(segmentBegin, segmentEnd)，返回时全部执行完
+         *  grain 为 0 时按工作线程数自动选，大约每个线程 4 段
+         */
+        template<class F>
+        void parallelFor(size_t begin, size_t end, size_t grain, F const& fn) {
+            if(begin >= end) {
+                return;
+            }
+            if(!grain) {
+                grain = std::max<size_t>(1, (end - begin) / ((size_t)(workerCount() + 1) * 4));
+            }
+            JobCounter counter;
+            splitRange(begin, end, grain, fn, counter);
+            wait(counter);
+        }
+
+        ~JobSystem();
+    };
+
+}
@@ -0,0 +1,374 @@
+#pragma once
+
+/**
+ * @file ring_queue.hpp
+ * @brief 有界无锁环形队列
+ *  - SPSCQueue：单生产者单消费者，头尾各占一条缓存行，各自缓存对方的位置，大多数操作不碰对方的缓存行
+ *  - MPMCQueue：多生产者多消费者，Vyukov 的做法，每个格子带一个序号，生产者/消费者用 CAS 抢位置
+ *  容量向上取整到 2 的幂。try* 不阻塞，push/pop 满了/空了先自旋一会，再睡在 futex 上。
+ *  批量接口一次搬多个元素，只有一次 CAS（或一次发布），适合日志、I/O 完成这种一次来一批的场景。
+ */
+
+#include "adaptive_mutex.hpp"
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <span>
+#include <utility>
+#include <algorithm>
+
+namespace comm {
+
+    /**
+     * @brief 队列的等待策略：先自旋，再睡在 epoch 上
+     *  _waiting 只是个标记，notify 把它清掉并唤醒所有人，没醒的人重试失败会重新标记；
+     *  这样被唤醒的线程还没来得及运行时，后面的 notify 不会一次次进内核
+     */
+    class QueueWaiter {
+    private:
+        constexpr static uint32_t   SpinCount = 128;
+    private:
+        std::atomic<uint32_t>       _epoch;
+        std::atomic<uint32_t>       _waiting;
+    public:
+        QueueWaiter()
+            : _epoch(0)
+            , _waiting(0)
+        {}
+        void notify() {
+            // 和 wait 里标记之后的 fence 配对：要么我们看到标记，要么它重试时看到新数据
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if(_waiting.load(std::memory_order_relaxed) && _waiting.exchange(0, std::memory_order_relaxed)) {
+                _epoch.fetch_add(1, std::memory_order_release);
+                FutexWakeAll(_epoch);
+            }
+        }
+        // 反复调用 attempt 直到它返回 true
+        template<class F>
+        void wait(F&& attempt) {
+            for(uint32_t i = 0; i < SpinCount; ++i) {
+                if(attempt()) {
+                    return;
+                }
+                CpuRelax();
+            }
+            while(true) {
+                uint32_t epoch = _epoch.load(std::memory_order_acquire);
+                _waiting.store(1, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if(attempt()) {
+                    return;
+                }
+                FutexWait(_epoch, epoch);
+                if(attempt()) {
+                    return;
+                }
+            }
+        }
+    };
+
+    inline size_t RingQueueCapacity(size_t capacity) {
+        size_t cap = 2;
+        while(cap < capacity) {
+            cap <<= 1;
+        }
+        return cap;
+    }
+
+    template<class T>
+    class SPSCQueue {
+    private:
+        struct alignas(64) producer_t {
+            std::atomic<size_t>     tail;
+            size_t                  headCache;      // 上次看到的 head，不够用了才重新读
+        };
+        struct alignas(64) consumer_t {
+            std::atomic<size_t>     head;
+            size_t                  tailCache;
+        };
+        producer_t          _producer;
+        consumer_t          _consumer;
+        alignas(64) size_t  _mask;
+        T*                  _items;
+        QueueWaiter         _notEmpty;
+        QueueWaiter         _notFull;
+    private:
+        size_t reserveWrite(size_t count) {
+            size_t tail = _producer.tail.load(std::memory_order_relaxed);
+            size_t capacity = _mask + 1;
+            if(capacity - (tail - _producer.headCache) < count) {
+                _producer.headCache = _consumer.head.load(std::memory_order_acquire);
+            }
+            return std::min(count, capacity - (tail - _producer.headCache));
+        }
+        size_t reserveRead(size_t count) {
+            size_t head = _consumer.head.load(std::memory_order_relaxed);
+            if(_consumer.tailCache - head < count) {
+                _consumer.tailCache = _producer.tail.load(std::memory_order_acquire);
+            }
+            return std::min(count, _consumer.tailCache - head);
+        }
+    public:
+        explicit SPSCQueue(size_t capacity)
+            : _producer { {0}, 0 }
+            , _consumer { {0}, 0 }
+            , _mask(RingQueueCapacity(capacity) - 1)
+            , _items(new T[_mask + 1])
+            , _notEmpty()
+            , _notFull()
+        {}
+        SPSCQueue(SPSCQueue const&) = delete;
+        SPSCQueue& operator = (SPSCQueue const&) = delete;
+
+        size_t capacity() const {
+            return _mask + 1;
+        }
+        // 近似值，只能用来做统计
+        size_t size() const {
+            return _producer.tail.load(std::memory_order_relaxed) - _consumer.head.load(std::memory_order_relaxed);
+        }
+
+        // 生产者线程
+        template<class U>
+        bool tryPush(U&& item) {
+            if(!reserveWrite(1)) {
+                return false;
+            }
+            size_t tail = _producer.tail.load(std::memory_order_relaxed);
+            _items[tail & _mask] = std::forward<U>(item);
+            _producer.tail.store(tail + 1, std::memory_order_release);
+            _notEmpty.notify();
+            return true;
+        }
+        // 生产者线程，返回实际放进去的个数，放进去的元素被 move 走
+        size_t tryPushBatch(std::span<T> items) {
+            size_t count = reserveWrite(items.size());
+            if(!count) {
+                return 0;
+            }
+            size_t tail = _producer.tail.load(std::memory_order_relaxed);
+            for(size_t i = 0; i < count; ++i) {
+                _items[(tail + i) & _mask] = std::move(items[i]);
+            }
+            _producer.tail.store(tail + count, std::memory_order_release);
+            _notEmpty.notify();
+            return count;
+        }
+        template<class U>
+        void push(U&& item) {
+            if(tryPush(std::forward<U>(item))) {
+                return;
+            }
+            _notFull.wait([&]() { return tryPush(std::forward<U>(item)); });
+        }
+        void pushBatch(std::span<T> items) {
+            size_t pushed = tryPushBatch(items);
+            while(pushed < items.size()) {
+                _notFull.wait([&]() {
+                    size_t count = tryPushBatch(items.subspan(pushed));
+                    pushed += count;
+                    return count != 0;
+                });
+            }
+        }
+
+        // 消费者线程
+        bool tryPop(T& item) {
+            if(!reserveRead(1)) {
+                return false;
+            }
+            size_t head = _consumer.head.load(std::memory_order_relaxed);
+            item = std::move(_items[head & _mask]);
+            _consumer.head.store(head + 1, std::memory_order_release);
+            _notFull.notify();
+            return true;
+        }
+        // 消费者线程，返回取出的个数
+        size_t tryPopBatch(std::span<T> items) {
+            size_t count = reserveRead(items.size());
+            if(!count) {
+                return 0;
+            }
+            size_t head = _consumer.head.load(std::memory_order_relaxed);
+            for(size_t i = 0; i < count; ++i) {
+                items[i] = std::move(_items[(head + i) & _mask]);
+            }
+            _consumer.head.store(head + count, std::memory_order_release);
+            _notFull.notify();
+            return count;
+        }
+        void pop(T& item) {
+            if(tryPop(item)) {
+                return;
+            }
+            _notEmpty.wait([&]() { return tryPop(item); });
+        }
+        // 至少取到一个才返回
+        size_t popBatch(std::span<T> items) {
+            size_t count = tryPopBatch(items);
+            if(!count && !items.empty()) {
+                _notEmpty.wait([&]() {
+                    count = tryPopBatch(items);
+                    return count != 0;
+                });
+            }
+            return count;
+        }
+
+        ~SPSCQueue() {
+            delete[] _items;
+        }
+    };
+
+    template<class T>
+    class MPMCQueue {
+    private:
+        struct cell_t {
+            std::atomic<size_t>     sequence;   // == 位置：空，可以写；== 位置 + 1：有数据，可以读
+            T                       data;
+        };
+        cell_t*                         _cells;
+        size_t                          _mask;
+        alignas(64) std::atomic<size_t> _enqueuePos;
+        alignas(64) std::atomic<size_t> _dequeuePos;
+        alignas(64) QueueWaiter         _notEmpty;
+        QueueWaiter                     _notFull;
+    private:
+        /**
+         * @brief 从 pos 开始连续抢最多 count 个格子，ready 表示格子处于可用状态时序号比位置大多少（写 0，读 1）
+         *  一次 CAS 把位置推过去，抢到的格子就归自己了
+         */
+        size_t claim(std::atomic<size_t>& position, size_t ready, size_t count, size_t& pos) {
+            pos = position.load(std::memory_order_relaxed);
+            while(true) {
+                size_t n = 0;
+                while(n < count && _cells[(pos + n) & _mask].sequence.load(std::memory_order_acquire) == pos + n + ready) {
+                    ++n;
+                }
+                if(!n) {
+                    size_t seq = _cells[pos & _mask].sequence.load(std::memory_order_acquire);
+                    if((intptr_t)(seq - (pos + ready)) < 0) {
+                        return 0;   // 满了（写）/ 空了（读）
+                    }
+                    pos = position.load(std::memory_order_relaxed);   // 被别人抢先了
+                    continue;
+                }
+                if(position.compare_exchange_weak(pos, pos + n, std::memory_order_relaxed)) {
+                    return n;
+                }
+            }
+        }
+    public:
+        explicit MPMCQueue(size_t capacity)
+            : _cells(nullptr)
+            , _mask(RingQueueCapacity(capacity) - 1)
+            , _enqueuePos(0)
+            , _dequeuePos(0)
+            , _notEmpty()
+            , _notFull()
+        {
+            _cells = new cell_t[_mask + 1];
+            for(size_t i = 0; i <= _mask; ++i) {
+                _cells[i].sequence.store(i, std::memory_order_relaxed);
+            }
+        }
+        MPMCQueue(MPMCQueue const&) = delete;
+        MPMCQueue& operator = (MPMCQueue const&) = delete;
+
+        size_t capacity() const {
+            return _mask + 1;
+        }
+        size_t size() const {
+            return _enqueuePos.load(std::memory_order_relaxed) - _dequeuePos.load(std::memory_order_relaxed);
+        }
+
+        template<class U>
+        bool tryPush(U&& item) {
+            size_t pos;
+            if(!claim(_enqueuePos, 0, 1, pos)) {
+                return false;
+            }
+            cell_t& cell = _cells[pos & _mask];
+            cell.data = std::forward<U>(item);
+            cell.sequence.store(pos + 1, std::memory_order_release);
+            _notEmpty.notify();
+            return true;
+        }
+        size_t tryPushBatch(std::span<T> items) {
+            size_t pos;
+            size_t count = claim(_enqueuePos, 0, items.size(), pos);
+            for(size_t i = 0; i < count; ++i) {
+                cell_t& cell = _cells[(pos + i) & _mask];
+                cell.data = std::move(items[i]);
+                cell.sequence.store(pos + i + 1, std::memory_order_release);
+            }
+            if(count) {
+                _notEmpty.notify();
+            }
+            return count;
+        }
+        template<class U>
+        void push(U&& item) {
+            if(tryPush(std::forward<U>(item))) {
+                return;
+            }
+            _notFull.wait([&]() { return tryPush(std::forward<U>(item)); });
+        }
+        void pushBatch(std::span<T> items) {
+            size_t pushed = tryPushBatch(items);
+            while(pushed < items.size()) {
+                _notFull.wait([&]() {
+                    size_t count = tryPushBatch(items.subspan(pushed));
+                    pushed += count;
+                    return count != 0;
+                });
+            }
+        }
+
+        bool tryPop(T& item) {
+            size_t pos;
+            if(!claim(_dequeuePos, 1, 1, pos)) {
+                return false;
+            }
+            cell_t& cell = _cells[pos & _mask];
+            item = std::move(cell.data);
+            cell.sequence.store(pos + _mask + 1, std::memory_order_release);
+            _notFull.notify();
+            return true;
+        }
+        size_t tryPopBatch(std::span<T> items) {
+            size_t pos;
+            size_t count = claim(_dequeuePos, 1, items.size(), pos);
+            for(size_t i = 0; i < count; ++i) {
+                cell_t& cell = _cells[(pos + i) & _mask];
+                items[i] = std::move(cell.data);
+                cell.sequence.store(pos + i + _mask + 1, std::memory_order_release);
+            }
+            if(count) {
+                _notFull.notify();
+            }
+            return count;
+        }
+        void pop(T& item) {
+            if(tryPop(item)) {
+                return;
+            }
+            _notEmpty.wait([&]() { return tryPop(item); });
+        }
+        size_t popBatch(std::span<T> items) {
+            size_t count = tryPopBatch(items);
+            if(!count && !items.empty()) {
+                _notEmpty.wait([&]() {
+                    count = tryPopBatch(items);
+                    return count != 0;
+                });
+            }
+            return count;
+        }
+
+        ~MPMCQueue() {
+            delete[] _cells;
+        }
+    };
+
+}
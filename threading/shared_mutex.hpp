@@ -4,128 +4,412 @@
  * @file shared_mutex.hpp
  * @author 李新
  * @brief 读写锁（共享锁）
- * 如果当前版本的编译器标准库中没有shared_mutex那么可以用它
- * 从 boost 库中抄出来的，并添加了关键注释
- * @version 0.1
- * 
+ * 最早从 boost 库中抄出来（所有操作都要进内部的 mutex），
+ * 现在改成了状态放在一个原子变量里，没有写者的时候读锁/解读锁只是一次原子操作，
+ * mutex 和条件变量只在真的需要等待的时候才用。写优先：写者一旦进入，新的读者就要等。
+ * @version 0.2
+ *
  */
 
 #include <condition_variable>
 #include <mutex>
+#include <atomic>
+#include <thread>
+#include <cstdint>
 #include <cassert>
+#include "../profile/profiler.h"
+#include "../profile/lock_stats.h"
 
 namespace comm {
 
     class SharedMutex {
     private:
-        constexpr static uint32_t           _writerMask = 1<<31;
-        constexpr static uint32_t           _readerMask = UINT32_MAX>>1;
+        constexpr static uint32_t           _writerMask = 1u<<31;       // 有写者持有锁或者在等读者退出
+        constexpr static uint32_t           _waiterMask = 1u<<30;       // 有线程睡在 _sharedCV 上
+        constexpr static uint32_t           _upgradeMask = 1u<<29;      // 有可升级的读者，它同时也算在读者计数里
+        constexpr static uint32_t           _readerMask = _upgradeMask - 1;
     private:
         mutable std::mutex                  _mutex;
         mutable std::condition_variable     _sharedCV;          // read condition variable
         mutable std::condition_variable     _exclusiveCV;       // write condition variable
-        mutable uint32_t                    _statusBits;
+        mutable std::atomic<uint32_t>       _statusBits;
+        [[no_unique_address]]
+        mutable LockStats                   _stats;             // 没开 LWC_LOCK_STATS 时是空的
     private:
-        bool writerEntered() const { return !!(_statusBits&_writerMask); }
-        bool writable() const { return 0 == _statusBits; }
-        uint32_t readerCount() const { return _statusBits&_readerMask; }
-        void setReaderCount( uint32_t count ) const { _statusBits&=~_readerMask; _statusBits|=count; }
+        /**
+         * @brief 解析（李新）
+         * 睡眠前在锁内先置上 _waiterMask 再检查条件，唤醒方先清标记再进锁 notify，
+         * 所以不会出现检查完条件、还没睡下就错过通知的情况
+         */
+        void waitCleared(std::unique_lock<std::mutex>& lock, uint32_t mask) const {
+            uint32_t status = _statusBits.fetch_or(_waiterMask, std::memory_order_relaxed);
+            if(status & mask) {
+                _sharedCV.wait(lock);
+            }
+        }
+
+        // 把状态改成 transform(status)，同时清掉等待标记，有人在睡就叫醒
+        template<class Transform>
+        void releaseAndWake(Transform transform) const {
+            uint32_t status = _statusBits.load(std::memory_order_relaxed);
+            while(!_statusBits.compare_exchange_weak(status, transform(status) & ~_waiterMask, std::memory_order_release)) {
+            }
+            if(status & _waiterMask) {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _sharedCV.notify_all();
+            }
+        }
+
+        // 返回是否真的等过
+        bool waitReadersDrained() const {
+            if((_statusBits.load(std::memory_order_acquire) & _readerMask) == 0) {
+                return false;
+            }
+            LWC_PROFILE_ZONE("SharedMutex::waitReadersDrained");
+            std::unique_lock<std::mutex> lock(_mutex);
+            _exclusiveCV.wait(lock, [this]()->bool{
+                return (_statusBits.load(std::memory_order_acquire) & _readerMask) == 0;
+            });
+            return true;
+        }
+
+        // 读者数量降到 0 时如果有写者在等，叫醒它
+        void readerLeft(uint32_t status) const {
+            if((status & (_writerMask|_readerMask)) == _writerMask) {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _exclusiveCV.notify_one();
+            }
+        }
+
+        void lockSlow() const {
+            LWC_PROFILE_ZONE("SharedMutex::lockSlow");
+            std::unique_lock<std::mutex> lock(_mutex);
+            // 第一阶段，抢到写位（有可升级的读者时也要等，否则它升级的时候会和我们互相等）
+            while(true) {
+                uint32_t status = _statusBits.load(std::memory_order_relaxed);
+                if(!(status & (_writerMask|_upgradeMask))) {
+                    if(_statusBits.compare_exchange_weak(status, status|_writerMask, std::memory_order_acquire)) {
+                        break;
+                    }
+                    continue;
+                }
+                waitCleared(lock, _writerMask|_upgradeMask);
+            }
+            // 第二阶段，等已经进去的读者退出
+            _exclusiveCV.wait(lock, [this]()->bool{
+                return (_statusBits.load(std::memory_order_acquire) & _readerMask) == 0;
+            });
+        }
+
+        void lockSharedSlow() const {
+            LWC_PROFILE_ZONE("SharedMutex::lockSharedSlow");
+            std::unique_lock<std::mutex> lock(_mutex);
+            while(true) {
+                uint32_t status = _statusBits.load(std::memory_order_relaxed);
+                if(!(status & _writerMask)) {
+                    if(_statusBits.compare_exchange_weak(status, status + 1, std::memory_order_acquire)) {
+                        return;
+                    }
+                    continue;
+                }
+                waitCleared(lock, _writerMask);
+            }
+        }
+
+        void lockUpgradeSlow() const {
+            LWC_PROFILE_ZONE("SharedMutex::lockUpgradeSlow");
+            std::unique_lock<std::mutex> lock(_mutex);
+            while(true) {
+                uint32_t status = _statusBits.load(std::memory_order_relaxed);
+                if(!(status & (_writerMask|_upgradeMask))) {
+                    if(_statusBits.compare_exchange_weak(status, (status + 1)|_upgradeMask, std::memory_order_acquire)) {
+                        return;
+                    }
+                    continue;
+                }
+                waitCleared(lock, _writerMask|_upgradeMask);
+            }
+        }
     public:
         SharedMutex()
+            : SharedMutex(nullptr)
+        {}
+
+        // name 只在打开 LWC_LOCK_STATS 时用来标识统计数据
+        explicit SharedMutex(char const* name)
             : _mutex()
             , _sharedCV()
             , _exclusiveCV()
             , _statusBits(0)
+            , _stats(name, this)
         {}
 
         void lock() const {
-            std::unique_lock<std::mutex> lock(_mutex);
-            // 第一阶段
-            _sharedCV.wait(lock,[this]()->bool{
-                return !writerEntered();
-            });
-            _statusBits |= _writerMask;
-            // 第二阶段
-            _exclusiveCV.wait(lock,[this]()->bool{
-                return readerCount() == 0;
-            });
+            uint32_t status = _statusBits.load(std::memory_order_relaxed);
+            if(!(status & (_writerMask|_upgradeMask|_readerMask))
+                && _statusBits.compare_exchange_strong(status, status|_writerMask, std::memory_order_acquire)) {
+                _stats.acquired(false);
+                return;
+            }
+            uint64_t begin = _stats.waitBegin();
+            lockSlow();
+            _stats.acquiredAfterWait(begin, false);
         }
 
         bool try_lock() const {
-            std::unique_lock<std::mutex> lock(_mutex);
-            if(!writable()) {
+            uint32_t status = _statusBits.load(std::memory_order_relaxed);
+            if(status & (_writerMask|_upgradeMask|_readerMask)) {
                 return false;
             }
-            _statusBits = _writerMask;
+            if(!_statusBits.compare_exchange_strong(status, status|_writerMask, std::memory_order_acquire)) {
+                return false;
+            }
+            _stats.acquired(false);
             return true;
         }
 
         void unlock() const {
-            // TODO: 防止调用者胡乱调用应该加一些断言
-            std::unique_lock<std::mutex> lock(_mutex);
-            _statusBits = 0;
+            _stats.released();
+            uint32_t status = _statusBits.fetch_and(~(_writerMask|_waiterMask), std::memory_order_release);
+            assert(status & _writerMask);
             /**
              * @brief 解析（李新）
-             * 通知其它写线程和读线程
+             * 有人在睡才进锁通知其它写线程和读线程
              */
-            _sharedCV.notify_all();
+            if(status & _waiterMask) {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _sharedCV.notify_all();
+            }
         }
 
         void lock_shared() const {
-            std::unique_lock<std::mutex> lock(_mutex);
             /**
              * @brief 解析（李新）
-             * 这里主要是要等待两个条件
-             * *1 写锁在等待的时候会更改写位，如果这个写位被修改了则读锁要等待
-             * *2 读锁有个计数上限，超过了也不行
-             * 所以这里需要判断这两个条件，而读锁计数上限是 _readerMask ，
-             * 小于它写位必然为0，所在这里直接判断小于 _readerMask即可
+             * 快速路径：直接加读者计数，没有写者就拿到了锁。
+             * 有写者（持有或者在等）的话把计数退回去，退回的时候可能正好是写者在等的最后一个读者，
+             * 要叫醒它，然后进锁排队
              */
-            _sharedCV.wait(lock, [this]()->bool{
-                return _readerMask>_statusBits;
-            });
-            ++_statusBits;
+            uint32_t status = _statusBits.fetch_add(1, std::memory_order_acquire);
+            if(!(status & _writerMask)) {
+                _stats.acquired(true);
+                return;
+            }
+            uint64_t begin = _stats.waitBegin();
+            readerLeft(_statusBits.fetch_sub(1, std::memory_order_release) - 1);
+            lockSharedSlow();
+            _stats.acquiredAfterWait(begin, true);
         }
 
         bool try_lock_shared() const {
+            uint32_t status = _statusBits.load(std::memory_order_relaxed);
+            while(!(status & _writerMask)) {
+                if(_statusBits.compare_exchange_weak(status, status + 1, std::memory_order_acquire)) {
+                    _stats.acquired(true);
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void unlock_shared() const {
+            uint32_t status = _statusBits.fetch_sub(1, std::memory_order_release) - 1;
+            assert(((status + 1) & _readerMask) != 0);
+            readerLeft(status);
+        }
+
+        /**
+         * @brief 可升级的读锁：和普通读者共存，但同一时间只有一个，并且排斥写者。
+         *  用在 先读着检查、需要的时候再改 的地方，升级时不用先放掉读锁再去抢写锁，中间状态也不会被别的写者改掉
+         */
+        void lock_upgrade() const {
+            uint32_t status = _statusBits.load(std::memory_order_relaxed);
+            if(!(status & (_writerMask|_upgradeMask))
+                && _statusBits.compare_exchange_strong(status, (status + 1)|_upgradeMask, std::memory_order_acquire)) {
+                _stats.acquired(true);
+                return;
+            }
+            uint64_t begin = _stats.waitBegin();
+            lockUpgradeSlow();
+            _stats.acquiredAfterWait(begin, true);
+        }
+
+        void unlock_upgrade() const {
+            assert(_statusBits.load(std::memory_order_relaxed) & _upgradeMask);
+            releaseAndWake([](uint32_t status) {
+                return (status - 1) & ~_upgradeMask;
+            });
+        }
+
+        // 可升级读锁 -> 写锁，等其它读者退出
+        void unlock_upgrade_and_lock() const {
+            uint64_t begin = _stats.waitBegin();
+            uint32_t status = _statusBits.load(std::memory_order_relaxed);
+            assert(status & _upgradeMask);
+            // 持有升级位时不会有写者，直接换成写位，新的读者从这一刻起开始等
+            while(!_statusBits.compare_exchange_weak(status, ((status - 1) & ~_upgradeMask)|_writerMask, std::memory_order_acquire)) {
+            }
+            if(waitReadersDrained()) {
+                _stats.acquiredAfterWait(begin, false);
+            } else {
+                _stats.acquired(false);
+            }
+        }
+
+        // 写锁 -> 可升级读锁，放等着的读者进来
+        void unlock_and_lock_upgrade() const {
+            assert(_statusBits.load(std::memory_order_relaxed) & _writerMask);
+            _stats.released();
+            releaseAndWake([](uint32_t status) {
+                return ((status & ~_writerMask) + 1)|_upgradeMask;
+            });
+        }
+
+        // 写锁 -> 读锁
+        void unlock_and_lock_shared() const {
+            assert(_statusBits.load(std::memory_order_relaxed) & _writerMask);
+            _stats.released();
+            releaseAndWake([](uint32_t status) {
+                return (status & ~_writerMask) + 1;
+            });
+        }
+
+        // 可升级读锁 -> 普通读锁，让出升级位
+        void unlock_upgrade_and_lock_shared() const {
+            assert(_statusBits.load(std::memory_order_relaxed) & _upgradeMask);
+            releaseAndWake([](uint32_t status) {
+                return status & ~_upgradeMask;
+            });
+        }
+    };
+
+    /**
+     * @brief 读者计数分散到多个缓存行上的读写锁，用在读远多于写的数据上
+     *  每个线程固定用其中一个槽，读者之间不会抢同一条缓存行；代价是写锁要检查所有的槽，而且占用 Stripes 条缓存行
+     */
+    template<uint32_t Stripes = 16>
+    class StripedSharedMutex {
+        static_assert(Stripes && (Stripes & (Stripes - 1)) == 0, "Stripes must be a power of two");
+    private:
+        struct alignas(64) stripe_t {
+            std::atomic<uint32_t>   readers;
+        };
+    private:
+        mutable stripe_t                    _stripes[Stripes];
+        mutable std::atomic<bool>           _writer;
+        mutable std::atomic<uint32_t>       _waiters;
+        mutable std::mutex                  _mutex;
+        mutable std::condition_variable     _sharedCV;
+        mutable std::condition_variable     _exclusiveCV;
+    private:
+        static uint32_t stripeIndex() {
+            static std::atomic<uint32_t> counter(0);
+            thread_local uint32_t index = counter.fetch_add(1, std::memory_order_relaxed) & (Stripes - 1);
+            return index;
+        }
+
+        bool drained() const {
+            for(auto& stripe : _stripes) {
+                if(stripe.readers.load(std::memory_order_seq_cst)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        void readerLeft(stripe_t& stripe) const {
+            stripe.readers.fetch_sub(1, std::memory_order_seq_cst);
+            if(_writer.load(std::memory_order_seq_cst)) {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _exclusiveCV.notify_one();
+            }
+        }
+    public:
+        StripedSharedMutex()
+            : _writer(false)
+            , _waiters(0)
+        {
+            for(auto& stripe : _stripes) {
+                stripe.readers.store(0, std::memory_order_relaxed);
+            }
+        }
+
+        void lock() const {
             std::unique_lock<std::mutex> lock(_mutex);
-            if(_readerMask <= _statusBits) {
+            while(_writer.exchange(true, std::memory_order_seq_cst)) {
+                ++_waiters;
+                _sharedCV.wait(lock);
+                --_waiters;
+            }
+            _exclusiveCV.wait(lock, [this]()->bool{
+                return drained();
+            });
+        }
+
+        bool try_lock() const {
+            if(_writer.exchange(true, std::memory_order_seq_cst)) {
+                return false;
+            }
+            if(!drained()) {
+                unlock();
                 return false;
             }
-            ++_statusBits;
             return true;
         }
 
-        void unlock_shared() const {
-            // TODO: 防止调用者胡乱调用应该加一些断言
+        void unlock() const {
             std::unique_lock<std::mutex> lock(_mutex);
-            auto readerNum = readerCount()-1;
-            setReaderCount(readerNum);
-            if(writerEntered()) {
-                // 表明写锁lock已经进入第一阶段，优先唤醒写锁
-                if(readerCount() == 0) {
-                    _exclusiveCV.notify_one();
-                }
-            } else {
-                // 从读满的状态到不满的状态，通知写锁进入第一阶段或者读线程唤醒
-                if(readerNum == _readerMask-1) {
-                    _sharedCV.notify_one();
+            _writer.store(false, std::memory_order_seq_cst);
+            if(_waiters) {
+                _sharedCV.notify_all();
+            }
+        }
+
+        void lock_shared() const {
+            stripe_t& stripe = _stripes[stripeIndex()];
+            while(true) {
+                // 先加计数再看写标记，和写者的 先置标记再看计数 配对（都是 seq_cst）
+                stripe.readers.fetch_add(1, std::memory_order_seq_cst);
+                if(!_writer.load(std::memory_order_seq_cst)) {
+                    return;
                 }
+                readerLeft(stripe);
+                std::unique_lock<std::mutex> lock(_mutex);
+                ++_waiters;
+                _sharedCV.wait(lock, [this]()->bool{
+                    return !_writer.load(std::memory_order_seq_cst);
+                });
+                --_waiters;
             }
         }
+
+        bool try_lock_shared() const {
+            stripe_t& stripe = _stripes[stripeIndex()];
+            stripe.readers.fetch_add(1, std::memory_order_seq_cst);
+            if(!_writer.load(std::memory_order_seq_cst)) {
+                return true;
+            }
+            readerLeft(stripe);
+            return false;
+        }
+
+        void unlock_shared() const {
+            readerLeft(_stripes[stripeIndex()]);
+        }
     };
 
-    class SharedMutexLock {
+    template<class Mutex>
+    class BasicSharedMutexLock {
         enum class LockStatus {
             None,
             Shared,
+            Upgrade,
             Exclusive,
         };
     private:
-        SharedMutex*    _mutex;
+        Mutex*          _mutex;
         LockStatus      _status;
     public:
-        SharedMutexLock(SharedMutex& mutex )
+        BasicSharedMutexLock(Mutex& mutex )
             : _mutex(&mutex)
             , _status(LockStatus::None)
         {}
@@ -148,14 +432,51 @@ namespace comm {
             _status = LockStatus::Exclusive;
         }
 
-        ~SharedMutexLock() {
+        // 以下只有 SharedMutex 支持
+        void lock_upgrade() {
+            assert( _status == LockStatus::None);
+            if(_status != LockStatus::None) {
+                return;
+            }
+            _mutex->lock_upgrade();
+            _status = LockStatus::Upgrade;
+        }
+
+        // 可升级读锁 -> 写锁
+        void upgrade() {
+            assert( _status == LockStatus::Upgrade);
+            if(_status != LockStatus::Upgrade) {
+                return;
+            }
+            _mutex->unlock_upgrade_and_lock();
+            _status = LockStatus::Exclusive;
+        }
+
+        // 写锁 -> 读锁，可升级读锁 -> 读锁
+        void downgrade() {
+            if(_status == LockStatus::Exclusive) {
+                _mutex->unlock_and_lock_shared();
+            } else if(_status == LockStatus::Upgrade) {
+                _mutex->unlock_upgrade_and_lock_shared();
+            } else {
+                assert(false);
+                return;
+            }
+            _status = LockStatus::Shared;
+        }
+
+        ~BasicSharedMutexLock() {
             switch(_status) {
                 case LockStatus::Shared: {
                     _mutex->unlock_shared();
                     break;
                 }
+                case LockStatus::Upgrade: {
+                    _mutex->unlock_upgrade();
+                    break;
+                }
                 case LockStatus::Exclusive: {
-                    _mutex->unlock(); 
+                    _mutex->unlock();
                     break;
                 }
                 case LockStatus::None:
@@ -166,5 +487,6 @@ namespace comm {
 
     };
 
+    using SharedMutexLock = BasicSharedMutexLock<SharedMutex>;
 
-}
\ No newline at end of file
+}
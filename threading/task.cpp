@@ -0,0 +1,161 @@
+#include "task.h"
+#include "../memory/memory.h"
+#include <mutex>
+#include <condition_variable>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace comm {
+
+    constexpr size_t FrameGranularity = 64;
+    constexpr size_t FrameClassCount = 32;      // 缓存 2KB 以内的帧
+    constexpr uint32_t FrameCacheLimit = 64;    // 每档每线程最多缓存多少个
+
+    /**
+     * @brief 每个线程一份的协程帧缓存，空闲的帧用头 8 个字节串成单链表
+     *  协程会在线程之间跳，帧在哪个线程释放就进哪个线程的缓存。
+     *  平凡析构，别的 thread_local 析构时释放帧也能安全访问；清理放在 FrameCacheFlusher 的析构里，
+     *  清理之后标记 dead，之后的分配释放直接走 comm_alloc / comm_free
+     */
+    struct frame_cache_t {
+        void*       heads[FrameClassCount];
+        uint32_t    counts[FrameClassCount];
+        bool        registered;
+        bool        dead;
+    };
+
+    static thread_local frame_cache_t FrameCache;
+
+    struct frame_cache_flusher_t {
+        ~frame_cache_flusher_t() {
+            for(size_t i = 0; i < FrameClassCount; ++i) {
+                while(void* frame = FrameCache.heads[i]) {
+                    FrameCache.heads[i] = *(void**)frame;
+                    comm_free(frame);
+                }
+                FrameCache.counts[i] = 0;
+            }
+            FrameCache.dead = true;
+        }
+    };
+
+    static thread_local frame_cache_flusher_t FrameCacheFlusher;
+
+    // 线程退出清理之后返回 nullptr
+    static frame_cache_t* LocalFrameCache() {
+        frame_cache_t& cache = FrameCache;
+        if(cache.dead) {
+            return nullptr;
+        }
+        if(!cache.registered) {
+            (void)&FrameCacheFlusher;   // 第一次用到时构造，线程退出时析构
+            cache.registered = true;
+        }
+        return &cache;
+    }
+
+    void* AllocateTaskFrame(size_t size) {
+        size_t index = (size + FrameGranularity - 1) / FrameGranularity - 1;
+        frame_cache_t* cache = index < FrameClassCount ? LocalFrameCache() : nullptr;
+        if(!cache) {
+            return comm_alloc(size);
+        }
+        if(void* frame = cache->heads[index]) {
+            cache->heads[index] = *(void**)frame;
+            --cache->counts[index];
+            return frame;
+        }
+        return comm_alloc((index + 1) * FrameGranularity);
+    }
+
+    void FreeTaskFrame(void* frame, size_t size) {
+        size_t index = (size + FrameGranularity - 1) / FrameGranularity - 1;
+        frame_cache_t* cache = index < FrameClassCount ? LocalFrameCache() : nullptr;
+        if(!cache || cache->counts[index] >= FrameCacheLimit) {
+            comm_free(frame);
+            return;
+        }
+        *(void**)frame = cache->heads[index];
+        cache->heads[index] = frame;
+        ++cache->counts[index];
+    }
+
+    /**
+     * @brief SleepAwaitable 用的定时线程，按到期时间排的小根堆
+     */
+    class TaskTimer {
+    private:
+        struct timer_t {
+            SleepAwaitable::clock_t::time_point     deadline;
+            std::coroutine_handle<>                 handle;
+            bool operator < (timer_t const& other) const {
+                return deadline > other.deadline;
+            }
+        };
+        std::priority_queue<timer_t>    _timers;
+        std::mutex                      _mutex;
+        std::condition_variable         _cv;
+        std::thread                     _thread;
+        bool                            _exit;
+    private:
+        TaskTimer()
+            : _timers()
+            , _mutex()
+            , _cv()
+            , _thread()
+            , _exit(false)
+        {
+            _thread = std::thread(&TaskTimer::timerMain, this);
+        }
+        void timerMain() {
+            std::unique_lock<std::mutex> lock(_mutex);
+            while(!_exit) {
+                if(_timers.empty()) {
+                    _cv.wait(lock);
+                    continue;
+                }
+                auto deadline = _timers.top().deadline;
+                if(SleepAwaitable::clock_t::now() < deadline) {
+                    _cv.wait_until(lock, deadline);
+                    continue;
+                }
+                auto handle = _timers.top().handle;
+                _timers.pop();
+                lock.unlock();
+                JobSystem::Instance()->resume(handle);
+                lock.lock();
+            }
+        }
+    public:
+        // 第一次 SleepFor 可能在任意线程上，用函数内的静态变量保证只有一个定时线程；故意不释放
+        static TaskTimer* Instance() {
+            static TaskTimer* timer = new TaskTimer();
+            return timer;
+        }
+        void add(SleepAwaitable::clock_t::time_point deadline, std::coroutine_handle<> handle) {
+            bool earliest;
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                earliest = _timers.empty() || deadline < _timers.top().deadline;
+                _timers.push({ deadline, handle });
+            }
+            if(earliest) {
+                _cv.notify_one();
+            }
+        }
+        ~TaskTimer() {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _exit = true;
+            }
+            _cv.notify_one();
+            _thread.join();
+        }
+    };
+
+    void SleepAwaitable::await_suspend(std::coroutine_handle<> handle) {
+        TaskTimer::Instance()->add(_deadline, handle);
+    }
+
+}
@@ -0,0 +1,298 @@
+#pragma once
+
+/**
+ * @file task.h
+ * @brief C++20 协程任务 Task<T>
+ *  惰性启动：创建时不执行，被 co_await（或者交给 Spawn / SyncWait）时才开始跑。
+ *  co_await 子任务和子任务结束回到父任务都是对称转移（await_suspend 返回 handle），
+ *  一长串同步完成的子任务也不会让栈越来越深（GCC 只在开优化时保证生成尾调用，Debug 下很深的同步链仍可能爆栈）。
+ *  协程帧从按大小分档的线程缓存里分配，不走全局堆。
+ *
+ *  等待体：
+ *   - co_await archive->read(path, offset, size)     异步读文件，见 IArchive::read
+ *   - co_await JobYield()                            让出当前线程，换到 JobSystem 的工作线程上继续
+ *   - co_await SleepFor(duration) / SleepUntil(time) 定时器，到点后在工作线程上继续
+ */
+
+#include "job_system.h"
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <chrono>
+#include <stdexcept>
+#include <utility>
+
+namespace comm {
+
+    // 协程帧分配，按 64 字节分档缓存在当前线程，太大的直接 comm_alloc
+    void* AllocateTaskFrame(size_t size);
+    void FreeTaskFrame(void* frame, size_t size);
+
+    template<class T> class Task;
+
+    // co_await / Spawn / SyncWait 一个空的 Task（默认构造或者被 move 走的）是调用者的错误，没有 promise 可以取结果
+    [[noreturn]] inline void ThrowEmptyTask() {
+        throw std::logic_error("awaiting an empty Task");
+    }
+
+    class TaskPromiseBase {
+    protected:
+        std::coroutine_handle<>     _continuation;
+        std::exception_ptr          _exception;
+    public:
+        struct FinalAwaiter {
+            bool await_ready() const noexcept {
+                return false;
+            }
+            template<class Promise>
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+                auto continuation = handle.promise()._continuation;
+                return continuation ? continuation : std::noop_coroutine();
+            }
+            void await_resume() const noexcept {}
+        };
+    public:
+        TaskPromiseBase()
+            : _continuation()
+            , _exception()
+        {}
+        std::suspend_always initial_suspend() noexcept {
+            return {};
+        }
+        FinalAwaiter final_suspend() noexcept {
+            return {};
+        }
+        void unhandled_exception() noexcept {
+            _exception = std::current_exception();
+        }
+        void setContinuation(std::coroutine_handle<> continuation) {
+            _continuation = continuation;
+        }
+        static void* operator new(size_t size) {
+            return AllocateTaskFrame(size);
+        }
+        static void operator delete(void* frame, size_t size) {
+            FreeTaskFrame(frame, size);
+        }
+    };
+
+    template<class T>
+    class TaskPromise : public TaskPromiseBase {
+    private:
+        std::optional<T>            _value;
+    public:
+        Task<T> get_return_object() noexcept;
+        template<class U>
+        void return_value(U&& value) {
+            _value.emplace(std::forward<U>(value));
+        }
+        T result() {
+            if(_exception) {
+                std::rethrow_exception(_exception);
+            }
+            return std::move(*_value);
+        }
+    };
+
+    template<>
+    class TaskPromise<void> : public TaskPromiseBase {
+    public:
+        Task<void> get_return_object() noexcept;
+        void return_void() noexcept {}
+        void result() {
+            if(_exception) {
+                std::rethrow_exception(_exception);
+            }
+        }
+    };
+
+    template<class T = void>
+    class Task {
+    public:
+        using promise_type = TaskPromise<T>;
+        using handle_t = std::coroutine_handle<promise_type>;
+    private:
+        handle_t        _handle;
+    private:
+        struct awaiter_t {
+            handle_t    handle;
+            // 空的 Task 不挂起，到 await_resume 里报错
+            bool await_ready() const noexcept {
+                return !handle || handle.done();
+            }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+                handle.promise().setContinuation(awaiting);
+                return handle;
+            }
+        };
+        struct result_awaiter_t : awaiter_t {
+            T await_resume() {
+                if(!this->handle) {
+                    ThrowEmptyTask();
+                }
+                return this->handle.promise().result();
+            }
+        };
+        // 只等结束不取结果，给 Spawn / SyncWait 用
+        struct ready_awaiter_t : awaiter_t {
+            void await_resume() const noexcept {}
+        };
+        template<class U> friend U SyncWait(Task<U> task);
+        template<class U> friend void Spawn(Task<U> task);
+    public:
+        Task()
+            : _handle()
+        {}
+        explicit Task(handle_t handle)
+            : _handle(handle)
+        {}
+        Task(Task&& task) noexcept
+            : _handle(std::exchange(task._handle, {}))
+        {}
+        Task& operator = (Task&& task) noexcept {
+            if(this != &task) {
+                if(_handle) {
+                    _handle.destroy();
+                }
+                _handle = std::exchange(task._handle, {});
+            }
+            return *this;
+        }
+        Task(Task const&) = delete;
+        Task& operator = (Task const&) = delete;
+
+        bool valid() const {
+            return (bool)_handle;
+        }
+        bool done() const {
+            return !_handle || _handle.done();
+        }
+        result_awaiter_t operator co_await() & noexcept {
+            return { { _handle } };
+        }
+        result_awaiter_t operator co_await() && noexcept {
+            return { { _handle } };
+        }
+        ~Task() {
+            if(_handle) {
+                _handle.destroy();
+            }
+        }
+    };
+
+    template<class T>
+    Task<T> TaskPromise<T>::get_return_object() noexcept {
+        return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+    }
+
+    inline Task<void> TaskPromise<void>::get_return_object() noexcept {
+        return Task<void>(std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+    }
+
+    /**
+     * @brief 立即开始、跑完自己销毁的协程，用来从普通函数里驱动 Task
+     */
+    struct DetachedTask {
+        struct promise_type {
+            DetachedTask get_return_object() noexcept {
+                return {};
+            }
+            std::suspend_never initial_suspend() noexcept {
+                return {};
+            }
+            std::suspend_never final_suspend() noexcept {
+                return {};
+            }
+            void return_void() noexcept {}
+            void unhandled_exception() noexcept {
+                std::terminate();
+            }
+            static void* operator new(size_t size) {
+                return AllocateTaskFrame(size);
+            }
+            static void operator delete(void* frame, size_t size) {
+                FreeTaskFrame(frame, size);
+            }
+        };
+    };
+
+    /**
+     * @brief 在当前线程开始执行 task，第一次挂起时返回，不等它结束；task 里的异常会 terminate
+     */
+    template<class T>
+    void Spawn(Task<T> task) {
+        if(!task._handle) {
+            ThrowEmptyTask();
+        }
+        [](Task<T> task) -> DetachedTask {
+            co_await typename Task<T>::ready_awaiter_t { { task._handle } };
+            task._handle.promise().result();
+        }(std::move(task));
+    }
+
+    /**
+     * @brief 阻塞到 task 执行完，返回它的结果
+     *  用 JobSystem::wait 等待，所以在工作线程里调用也不会把线程池堵死
+     */
+    template<class T>
+    T SyncWait(Task<T> task) {
+        if(!task._handle) {
+            ThrowEmptyTask();
+        }
+        auto jobs = JobSystem::Instance();
+        JobCounter counter;
+        jobs->addPending(counter);
+        [](Task<T>& task, JobCounter& counter) -> DetachedTask {
+            co_await typename Task<T>::ready_awaiter_t { { task._handle } };
+            JobSystem::Instance()->complete(counter);
+        }(task, counter);
+        jobs->wait(counter);
+        return task._handle.promise().result();
+    }
+
+    /**
+     * @brief 挂起当前协程，交给 JobSystem 在工作线程上恢复
+     */
+    struct JobYieldAwaitable {
+        bool await_ready() const noexcept {
+            return false;
+        }
+        void await_suspend(std::coroutine_handle<> handle) {
+            JobSystem::Instance()->resume(handle);
+        }
+        void await_resume() const noexcept {}
+    };
+
+    inline JobYieldAwaitable JobYield() {
+        return {};
+    }
+
+    /**
+     * @brief 定时器等待体，由一个专门的定时线程计时，到点后在 JobSystem 的工作线程上恢复
+     */
+    class SleepAwaitable {
+    public:
+        using clock_t = std::chrono::steady_clock;
+    private:
+        clock_t::time_point     _deadline;
+    public:
+        explicit SleepAwaitable(clock_t::time_point deadline)
+            : _deadline(deadline)
+        {}
+        bool await_ready() const noexcept {
+            return _deadline <= clock_t::now();
+        }
+        void await_suspend(std::coroutine_handle<> handle);
+        void await_resume() const noexcept {}
+    };
+
+    inline SleepAwaitable SleepUntil(SleepAwaitable::clock_t::time_point deadline) {
+        return SleepAwaitable(deadline);
+    }
+
+    template<class Rep, class Period>
+    SleepAwaitable SleepFor(std::chrono::duration<Rep, Period> duration) {
+        return SleepAwaitable(SleepAwaitable::clock_t::now() + std::chrono::duration_cast<SleepAwaitable::clock_t::duration>(duration));
+    }
+
+}
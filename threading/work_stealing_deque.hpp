@@ -0,0 +1,137 @@
+#pragma once
+
+/**
+ * @file work_stealing_deque.hpp
+ * @brief Chase-Lev 工作窃取队列（按 Lê 等人 2013 年 C11 内存模型的版本实现）
+ *  只有所有者线程能 push/pop（在底部，后进先出，缓存友好），其它线程从顶部 steal（先进先出）。
+ *  满了之后扩容成两倍，旧的数组可能还有窃取者在读，留到析构时再释放。
+ */
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+#include <type_traits>
+
+namespace comm {
+
+    template<class T>
+    class WorkStealingDeque {
+        static_assert(std::is_trivially_copyable<T>::value, "WorkStealingDeque stores trivially copyable items");
+    private:
+        struct array_t {
+            int64_t             capacity;
+            int64_t             mask;
+            std::atomic<T>*     items;
+
+            array_t(int64_t cap)
+                : capacity(cap)
+                , mask(cap - 1)
+                , items(new std::atomic<T>[cap])
+            {}
+            T get(int64_t index) const {
+                return items[index & mask].load(std::memory_order_relaxed);
+            }
+            void put(int64_t index, T item) {
+                items[index & mask].store(item, std::memory_order_relaxed);
+            }
+            ~array_t() {
+                delete[] items;
+            }
+        };
+    private:
+        alignas(64) std::atomic<int64_t>    _top;
+        alignas(64) std::atomic<int64_t>    _bottom;
+        std::atomic<array_t*>               _array;
+        std::vector<array_t*>               _retired;   // 只有所有者线程访问
+    private:
+        array_t* grow(array_t* array, int64_t bottom, int64_t top) {
+            array_t* bigger = new array_t(array->capacity * 2);
+            for(int64_t i = top; i < bottom; ++i) {
+                bigger->put(i, array->get(i));
+            }
+            _retired.push_back(array);
+            _array.store(bigger, std::memory_order_release);
+            return bigger;
+        }
+    public:
+        WorkStealingDeque(int64_t capacity = 256)
+            : _top(0)
+            , _bottom(0)
+            , _array(nullptr)
+        {
+            int64_t cap = 1;
+            while(cap < capacity) {
+                cap <<= 1;
+            }
+            _array.store(new array_t(cap), std::memory_order_relaxed);
+        }
+        WorkStealingDeque(WorkStealingDeque const&) = delete;
+        WorkStealingDeque& operator = (WorkStealingDeque const&) = delete;
+
+        // 所有者线程
+        void push(T item) {
+            int64_t bottom = _bottom.load(std::memory_order_relaxed);
+            int64_t top = _top.load(std::memory_order_acquire);
+            array_t* array = _array.load(std::memory_order_relaxed);
+            if(bottom - top > array->capacity - 1) {
+                array = grow(array, bottom, top);
+            }
+            array->put(bottom, item);
+            // 论文里是 release fence + relaxed store，这里直接 release store，效果一样
+            _bottom.store(bottom + 1, std::memory_order_release);
+        }
+
+        // 所有者线程，空的时候返回 false
+        bool pop(T& item) {
+            int64_t bottom = _bottom.load(std::memory_order_relaxed) - 1;
+            array_t* array = _array.load(std::memory_order_relaxed);
+            _bottom.store(bottom, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t top = _top.load(std::memory_order_relaxed);
+            bool rst = true;
+            if(top <= bottom) {
+                item = array->get(bottom);
+                if(top == bottom) {
+                    // 只剩最后一个，和窃取者抢
+                    if(!_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                        rst = false;
+                    }
+                    _bottom.store(bottom + 1, std::memory_order_relaxed);
+                }
+            } else {
+                rst = false;
+                _bottom.store(bottom + 1, std::memory_order_relaxed);
+            }
+            return rst;
+        }
+
+        // 任意线程，空的或者没抢到返回 false
+        bool steal(T& item) {
+            int64_t top = _top.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t bottom = _bottom.load(std::memory_order_acquire);
+            if(top >= bottom) {
+                return false;
+            }
+            array_t* array = _array.load(std::memory_order_acquire);
+            T stolen = array->get(top);
+            if(!_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                return false;
+            }
+            item = stolen;
+            return true;
+        }
+
+        bool empty() const {
+            return _bottom.load(std::memory_order_relaxed) <= _top.load(std::memory_order_relaxed);
+        }
+
+        ~WorkStealingDeque() {
+            delete _array.load(std::memory_order_relaxed);
+            for(auto array : _retired) {
+                delete array;
+            }
+        }
+    };
+
+}
@@ -0,0 +1,56 @@
+#include <io/pkg_builder.h>
+#include <filesystem>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+/**
+ * @brief 资源包打包工具
+ *  pkg_packer <输入目录> <输出文件> [--align N] [--no-compress]
+ */
+
+int main(int argc, char** argv) {
+    if(argc < 3) {
+        printf("usage: %s <input_dir> <output.pkg> [--align N] [--no-compress]\n", argv[0]);
+        return 1;
+    }
+    comm::PkgBuilder::Options options;
+    for(int i = 3; i < argc; ++i) {
+        if(!strcmp(argv[i], "--align") && i + 1 < argc) {
+            options.alignment = (uint32_t)strtoul(argv[++i], nullptr, 10);
+        } else if(!strcmp(argv[i], "--no-compress")) {
+            options.compress = false;
+        } else {
+            printf("unknown option : %s\n", argv[i]);
+            return 1;
+        }
+    }
+    namespace fs = std::filesystem;
+    fs::path root(argv[1]);
+    std::error_code ec;
+    if(!fs::is_directory(root, ec)) {
+        printf("%s is not a directory\n", argv[1]);
+        return 1;
+    }
+    comm::PkgBuilder builder(options);
+    for(auto it = fs::recursive_directory_iterator(root, ec); !ec && it != fs::recursive_directory_iterator(); it.increment(ec)) {
+        if(!it->is_regular_file()) {
+            continue;
+        }
+        std::string packPath = fs::relative(it->path(), root).generic_string();
+        if(!builder.addFile(packPath, it->path().string())) {
+            printf("failed to add %s (duplicated path or hash collision)\n", packPath.c_str());
+            return 1;
+        }
+    }
+    if(ec) {
+        printf("failed to walk %s : %s\n", argv[1], ec.message().c_str());
+        return 1;
+    }
+    if(!builder.write(argv[2])) {
+        printf("failed to write %s\n", argv[2]);
+        return 1;
+    }
+    printf("packed %zu files into %s\n", builder.count(), argv[2]);
+    return 0;
+}
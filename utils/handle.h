@@ -10,6 +10,7 @@
  * 
  */
 #include <atomic>
+#include <memory/object_pool.h>
 
 /**
  * @brief 
@@ -18,6 +19,9 @@
 
 namespace comm {
 
+    class RefInfo;
+    ObjectPool<RefInfo>& RefInfoPool();
+
     class RefInfo {
     private:
         std::atomic<int>                ref_;
@@ -34,7 +38,7 @@ namespace comm {
         void deRef() {
             --ref_;
             if(ref_ == 0) {
-                delete this;
+                RefInfoPool().destroy(this);
             }
         }
         int refCount() const {
@@ -48,6 +52,14 @@ namespace comm {
         }
     };
 
+    /**
+     * @brief RefInfo 创建销毁很频繁，走带线程缓存的对象池；池子不析构，进程退出时还可能有 Handle 没释放
+     */
+    inline ObjectPool<RefInfo>& RefInfoPool() {
+        static ObjectPool<RefInfo>* pool = new ObjectPool<RefInfo>(0, true);
+        return *pool;
+    }
+
     class Handle {
         friend class ObjectHandle;
     private:
@@ -59,7 +71,7 @@ namespace comm {
         }
         // 逻辑层不可手动创建Handle对象，只能通过GObject来获取弱引用
         Handle(void* ptr) {
-            ref_ = new RefInfo(ptr);
+            ref_ = RefInfoPool().create(ptr);
         }
         Handle(Handle const& handle) {
             ref_ = handle.ref_;